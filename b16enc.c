@@ -13,6 +13,7 @@
 #include <unistd.h>
 #include <string.h>
 #include "base64.h"
+#include "cli.h"
 int main(int argc, char *argv[])
 {
         struct finfo *fd;
@@ -21,6 +22,10 @@ int main(int argc, char *argv[])
         ssize_t wr;
         size_t out_len;
 
+        if (argc > 1 && argv[1][0] == '-') {
+                return cli_run(argc, argv, BASE16, 0);
+        }
+
         if (argv[1]) {
                 if ((fd = get_file(argv[1])) == NULL) {
                         perror("get_file");
@@ -38,7 +43,7 @@ int main(int argc, char *argv[])
 
                         if ((ofd = open(argv[2], O_CREAT | O_RDWR, S_IRUSR | O_TRUNC | S_IWUSR)) == -1) {
                                 perror("open");
-                                free(enc_buf);
+                                dealloc(enc_buf, buf_len);
                                 free_finfo(fd);
                                 return EXIT_FAILURE;
                         }
@@ -47,12 +52,12 @@ int main(int argc, char *argv[])
                         if (wr == -1 || (size_t)wr != out_len) {
                                 perror("write");
                                 close(ofd);
-                                free(enc_buf);
+                                dealloc(enc_buf, buf_len);
                                 free_finfo(fd);
                                 return EXIT_FAILURE;
                         }
                         close(ofd);
-                        free(enc_buf);
+                        dealloc(enc_buf, buf_len);
                 }
                 free_finfo(fd);
         }
@@ -0,0 +1,291 @@
+/*
+ *      client of the b64d codec daemon, encodes or decodes 'src' into
+ *      'dst' like the b64enc family of tools but the work is done by the
+ *      resident daemon. By default the two files are opened here and
+ *      their descriptors are passed to the daemon, -i sends the data
+ *      through the socket and -P sends the paths.
+ *
+ *      usage: b64c [-d] [-t 64|32|16] [-i | -P] [-S socket] src dst
+ *
+ *  Copyright Orestes Leal Rodriguez 2015-2025 <lukes357@gmail.com>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "base64.h"
+#include "b64d.h"
+
+static int read_full(int fd, void *b, size_t len)
+{
+        for (size_t off = 0; off < len;) {
+                ssize_t rd = read(fd, (char *)b + off, len - off);
+                if (rd < 0) {
+                        if (errno == EINTR) {
+                                continue;
+                        }
+                        return -1;
+                }
+                if (rd == 0) {
+                        errno = ECONNRESET;
+                        return -1;
+                }
+                off += (size_t)rd;
+        }
+        return 0;
+}
+
+static int write_all(int fd, const void *b, size_t len)
+{
+        for (size_t off = 0; off < len;) {
+                ssize_t wr = write(fd, (const char *)b + off, len - off);
+                if (wr < 0) {
+                        if (errno == EINTR) {
+                                continue;
+                        }
+                        return -1;
+                }
+                off += (size_t)wr;
+        }
+        return 0;
+}
+
+/* read all of 'fd' into a malloc'ed buffer */
+static char *slurp(int fd, size_t *len)
+{
+        size_t n = 0, cap = 65536;
+        char *b = malloc(cap), *p;
+
+        while (b != NULL) {
+                ssize_t rd;
+
+                if (n == cap) {
+                        if ((p = realloc(b, cap * 2)) == NULL) {
+                                break;
+                        }
+                        b = p;
+                        cap *= 2;
+                }
+                if ((rd = read(fd, b + n, cap - n)) < 0) {
+                        if (errno == EINTR) {
+                                continue;
+                        }
+                        break;
+                }
+                if (rd == 0) {
+                        *len = n;
+                        return b;
+                }
+                n += (size_t)rd;
+        }
+        free(b);
+        return NULL;
+}
+
+/* send the header with 'fds' attached when 'nfds' is not 0 */
+static int send_req(int s, const struct b64d_req *rq, const int *fds, int nfds)
+{
+        union {
+                struct cmsghdr h;
+                char b[CMSG_SPACE(2 * sizeof(int))];
+        } ctl;
+        struct iovec iov = {(void *)rq, sizeof(*rq)};
+        struct msghdr msg;
+        ssize_t n;
+
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        if (nfds > 0) {
+                struct cmsghdr *cm;
+
+                memset(&ctl, 0, sizeof(ctl));
+                msg.msg_control = ctl.b;
+                msg.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+                cm = CMSG_FIRSTHDR(&msg);
+                cm->cmsg_level = SOL_SOCKET;
+                cm->cmsg_type = SCM_RIGHTS;
+                cm->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+                memcpy(CMSG_DATA(cm), fds, nfds * sizeof(int));
+        }
+        while ((n = sendmsg(s, &msg, MSG_NOSIGNAL)) < 0 && errno == EINTR);
+        if (n < 0) {
+                return -1;
+        }
+        return write_all(s, (const char *)rq + n, sizeof(*rq) - (size_t)n);
+}
+
+/* 'path' made absolute, the daemon does not share our working directory */
+static char *absolute(const char *path)
+{
+        char cwd[PATH_MAX];
+        char *p;
+
+        if (path[0] == '/') {
+                return strdup(path);
+        }
+        if (getcwd(cwd, sizeof(cwd)) == NULL ||
+            (p = malloc(strlen(cwd) + strlen(path) + 2)) == NULL) {
+                return NULL;
+        }
+        sprintf(p, "%s/%s", cwd, path);
+        return p;
+}
+
+static void usage(const char *prog)
+{
+        fprintf(stderr,
+                "usage: %s [-d] [-t 64|32|16] [-i | -P] [-S socket] src dst\n"
+                "\n"
+                "  -d         decode instead of encode\n"
+                "  -t base    64 (default), 32 or 16\n"
+                "  -i         send the data through the socket instead of the descriptors\n"
+                "  -P         send the paths, the daemon opens the files itself\n"
+                "  -S socket  path of the daemon socket (default: $B64D_SOCKET or %s)\n"
+                "\n"
+                "src and dst may be '-' for stdin and stdout except with -P\n",
+                prog, B64D_SOCKET);
+}
+
+int main(int argc, char *argv[])
+{
+        const char *path = getenv("B64D_SOCKET");
+        struct b64d_req rq = {B64D_MAGIC, BASE64, 0, B64D_FD, 0, 0};
+        struct b64d_resp resp;
+        struct sockaddr_un addr;
+        const char *src, *dst;
+        char *payload = NULL, *out = NULL;
+        int s, opt, fds[2] = {-1, -1};
+        int status = EXIT_FAILURE;
+
+        while ((opt = getopt(argc, argv, "dt:iPS:h")) != -1) {
+                switch (opt) {
+                        case 'd':
+                                rq.decode = 1;
+                                break;
+                        case 't':
+                                if (strcmp(optarg, "64") == 0) {
+                                        rq.mode = BASE64;
+                                } else if (strcmp(optarg, "32") == 0) {
+                                        rq.mode = BASE32;
+                                } else if (strcmp(optarg, "16") == 0) {
+                                        rq.mode = BASE16;
+                                } else {
+                                        fprintf(stderr, "%s: not a base: %s\n", argv[0], optarg);
+                                        return EXIT_FAILURE;
+                                }
+                                break;
+                        case 'i':
+                                rq.kind = B64D_INLINE;
+                                break;
+                        case 'P':
+                                rq.kind = B64D_PATH;
+                                break;
+                        case 'S':
+                                path = optarg;
+                                break;
+                        default:
+                                usage(argv[0]);
+                                return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+                }
+        }
+        if (argc - optind != 2) {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+        src = argv[optind];
+        dst = argv[optind + 1];
+        if (path == NULL) {
+                path = B64D_SOCKET;
+        }
+
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+        if ((s = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1 ||
+            connect(s, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+                fprintf(stderr, "%s: %s: %s\n", argv[0], path, strerror(errno));
+                return EXIT_FAILURE;
+        }
+
+        if (rq.kind == B64D_PATH) {
+                char *a = absolute(src), *b = absolute(dst);
+                size_t la, lb;
+
+                if (a == NULL || b == NULL || (payload = malloc((la = strlen(a) + 1) +
+                                                                (lb = strlen(b) + 1))) == NULL) {
+                        perror(argv[0]);
+                        free(a);
+                        free(b);
+                        goto cleanup;
+                }
+                memcpy(payload, a, la);
+                memcpy(payload + la, b, lb);
+                rq.len = la + lb;
+                free(a);
+                free(b);
+        } else {
+                fds[0] = strcmp(src, "-") == 0 ? STDIN_FILENO : open(src, O_RDONLY);
+                if (fds[0] == -1) {
+                        fprintf(stderr, "%s: %s: %s\n", argv[0], src, strerror(errno));
+                        goto cleanup;
+                }
+                fds[1] = strcmp(dst, "-") == 0 ? STDOUT_FILENO :
+                         open(dst, O_CREAT | O_WRONLY | O_TRUNC, S_IRUSR | S_IWUSR);
+                if (fds[1] == -1) {
+                        fprintf(stderr, "%s: %s: %s\n", argv[0], dst, strerror(errno));
+                        goto cleanup;
+                }
+                if (rq.kind == B64D_INLINE) {
+                        size_t len;
+                        if ((payload = slurp(fds[0], &len)) == NULL) {
+                                fprintf(stderr, "%s: %s: %s\n", argv[0], src, strerror(errno));
+                                goto cleanup;
+                        }
+                        rq.len = len;
+                }
+        }
+
+        if (send_req(s, &rq, fds, rq.kind == B64D_FD ? 2 : 0) == -1 ||
+            (rq.len > 0 && write_all(s, payload, (size_t)rq.len) == -1) ||
+            read_full(s, &resp, sizeof(resp)) == -1) {
+                fprintf(stderr, "%s: %s: %s\n", argv[0], path, strerror(errno));
+                goto cleanup;
+        }
+        if (resp.len > 0) {
+                if ((out = malloc((size_t)resp.len)) == NULL ||
+                    read_full(s, out, (size_t)resp.len) == -1) {
+                        fprintf(stderr, "%s: %s: %s\n", argv[0], path, strerror(errno));
+                        goto cleanup;
+                }
+                if (write_all(fds[1], out, (size_t)resp.len) == -1) {
+                        fprintf(stderr, "%s: %s: %s\n", argv[0], dst, strerror(errno));
+                        goto cleanup;
+                }
+        }
+        if (resp.err != 0) {
+                fprintf(stderr, "%s: %s: %s\n", argv[0], src, strerror(resp.err));
+                goto cleanup;
+        }
+        status = EXIT_SUCCESS;
+
+cleanup:
+        if (fds[0] > STDIN_FILENO) {
+                close(fds[0]);
+        }
+        if (fds[1] > STDOUT_FILENO && close(fds[1]) == -1 && status == EXIT_SUCCESS) {
+                fprintf(stderr, "%s: %s: %s\n", argv[0], dst, strerror(errno));
+                status = EXIT_FAILURE;
+        }
+        free(payload);
+        free(out);
+        close(s);
+        return status;
+}
@@ -0,0 +1,339 @@
+/*
+ *      resident codec daemon, serves encode and decode requests from
+ *      b64c over a Unix domain socket so scripts don't pay for an exec
+ *      and cold buffers on every file. Every worker thread accepts its
+ *      own connections and keeps its buffers from request to request.
+ *
+ *      usage: b64d [-S socket] [-j workers]
+ *
+ *  Copyright Orestes Leal Rodriguez 2015-2025 <lukes357@gmail.com>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "base64.h"
+#include "b64d.h"
+
+#define MAX_INLINE (1ULL << 30)         /* largest inline payload accepted */
+
+struct worker {
+        pthread_t tid;
+        int lfd;
+        struct codec_arena *a;  /* output buffer, kept warm */
+        char *in;               /* input buffer, kept warm */
+        size_t in_cap;
+};
+
+static int read_full(int fd, void *b, size_t len)
+{
+        for (size_t off = 0; off < len;) {
+                ssize_t rd = read(fd, (char *)b + off, len - off);
+                if (rd < 0) {
+                        if (errno == EINTR) {
+                                continue;
+                        }
+                        return -1;
+                }
+                if (rd == 0) {
+                        errno = ECONNRESET;
+                        return -1;
+                }
+                off += (size_t)rd;
+        }
+        return 0;
+}
+
+static int write_all(int fd, const void *b, size_t len)
+{
+        for (size_t off = 0; off < len;) {
+                ssize_t wr = write(fd, (const char *)b + off, len - off);
+                if (wr < 0) {
+                        if (errno == EINTR) {
+                                continue;
+                        }
+                        return -1;
+                }
+                off += (size_t)wr;
+        }
+        return 0;
+}
+
+/* grow the input buffer of 'w' to 'size' bytes, keeping its contents */
+static int reserve(struct worker *w, size_t size)
+{
+        char *p;
+
+        if (size <= w->in_cap) {
+                return 0;
+        }
+        if (size < w->in_cap + w->in_cap / 2) {
+                size = w->in_cap + w->in_cap / 2;
+        }
+        if ((p = realloc(w->in, size)) == NULL) {
+                errno = ENOMEM;
+                return -1;
+        }
+        w->in = p;
+        w->in_cap = size;
+        return 0;
+}
+
+/* read everything 'fd' has into the input buffer */
+static int read_fd(struct worker *w, int fd, size_t *len)
+{
+        struct stat st;
+        size_t n = 0;
+
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && reserve(w, (size_t)st.st_size + 1) == -1) {
+                return -1;
+        }
+        for (;;) {
+                ssize_t rd;
+
+                if (n == w->in_cap && reserve(w, n ? n * 2 : 65536) == -1) {
+                        return -1;
+                }
+                if ((rd = read(fd, w->in + n, w->in_cap - n)) < 0) {
+                        if (errno == EINTR) {
+                                continue;
+                        }
+                        return -1;
+                }
+                if (rd == 0) {
+                        break;
+                }
+                n += (size_t)rd;
+        }
+        *len = n;
+        return 0;
+}
+
+/* receive a request header and the descriptors sent with it, returns 0
+   at the end of the connection */
+static int recv_req(int c, struct b64d_req *rq, int fds[2], int *nfds)
+{
+        union {
+                struct cmsghdr h;
+                char b[CMSG_SPACE(2 * sizeof(int))];
+        } ctl;
+        struct iovec iov = {rq, sizeof(*rq)};
+        struct msghdr msg;
+        struct cmsghdr *cm;
+        ssize_t n;
+
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = ctl.b;
+        msg.msg_controllen = sizeof(ctl.b);
+        while ((n = recvmsg(c, &msg, 0)) < 0 && errno == EINTR);
+        if (n <= 0) {
+                return (int)n;
+        }
+        *nfds = 0;
+        for (cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm)) {
+                if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_RIGHTS) {
+                        int k = (int)((cm->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+                        for (int i = 0; i < k; i++) {
+                                int fd;
+                                memcpy(&fd, CMSG_DATA(cm) + i * sizeof(int), sizeof(int));
+                                if (*nfds < 2) {
+                                        fds[(*nfds)++] = fd;
+                                } else {
+                                        close(fd);
+                                }
+                        }
+                }
+        }
+        if ((size_t)n < sizeof(*rq) &&
+            read_full(c, (char *)rq + n, sizeof(*rq) - (size_t)n) == -1) {
+                return -1;
+        }
+        return 1;
+}
+
+/* run one request, the reply is sent unless the connection failed */
+static int serve(struct worker *w, int c, const struct b64d_req *rq, int fds[2], int nfds)
+{
+        struct b64d_resp resp = {0, 0, 0};
+        const char *out = NULL;
+        size_t len = 0, out_len = 0;
+
+        if (rq->magic != B64D_MAGIC || codec_buf_size(rq->mode, rq->decode, 0) == 0) {
+                resp.err = EPROTO;
+        } else if (rq->kind == B64D_INLINE) {
+                if (rq->len > MAX_INLINE) {
+                        return -1;      /* the payload can't be skipped */
+                }
+                len = (size_t)rq->len;
+                if (reserve(w, len + 1) == -1 || read_full(c, w->in, len) == -1) {
+                        return -1;
+                }
+                if ((out = codec_arena_mem(w->a, rq->mode, rq->decode, w->in, len, &out_len)) == NULL) {
+                        resp.err = errno;
+                }
+        } else if (rq->kind == B64D_PATH) {
+                const char *src, *dst;
+
+                if (rq->len > 2 * PATH_MAX + 2 || reserve(w, (size_t)rq->len + 1) == -1 ||
+                    read_full(c, w->in, (size_t)rq->len) == -1) {
+                        return -1;
+                }
+                w->in[rq->len] = '\0';
+                src = w->in;
+                dst = src + strlen(src) + 1;
+                if (rq->len == 0 || dst >= w->in + rq->len) {
+                        resp.err = EPROTO;
+                } else if ((rq->decode ? decode_rd_file_arena(src, dst, rq->mode, w->a)
+                                       : encode_wr_file_arena(src, dst, rq->mode, w->a)) == -1) {
+                        resp.err = errno;
+                }
+        } else if (rq->kind == B64D_FD && nfds == 2) {
+                const char *res;
+
+                if (read_fd(w, fds[0], &len) == -1 ||
+                    (res = codec_arena_mem(w->a, rq->mode, rq->decode, w->in, len, &out_len)) == NULL ||
+                    write_all(fds[1], res, out_len) == -1) {
+                        resp.err = errno;
+                }
+                out_len = 0;
+        } else {
+                resp.err = EPROTO;
+        }
+
+        resp.len = out != NULL ? out_len : 0;
+        if (write_all(c, &resp, sizeof(resp)) == -1 ||
+            (resp.len > 0 && write_all(c, out, out_len) == -1)) {
+                return -1;
+        }
+        /* after a malformed request the stream can't be trusted */
+        return resp.err == EPROTO ? -1 : 0;
+}
+
+static void *worker_run(void *arg)
+{
+        struct worker *w = arg;
+
+        for (;;) {
+                int c = accept(w->lfd, NULL, NULL);
+
+                if (c == -1) {
+                        if (errno == EINTR || errno == ECONNABORTED || errno == EMFILE ||
+                            errno == ENFILE) {
+                                continue;
+                        }
+                        perror("b64d: accept");
+                        return NULL;
+                }
+                for (;;) {
+                        struct b64d_req rq;
+                        int fds[2], nfds = 0, rc;
+
+                        if ((rc = recv_req(c, &rq, fds, &nfds)) <= 0) {
+                                break;
+                        }
+                        rc = serve(w, c, &rq, fds, nfds);
+                        for (int i = 0; i < nfds; i++) {
+                                close(fds[i]);
+                        }
+                        if (rc == -1) {
+                                break;
+                        }
+                }
+                close(c);
+        }
+}
+
+static void usage(const char *prog)
+{
+        fprintf(stderr,
+                "usage: %s [-S socket] [-j workers]\n"
+                "\n"
+                "  -S socket    path of the listening socket (default: $B64D_SOCKET or %s)\n"
+                "  -j workers   worker threads (default: one per cpu)\n",
+                prog, B64D_SOCKET);
+}
+
+int main(int argc, char *argv[])
+{
+        const char *path = getenv("B64D_SOCKET");
+        struct sockaddr_un addr;
+        struct worker *w;
+        unsigned int nworkers = 0;
+        sigset_t set;
+        int lfd, opt, sig;
+
+        while ((opt = getopt(argc, argv, "S:j:h")) != -1) {
+                switch (opt) {
+                        case 'S':
+                                path = optarg;
+                                break;
+                        case 'j':
+                                nworkers = (unsigned int)strtoul(optarg, NULL, 10);
+                                break;
+                        default:
+                                usage(argv[0]);
+                                return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+                }
+        }
+        if (path == NULL) {
+                path = B64D_SOCKET;
+        }
+        if (nworkers == 0) {
+                long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+                nworkers = cpus > 0 ? (unsigned int)cpus : 1;
+        }
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (strlen(path) >= sizeof(addr.sun_path)) {
+                fprintf(stderr, "%s: %s: %s\n", argv[0], path, strerror(ENAMETOOLONG));
+                return EXIT_FAILURE;
+        }
+        strcpy(addr.sun_path, path);
+
+        /* only the owner may talk to the daemon, requests run with its rights */
+        umask(077);
+        unlink(path);
+        if ((lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1 ||
+            bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) == -1 || listen(lfd, 128) == -1) {
+                fprintf(stderr, "%s: %s: %s\n", argv[0], path, strerror(errno));
+                return EXIT_FAILURE;
+        }
+
+        /* the workers run with the signals blocked, the main thread waits
+           for the ones that stop the daemon */
+        signal(SIGPIPE, SIG_IGN);
+        sigemptyset(&set);
+        sigaddset(&set, SIGINT);
+        sigaddset(&set, SIGTERM);
+        sigaddset(&set, SIGHUP);
+        pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+        if ((w = calloc(nworkers, sizeof(*w))) == NULL) {
+                perror(argv[0]);
+                return EXIT_FAILURE;
+        }
+        for (unsigned int i = 0; i < nworkers; i++) {
+                w[i].lfd = lfd;
+                if ((w[i].a = codec_arena_create()) == NULL ||
+                    pthread_create(&w[i].tid, NULL, worker_run, &w[i]) != 0) {
+                        perror(argv[0]);
+                        unlink(path);
+                        return EXIT_FAILURE;
+                }
+        }
+
+        sigwait(&set, &sig);
+        unlink(path);
+        return EXIT_SUCCESS;
+}
@@ -0,0 +1,40 @@
+/*
+ * Protocol between the b64d codec daemon and the b64c client
+ *
+ *  A connection carries any number of requests, one after the other. A
+ *  request is a 'b64d_req' header followed by 'len' bytes: the data for
+ *  B64D_INLINE, or "src\0dst\0" for B64D_PATH. B64D_FD sends no payload;
+ *  the input and output descriptors come with the header as SCM_RIGHTS
+ *  ancillary data. Each request is answered with a 'b64d_resp' header,
+ *  and for B64D_INLINE the encoded or decoded data follows it.
+ *
+ * Copyright Orestes Leal Rodriguez 2015-2025
+ */
+#ifndef B64D_H
+#define B64D_H
+
+#include <stdint.h>
+
+#define B64D_MAGIC 0x52343642U  /* "B64R" */
+#define B64D_SOCKET "/tmp/b64d.sock"    /* default, B64D_SOCKET in the environment overrides it */
+
+#define B64D_INLINE 0
+#define B64D_PATH 1
+#define B64D_FD 2
+
+struct b64d_req {
+	uint32_t magic;
+	uint8_t mode;    /* BASE64, BASE32 or BASE16 */
+	uint8_t decode;
+	uint8_t kind;    /* B64D_INLINE, B64D_PATH or B64D_FD */
+	uint8_t pad;
+	uint64_t len;    /* bytes of payload after the header */
+};
+
+struct b64d_resp {
+	int32_t err;     /* 0 or errno of the failure */
+	uint32_t pad;
+	uint64_t len;    /* bytes of data after the header */
+};
+
+#endif
@@ -14,6 +14,7 @@
 #include <string.h>
 #include <errno.h>
 #include "base64.h"
+#include "cli.h"
 int main(int argc, char *argv[])
 {
         struct finfo *fd;
@@ -22,6 +23,10 @@ int main(int argc, char *argv[])
         ssize_t wr;
         unsigned int dec;
 
+        if (argc > 1 && argv[1][0] == '-') {
+                return cli_run(argc, argv, BASE64, 1);
+        }
+
         if (argv[1]) {
                 if ((fd = get_file(argv[1])) == NULL) {
                         perror("get_file");
@@ -39,14 +44,14 @@ int main(int argc, char *argv[])
                         dec = b64_dec((const unsigned char *)fd->addr, dec_buf, fd->size);
                         if (errno != 0) {
                                 perror("b64_dec");
-                                free(dec_buf);
+                                dealloc(dec_buf, fd->size + 1);
                                 free_finfo(fd);
                                 return EXIT_FAILURE;
                         }
 
                         if ((ofd = open(argv[2], O_CREAT | O_RDWR, S_IRUSR | O_TRUNC | S_IWUSR)) == -1) {
                                 perror("open");
-                                free(dec_buf);
+                                dealloc(dec_buf, fd->size + 1);
                                 free_finfo(fd);
                                 return EXIT_FAILURE;
                         }
@@ -54,12 +59,12 @@ int main(int argc, char *argv[])
                         if (wr == -1 || (unsigned int)wr != dec) {
                                 perror("write");
                                 close(ofd);
-                                free(dec_buf);
+                                dealloc(dec_buf, fd->size + 1);
                                 free_finfo(fd);
                                 return EXIT_FAILURE;
                         }
                         close(ofd);
-                        free(dec_buf);
+                        dealloc(dec_buf, fd->size + 1);
                 }
                 free_finfo(fd);
         }
@@ -0,0 +1,134 @@
+/*
+ *      extracts the base64 parts of a raw RFC 5322 message (attachments
+ *      and base64 bodies) in a single pass over the mapped message. Every
+ *      part is written to 'dir' under its filename, or as part-N when it
+ *      has none, -l only lists them.
+ *
+ *      usage: b64mime [-l] [-o dir] message
+ *
+ *  Copyright Orestes Leal Rodriguez 2015-2025 <lukes357@gmail.com>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include "base64.h"
+
+struct extract {
+        const char *prog;
+        const char *dir;
+        int list;
+        long failed;
+};
+
+static int write_all(int fd, const char *b, size_t len)
+{
+        while (len > 0) {
+                ssize_t wr = write(fd, b, len);
+                if (wr < 0) {
+                        if (errno == EINTR) {
+                                continue;
+                        }
+                        return -1;
+                }
+                b += wr;
+                len -= (size_t)wr;
+        }
+        return 0;
+}
+
+/* the file name of 'p' without any directory, or part-N when it has no
+   usable one */
+static void part_name(const struct mime_part *p, char *name, size_t size)
+{
+        const char *s = p->name;
+        size_t n = p->name_len;
+
+        for (size_t i = 0; s != NULL && i < n; i++) {
+                if (s[i] == '/' || s[i] == '\\') {
+                        s += i + 1;
+                        n -= i + 1;
+                        i = (size_t)-1;
+                }
+        }
+        if (s == NULL || n == 0 || n >= size || memchr(s, '\0', n) != NULL ||
+            (s[0] == '.' && (n == 1 || (n == 2 && s[1] == '.')))) {
+                snprintf(name, size, "part-%zu", p->index);
+                return;
+        }
+        memcpy(name, s, n);
+        name[n] = '\0';
+}
+
+static int save_part(const struct mime_part *p, void *arg)
+{
+        struct extract *x = arg;
+        char name[NAME_MAX + 1], path[PATH_MAX];
+        int fd;
+
+        part_name(p, name, sizeof(name));
+        if (p->err != 0) {
+                fprintf(stderr, "%s: part %zu (%s): %s\n", x->prog, p->index, name, strerror(p->err));
+                x->failed++;
+                return 0;
+        }
+        if (x->list) {
+                printf("%4zu %12zu  %.*s  %s\n", p->index, p->len, (int)p->type_len,
+                       p->type != NULL ? p->type : "", name);
+                return 0;
+        }
+        snprintf(path, sizeof(path), "%s/%s", x->dir, name);
+        if ((fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, S_IRUSR | S_IWUSR)) == -1 ||
+            write_all(fd, p->data, p->len) == -1 || close(fd) == -1) {
+                fprintf(stderr, "%s: %s: %s\n", x->prog, path, strerror(errno));
+                x->failed++;
+        }
+        return 0;
+}
+
+static void usage(const char *prog)
+{
+        fprintf(stderr,
+                "usage: %s [-l] [-o dir] message\n"
+                "\n"
+                "  -l       list the base64 parts instead of saving them\n"
+                "  -o dir   where the parts are written (default: .)\n",
+                prog);
+}
+
+int main(int argc, char *argv[])
+{
+        struct extract x = {argv[0], ".", 0, 0};
+        long n;
+        int opt;
+
+        while ((opt = getopt(argc, argv, "lo:h")) != -1) {
+                switch (opt) {
+                        case 'l':
+                                x.list = 1;
+                                break;
+                        case 'o':
+                                x.dir = optarg;
+                                break;
+                        default:
+                                usage(argv[0]);
+                                return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+                }
+        }
+        if (argc - optind != 1) {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+        if ((n = mime_scan_file(argv[optind], save_part, &x)) == -1) {
+                fprintf(stderr, "%s: %s: %s\n", argv[0], argv[optind], strerror(errno));
+                return EXIT_FAILURE;
+        }
+        if (!x.list) {
+                fprintf(stderr, "%ld parts, %ld failed\n", n, x.failed);
+        }
+        return x.failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
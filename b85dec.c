@@ -0,0 +1,27 @@
+/*
+ *      decode a Base85 (Z85) encoded file and write the decoded output to
+ *      another file, --ascii85 selects the Ascii85 alphabet.
+ *
+ *  Copyright Orestes Leal Rodriguez 2015-2025 <lukes357@gmail.com>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "base64.h"
+#include "cli.h"
+int main(int argc, char *argv[])
+{
+        if (argc > 1 && argv[1][0] == '-') {
+                return cli_run(argc, argv, BASE85, 1);
+        }
+        if (argc != 3) {
+                fprintf(stderr, "usage: %s src dst\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+        if (decode_rd_file(argv[1], argv[2], BASE85) == -1) {
+                fprintf(stderr, "%s: %s: %s\n", argv[0], argv[1], strerror(errno));
+                return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+}
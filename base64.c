@@ -62,18 +62,31 @@
  *			   functions 'b16_enc' and 'b16_dec'
  *
  */
+#define _GNU_SOURCE     /* SEEK_DATA, SEEK_HOLE */
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <sys/uio.h>
+#include <sys/mman.h>
+#include <dirent.h>
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
 #include <limits.h>
 #include <stdint.h>
 #include <ctype.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <stdatomic.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#endif
 #include "base64.h"
 #define ESC '\\'
 #define PAD '='
@@ -101,6 +114,110 @@ static const unsigned char b64_lookup[256] = {
     /* All other values remain 0 (invalid) */
 };
 
+/* -------------------------------------------------------------------> stats */
+/*  per-codec counters, compiled in with -DBASE64_STATS. Every thread adds
+    to one of STATS_SHARDS cache line aligned shards with relaxed atomics
+    so concurrent callers don't fight over the same lines, a snapshot sums
+    all the shards */
+#ifdef BASE64_STATS
+#include <time.h>
+#define STATS_SHARDS 16
+
+struct stats_shard {
+        _Atomic unsigned long long v[STATS_NCODECS][5 + STATS_BUCKETS];
+} __attribute__((aligned(64)));
+
+static struct stats_shard stats_shards[STATS_SHARDS];
+static atomic_uint stats_next_shard;
+static _Thread_local int stats_shard = -1;
+
+static unsigned long long stats_now(void)
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
+
+static void stats_add(int codec, unsigned long long in, unsigned long long out,
+                      int invalid, unsigned long long t0)
+{
+        unsigned long long ns = stats_now() - t0;
+        _Atomic unsigned long long *v;
+        int bucket = 63 - __builtin_clzll(ns | 1);
+
+        if (stats_shard < 0) {
+                stats_shard = (int)(atomic_fetch_add_explicit(&stats_next_shard, 1,
+                                        memory_order_relaxed) % STATS_SHARDS);
+        }
+        v = stats_shards[stats_shard].v[codec];
+        atomic_fetch_add_explicit(&v[0], 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&v[1], in, memory_order_relaxed);
+        atomic_fetch_add_explicit(&v[2], out, memory_order_relaxed);
+        atomic_fetch_add_explicit(&v[3], invalid ? 1 : 0, memory_order_relaxed);
+        atomic_fetch_add_explicit(&v[4], ns, memory_order_relaxed);
+        atomic_fetch_add_explicit(&v[5 + (bucket < STATS_BUCKETS ? bucket : STATS_BUCKETS - 1)],
+                                  1, memory_order_relaxed);
+}
+#define STATS_BEGIN() unsigned long long stats_t0 = stats_now()
+#define STATS_END(codec, in, out, invalid) stats_add(codec, in, out, invalid, stats_t0)
+#else
+#define STATS_BEGIN()
+#define STATS_END(codec, in, out, invalid)
+#endif
+
+/* copy the counters of the STATS_NCODECS codecs into the array 'st',
+   returns -1 with errno set to ENOSYS when the library was built
+   without BASE64_STATS */
+int codec_stats_snapshot(struct codec_stats *st)
+{
+#ifdef BASE64_STATS
+        memset(st, 0, sizeof(struct codec_stats) * STATS_NCODECS);
+        for (int i = 0; i < STATS_SHARDS; i++) {
+                for (int c = 0; c < STATS_NCODECS; c++) {
+                        _Atomic unsigned long long *v = stats_shards[i].v[c];
+                        st[c].calls += atomic_load_explicit(&v[0], memory_order_relaxed);
+                        st[c].bytes_in += atomic_load_explicit(&v[1], memory_order_relaxed);
+                        st[c].bytes_out += atomic_load_explicit(&v[2], memory_order_relaxed);
+                        st[c].invalid += atomic_load_explicit(&v[3], memory_order_relaxed);
+                        st[c].nsec += atomic_load_explicit(&v[4], memory_order_relaxed);
+                        for (int b = 0; b < STATS_BUCKETS; b++) {
+                                st[c].hist[b] += atomic_load_explicit(&v[5 + b],
+                                                                      memory_order_relaxed);
+                        }
+                }
+        }
+        return 0;
+#else
+        (void)st;
+        errno = ENOSYS;
+        return -1;
+#endif
+}
+
+/* zero all the counters, calls running at the same time may be lost */
+void codec_stats_reset(void)
+{
+#ifdef BASE64_STATS
+        for (int i = 0; i < STATS_SHARDS; i++) {
+                for (int c = 0; c < STATS_NCODECS; c++) {
+                        for (int k = 0; k < 5 + STATS_BUCKETS; k++) {
+                                atomic_store_explicit(&stats_shards[i].v[c][k], 0,
+                                                      memory_order_relaxed);
+                        }
+                }
+        }
+#endif
+}
+
+/* name of a codec index of 'codec_stats_snapshot' */
+const char *codec_stats_name(int codec)
+{
+        static const char *names[STATS_NCODECS] = {
+                "b64_enc", "b64_dec", "b32_enc", "b32_dec", "b16_enc", "b16_dec"
+        };
+        return codec >= 0 && codec < STATS_NCODECS ? names[codec] : "unknown";
+}
+
 /* get the position of the character 'tk' on the alphabet
    'alp' and test at most 'len' positions on it */
 int get_token_pos(char tk, unsigned char len, const char alp[])
@@ -278,6 +395,18 @@ void base16_decoder(char *b16, char b[])
 	}
 	b[i] = '\0';
 }
+#define ZBLOCK 48       /* bytes checked at once by the zero-run path, a multiple of 3 */
+
+static int zero_block(const unsigned char *s)
+{
+	uint64_t v, acc = 0;
+
+	for (int k = 0; k < ZBLOCK; k += 8) {
+		memcpy(&v, s + k, 8);
+		acc |= v;
+	}
+	return acc == 0;
+}
 /**
  * @brief Encode binary data to base64
  * @param s Input data to encode
@@ -289,9 +418,25 @@ void b64_enc(unsigned const char *s, char b[], unsigned int len)
 {
 	unsigned int x,i,w;
 	unsigned char rm,z;
+	STATS_BEGIN();
 
 	w = 0;
-	for (i = 0; i < len; i++) {
+	/* whole blocks first, all-zero blocks (sparse images, preallocated
+	   files) go out as a run of 'A' without being encoded */
+	for (i = 0; len - i >= ZBLOCK; i += ZBLOCK, w += ZBLOCK / 3 * 4) {
+		if (zero_block(s + i)) {
+			memset(b + w, 'A', ZBLOCK / 3 * 4);
+			continue;
+		}
+		for (unsigned int k = 0; k < ZBLOCK; k += 3) {
+			x = (unsigned int)s[i + k] << 16 | (unsigned int)s[i + k + 1] << 8 | s[i + k + 2];
+			b[w + k / 3 * 4] = b64_alp[x >> 18];
+			b[w + k / 3 * 4 + 1] = b64_alp[(x >> 12) & 0x3f];
+			b[w + k / 3 * 4 + 2] = b64_alp[(x >> 6) & 0x3f];
+			b[w + k / 3 * 4 + 3] = b64_alp[x & 0x3f];
+		}
+	}
+	for (; i < len; i++) {
 		for (x = 0, z = 0; z < 3 && i < len; z++, i++) {
 			x |= s[i];	
 			(z < 2 && i+1 < len) ? x <<= 8 : 0;
@@ -310,16 +455,21 @@ void b64_enc(unsigned const char *s, char b[], unsigned int len)
 			b[--w] = PAD;
 		}
 	}
+	STATS_END(STATS_B64_ENC, len, ((len + 2) / 3) * 4, 0);
 }
-/**
- * @brief Decode base64 string to binary data
- * @param s Base64 encoded string to decode
- * @param b Output buffer for decoded data (must be large enough)
- * @param len Length of input base64 string
- * @return Number of decoded bytes, or 0 on error
- * @note Output buffer should be at least (len / 4) * 3 bytes
- */
-unsigned int b64_dec(const unsigned char *s, char b[], unsigned int len)
+/* padding rule shared by b64_dec and b64_validate, so that every block
+   path accepts the same strings: only the last quad may be padded, and
+   as "xy==" or "xyz=" */
+static int b64_pad_ok(unsigned char c2, unsigned char c3, int last)
+{
+        if (!last) {
+                return c2 != PAD && c3 != PAD;
+        }
+        return c2 != PAD || c3 == PAD;
+}
+
+/* b64_dec without the call statistics */
+static unsigned int b64_dec_run(const unsigned char *s, char b[], unsigned int len)
 {
         unsigned int trimmed_len = len;
         unsigned int w = 0;
@@ -352,7 +502,7 @@ unsigned int b64_dec(const unsigned char *s, char b[], unsigned int len)
                 unsigned char c2 = s[i + 2];
                 unsigned char c3 = s[i + 3];
 
-                if (c0 == PAD || c1 == PAD) {
+                if (c0 == PAD || c1 == PAD || !b64_pad_ok(c2, c3, i + 4 == trimmed_len)) {
                         errno = EINVAL;
                         b[0] = '\0';
                         return 0;
@@ -401,10 +551,30 @@ unsigned int b64_dec(const unsigned char *s, char b[], unsigned int len)
         b[w] = '\0';
         return w;
 }
+/**
+ * @brief Decode base64 string to binary data
+ * @param s Base64 encoded string to decode
+ * @param b Output buffer for decoded data (must be large enough)
+ * @param len Length of input base64 string
+ * @return Number of decoded bytes, or 0 on error
+ * @note Output buffer should be at least (len / 4) * 3 bytes
+ */
+unsigned int b64_dec(const unsigned char *s, char b[], unsigned int len)
+{
+#ifdef BASE64_STATS
+        STATS_BEGIN();
+        unsigned int w = b64_dec_run(s, b, len);
+        STATS_END(STATS_B64_DEC, len, w, errno != 0);
+        return w;
+#else
+        return b64_dec_run(s, b, len);
+#endif
+}
 
 
 
-/* get the size of the encoded data in a base64 string */
+/* get the size of the encoded data in a base64 string, the input is
+   assumed valid, b64_validate checks it and gives the exact size */
 unsigned int get_data_size(char *s, unsigned int len)
 {
 	unsigned int rtsize, i;
@@ -443,6 +613,7 @@ void b32_enc(const unsigned char *s, unsigned char *b, unsigned int len)
 	unsigned long long x;	/* c99 only */
 	unsigned int i,w,z;
 	unsigned char ap[5] = {0,6,4,3,1};
+	STATS_BEGIN();
 
 	w = x = 0;
 	/* 	in base32 per 5 bytes of input we get 40 bits that must
@@ -476,16 +647,18 @@ void b32_enc(const unsigned char *s, unsigned char *b, unsigned int len)
 	for (i = ap[len % 5]; i; i--) {
 		b[--w] = PAD; 
 	}		
+	STATS_END(STATS_B32_ENC, len, ((len + 4) / 5) * 8, 0);
 	return;
 }
-/* general purpose Base32 decoding */
-unsigned int b32_dec(const unsigned char *s, char *b, unsigned int len)
+/* b32_dec without the call statistics */
+static unsigned int b32_dec_run(const unsigned char *s, char *b, unsigned int len)
 {
         unsigned int clean_len = len;
         unsigned int pad = 0;
         unsigned int w = 0;
         unsigned long long buffer = 0;
         unsigned int bits = 0;
+        /* bytes in the last group for each valid count of padding */
         static const unsigned char lkpad[7] = {0,4,0,3,2,0,1};
 
         if (s == NULL || b == NULL) {
@@ -524,35 +697,45 @@ unsigned int b32_dec(const unsigned char *s, char *b, unsigned int len)
                 }
         }
 
+        /* the bit loop already dropped the padding bits, the padding
+           only has to complete the last 8 character group */
         if (pad) {
-                if (pad >= sizeof(lkpad)) {
-                        errno = EINVAL;
-                        b[0] = '\0';
-                        return 0;
-                }
-                if (w < lkpad[pad]) {
+                if (pad >= sizeof(lkpad) || lkpad[pad] == 0 || (clean_len + pad) % 8 != 0) {
                         errno = EINVAL;
                         b[0] = '\0';
                         return 0;
                 }
-                w -= lkpad[pad];
         }
 
         b[w] = '\0';
         return w;
 }
+/* general purpose Base32 decoding */
+unsigned int b32_dec(const unsigned char *s, char *b, unsigned int len)
+{
+#ifdef BASE64_STATS
+        STATS_BEGIN();
+        unsigned int w = b32_dec_run(s, b, len);
+        STATS_END(STATS_B32_DEC, len, w, errno != 0);
+        return w;
+#else
+        return b32_dec_run(s, b, len);
+#endif
+}
 
 /* general purpose base16 encoder */
 void b16_enc(const unsigned char *s, char *b, unsigned int len)
 {
-	while (len--) {
+	STATS_BEGIN();
+	for (unsigned int i = 0; i < len; i++) {
 		*b++ = b16_alp[*s >> 4];
 		*b++ = b16_alp[*s++ & 0x0f]; 	
 	}
 	*b = '\0';
+	STATS_END(STATS_B16_ENC, len, len * 2ULL, 0);
 }
-/* general purpose base16 decoder */
-unsigned int b16_dec(const char *s, char *b, unsigned int len)
+/* b16_dec without the call statistics */
+static unsigned int b16_dec_run(const char *s, char *b, unsigned int len)
 {
         unsigned int w = 0;
 
@@ -587,235 +770,4621 @@ unsigned int b16_dec(const char *s, char *b, unsigned int len)
         b[w] = '\0';
         return w;
 }
-
-/* -------------------------------------------------------------------> utilities */
-/* write an input file into a destination file encoded in
-   the base encoding specified in 'mode'. 
-   modes supported : BASE64, BASE32, BASE16 */
-int encode_wr_file(const char *src, const char *dst, unsigned char mode)
+/* general purpose base16 decoder */
+unsigned int b16_dec(const char *s, char *b, unsigned int len)
 {
-        struct finfo *fd = get_file(src);
-        char *enc_buf = NULL;
-        int ofd = -1;
-        ssize_t wr;
-        int flags = O_CREAT | O_RDWR;
-        int perms = S_IRUSR | O_TRUNC | S_IWUSR;
-        int status = -1;
-        size_t buf_len = 0;
-        size_t out_len = 0;
+#ifdef BASE64_STATS
+        STATS_BEGIN();
+        unsigned int w = b16_dec_run(s, b, len);
+        STATS_END(STATS_B16_DEC, len, w, errno != 0);
+        return w;
+#else
+        return b16_dec_run(s, b, len);
+#endif
+}
 
-        if (fd == NULL) {
-                return -1;
-        }
+/* -------------------------------------------------------------------> base85 */
+/*  Base85 packs 4 bytes into 5 characters. Z85 (ZeroMQ RFC 32) uses an
+    alphabet that is safe in source code and strings, Ascii85 (btoa,
+    PostScript) the characters '!' to 'u' plus 'z' for a group of zeros.
+    A last group of n < 4 bytes is written as its first n + 1 characters,
+    as Ascii85 does, so Z85 is not limited to multiples of 4. The digits
+    are taken out with a multiply and a shift instead of divisions:
+    q = v * ceil(2^38 / 85) >> 38 is exact for every 32 bit v */
+#define B85_MAGIC 3233857729ULL
 
-        switch (mode) {
-                case BASE64:
-                        buf_len = b64_enc_size(fd->size);
-                        break;
-                case BASE32:
-                        buf_len = ((fd->size + 4) / 5) * 8 + 1;
-                        break;
-                case BASE16:
-                        buf_len = fd->size * 2 + 1;
-                        break;
-                default:
-                        errno = EINVAL;
-                        goto cleanup;
-        }
+static const char z85_alp[86] =
+        "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ.-:+=^!/*?&<>()[]{}@%$#";
+static const char a85_alp[86] =
+        "!\"#$%&'()*+,-./0123456789:;<=>?@ABCDEFGHIJKLMNOPQRSTUVWXYZ[\\]^_`abcdefghijklmnopqrstu";
 
-        enc_buf = malloc(buf_len);
-        if (enc_buf == NULL) {
-                errno = ENOMEM;
-                goto cleanup;
-        }
+/* value of each Z85 character, 0xff for the ones outside the alphabet */
+static const unsigned char z85_lookup[128] = {
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0x44, 0xff, 0x54, 0x53, 0x52, 0x48, 0xff, 0x4b, 0x4c, 0x46, 0x41, 0xff, 0x3f, 0x3e, 0x45,
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x40, 0xff, 0x49, 0x42, 0x4a, 0x47,
+        0x51, 0x24, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f, 0x30, 0x31, 0x32,
+        0x33, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0x4d, 0xff, 0x4e, 0x43, 0xff,
+        0xff, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18,
+        0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20, 0x21, 0x22, 0x23, 0x4f, 0xff, 0x50, 0xff, 0xff,
+};
 
-        switch (mode) {
-                case BASE64:
-                        b64_enc((const unsigned char *)fd->addr, enc_buf, fd->size);
-                        break;
-                case BASE32:
-                        b32_enc((const unsigned char *)fd->addr, (unsigned char *)enc_buf, fd->size);
-                        break;
-                case BASE16:
-                        b16_enc((const unsigned char *)fd->addr, enc_buf, fd->size);
-                        break;
+/* the 5 digits of 'v' */
+static inline void b85_digits(uint32_t v, char *b, const char *alp)
+{
+        for (int i = 4; i >= 0; i--) {
+                uint32_t q = (uint32_t)(((uint64_t)v * B85_MAGIC) >> 38);
+                b[i] = alp[v - q * 85];
+                v = q;
         }
+}
+
+static unsigned int b85_enc_run(const unsigned char *s, char *b, unsigned int len,
+                                const char *alp, int zero_z)
+{
+        unsigned int i = 0, w = 0;
+        char tail[5];
 
-        ofd = open(dst, flags, perms);
-        if (ofd == -1) {
-                goto cleanup;
+        for (; i + 4 <= len; i += 4) {
+                uint32_t v = (uint32_t)s[i] << 24 | (uint32_t)s[i + 1] << 16 |
+                             (uint32_t)s[i + 2] << 8 | s[i + 3];
+                if (zero_z && v == 0) {
+                        b[w++] = 'z';
+                        continue;
+                }
+                b85_digits(v, b + w, alp);
+                w += 5;
         }
+        if (i < len) {
+                uint32_t v = 0;
+                unsigned int n = len - i;
 
-        out_len = strlen(enc_buf);
-        wr = write(ofd, enc_buf, out_len);
-        if (wr == -1 || (size_t)wr != out_len) {
-                goto cleanup;
+                for (unsigned int k = 0; k < 4; k++) {
+                        v = v << 8 | (k < n ? s[i + k] : 0);
+                }
+                b85_digits(v, tail, alp);
+                memcpy(b + w, tail, n + 1);
+                w += n + 1;
         }
+        b[w] = '\0';
+        return w;
+}
 
-        status = 0;
+/* Z85 encoding of 'len' bytes of 's', returns the characters written */
+unsigned int z85_enc(const unsigned char *s, char *b, unsigned int len)
+{
+        return b85_enc_run(s, b, len, z85_alp, 0);
+}
 
-cleanup:
-        if (ofd != -1) {
-                close(ofd);
-        }
-        free(enc_buf);
-        free_finfo(fd);
-        return status;
+/* Ascii85 encoding, without the <~ ~> delimiters */
+unsigned int a85_enc(const unsigned char *s, char *b, unsigned int len)
+{
+        return b85_enc_run(s, b, len, a85_alp, 1);
 }
 
-char *alloc(unsigned int size)
+/* value of the Base85 character 'c', -1 when it is not a digit */
+static inline int b85_value(unsigned char c, int ascii)
 {
-        char *ptr = (char *)malloc(size);
-        if (ptr == NULL) {
-                errno = ENOMEM;
+        if (ascii) {
+                return c >= '!' && c <= 'u' ? c - '!' : -1;
         }
-        return ptr;
+        return c < 128 && z85_lookup[c] != 0xff ? z85_lookup[c] : -1;
 }
 
-/* open a file, get file info, load it to memory and return file 
-   information on memory as a pointer to a structure 'finfo', 
-   returns NULL on error */
-struct finfo *get_file(const char *f)
+/* write the 'n' - 1 bytes of a group of 'n' digits, padded with the
+   highest digit, 0 when the group is out of range */
+static int b85_group(const int *d, unsigned int n, char *b)
 {
-        int fd = -1;
-        struct stat fp;
-        char *addr = NULL;
-        struct finfo *st_addr = NULL;
-        size_t to_read = 0;
-        size_t offset = 0;
+        uint64_t v = 0;
 
-        if (f == NULL) {
-                errno = EINVAL;
-                return NULL;
+        for (unsigned int k = 0; k < 5; k++) {
+                v = v * 85 + (uint64_t)(k < n ? d[k] : 84);
         }
-
-        fd = open(f, O_RDONLY);
-        if (fd == -1) {
-                return NULL;
+        if (v > 0xffffffffULL) {
+                return 0;
         }
-
-        if (fstat(fd, &fp) == -1) {
-                close(fd);
-                return NULL;
+        for (unsigned int k = 0; k + 1 < n; k++) {
+                b[k] = (char)(v >> (24 - 8 * k));
         }
+        return 1;
+}
 
-        if (fp.st_size < 0) {
+static unsigned int b85_dec_run(const unsigned char *s, char *b, unsigned int len, int ascii)
+{
+        unsigned int i = 0, w = 0, n = 0;
+        int d[5];
+
+        if (s == NULL || b == NULL) {
                 errno = EINVAL;
-                close(fd);
-                return NULL;
+                return 0;
         }
-
-        if ((unsigned long long)fp.st_size > (unsigned long long)(SIZE_MAX - 1)) {
-                errno = EOVERFLOW;
-                close(fd);
-                return NULL;
+        errno = 0;
+        while (len > 0 && (s[len - 1] == '\r' || s[len - 1] == '\n')) {
+                --len;
         }
-
-        to_read = (size_t)fp.st_size;
-        addr = malloc(to_read + 1);
-        if (addr == NULL) {
-                errno = ENOMEM;
-                close(fd);
-                return NULL;
+        if (ascii) {
+                /* the Adobe delimiters are optional */
+                if (len >= 2 && s[0] == '<' && s[1] == '~') {
+                        i = 2;
+                }
+                if (len >= i + 2 && s[len - 2] == '~' && s[len - 1] == '>') {
+                        len -= 2;
+                }
         }
+        for (; i < len; i++) {
+                int v;
 
-        while (offset < to_read) {
-                ssize_t chunk = read(fd, addr + offset, to_read - offset);
-                if (chunk < 0) {
-                        free(addr);
-                        close(fd);
-                        return NULL;
+                if (n == 0 && !ascii) {
+                        /* whole groups, no line breaks or 'z' in Z85 */
+                        for (; i + 5 <= len; i += 5) {
+                                uint64_t g = 0;
+                                int bad = 0;
+
+                                for (unsigned int k = 0; k < 5; k++) {
+                                        unsigned char c = s[i + k];
+                                        int x = c < 128 ? z85_lookup[c] : 0xff;
+                                        bad |= x;
+                                        g = g * 85 + (unsigned int)x;
+                                }
+                                if ((bad & 0x80) || g > 0xffffffffULL) {
+                                        break;
+                                }
+                                b[w++] = (char)(g >> 24);
+                                b[w++] = (char)(g >> 16);
+                                b[w++] = (char)(g >> 8);
+                                b[w++] = (char)g;
+                        }
+                        if (i == len) {
+                                break;
+                        }
                 }
-                if (chunk == 0) {
-                        break;
+                if (ascii && (s[i] == ' ' || s[i] == '\t' || s[i] == '\r' || s[i] == '\n')) {
+                        continue;
+                }
+                if (ascii && s[i] == 'z' && n == 0) {
+                        memset(b + w, 0, 4);
+                        w += 4;
+                        continue;
+                }
+                if ((v = b85_value(s[i], ascii)) < 0) {
+                        goto invalid;
+                }
+                d[n++] = v;
+                if (n == 5) {
+                        if (!b85_group(d, 5, b + w)) {
+                                goto invalid;
+                        }
+                        w += 4;
+                        n = 0;
                 }
-                offset += (size_t)chunk;
         }
+        /* a last group of n digits holds n - 1 bytes */
+        if (n == 1 || (n > 1 && !b85_group(d, n, b + w))) {
+                goto invalid;
+        }
+        w += n ? n - 1 : 0;
+        b[w] = '\0';
+        return w;
 
-        close(fd);
-        addr[offset] = '\0';
+invalid:
+        errno = EINVAL;
+        b[0] = '\0';
+        return 0;
+}
 
-        st_addr = malloc(sizeof(*st_addr));
-        if (st_addr == NULL) {
-                free(addr);
-                errno = ENOMEM;
-                return NULL;
-        }
+/* Z85 decoding, returns the bytes written, 0 with errno set to EINVAL
+   for invalid input */
+unsigned int z85_dec(const char *s, char *b, unsigned int len)
+{
+        return b85_dec_run((const unsigned char *)s, b, len, 0);
+}
 
-        st_addr->addr = addr;
-        st_addr->size = offset;
-        return st_addr;
+/* Ascii85 decoding, whitespace, 'z' and the <~ ~> delimiters are taken */
+unsigned int a85_dec(const char *s, char *b, unsigned int len)
+{
+        return b85_dec_run((const unsigned char *)s, b, len, 1);
 }
 
-void free_finfo(struct finfo *info)
+/* -------------------------------------------------------------------> validation */
+/*  the validators accept exactly what b64_dec, b32_dec and b16_dec accept
+    without writing anything, the bulk of the input is checked 16 bytes at
+    a time with SSE2 when it is available */
+#define B64_VALID(c) (b64_lookup[(c)] != 0 || (c) == 'A')
+#define B32_VALID(c) (((c) >= 'A' && (c) <= 'Z') || ((c) >= '2' && (c) <= '7'))
+#define B16_VALID(c) (((c) >= '0' && (c) <= '9') || (((c) | 0x20) >= 'a' && ((c) | 0x20) <= 'f'))
+
+#ifdef __SSE2__
+/* 0xff in every lane of 'v' that is within [lo, hi], both in 0..126 */
+static inline __m128i byte_range(__m128i v, char lo, char hi)
 {
-        if (info == NULL) {
-                return;
-        }
-        free(info->addr);
-        free(info);
+        return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8((char)(lo - 1))),
+                             _mm_cmplt_epi8(v, _mm_set1_epi8((char)(hi + 1))));
 }
 
-int decode_rd_file(const char *src, const char *dst, unsigned char mode)
+/* offset of the first zero lane of the mask 'ok' or 16 */
+static inline unsigned int first_bad(__m128i ok)
 {
-        struct finfo *fd = get_file(src);
-        char *dec_buf = NULL;
-        int ofd = -1;
-        ssize_t wr;
-        unsigned int dec = 0;
-        int flags = O_CREAT | O_RDWR;
-        int perms = S_IRUSR | O_TRUNC | S_IWUSR;
-        int status = -1;
+        unsigned int m = (unsigned int)_mm_movemask_epi8(ok) ^ 0xffffU;
+        return m ? (unsigned int)__builtin_ctz(m) : 16;
+}
+#endif
 
-        if (fd == NULL) {
-                return -1;
+/* offset of the first character of 's' that is not in the alphabet */
+static unsigned int b64_scan(const unsigned char *s, unsigned int n)
+{
+        unsigned int i = 0;
+#ifdef __SSE2__
+        for (; i + 16 <= n; i += 16) {
+                __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+                __m128i ok = _mm_or_si128(_mm_or_si128(byte_range(v, 'A', 'Z'), byte_range(v, 'a', 'z')),
+                             _mm_or_si128(byte_range(v, '0', '9'),
+                             _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('+')),
+                                          _mm_cmpeq_epi8(v, _mm_set1_epi8('/')))));
+                unsigned int k = first_bad(ok);
+                if (k < 16) {
+                        return i + k;
+                }
         }
+#endif
+        for (; i < n && B64_VALID(s[i]); i++);
+        return i;
+}
 
-        dec_buf = malloc(fd->size + 1);
-        if (dec_buf == NULL) {
-                errno = ENOMEM;
-                goto cleanup;
+static unsigned int b32_scan(const unsigned char *s, unsigned int n)
+{
+        unsigned int i = 0;
+#ifdef __SSE2__
+        for (; i + 16 <= n; i += 16) {
+                __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+                unsigned int k = first_bad(_mm_or_si128(byte_range(v, 'A', 'Z'), byte_range(v, '2', '7')));
+                if (k < 16) {
+                        return i + k;
+                }
         }
+#endif
+        for (; i < n && B32_VALID(s[i]); i++);
+        return i;
+}
 
-        errno = 0;
-        switch (mode) {
-                case BASE64:
-                        dec = b64_dec((const unsigned char *)fd->addr, dec_buf, fd->size);
-                        break;
-                case BASE32:
-                        dec = b32_dec((const unsigned char *)fd->addr, dec_buf, fd->size);
-                        break;
-                case BASE16:
-                        dec = b16_dec(fd->addr, dec_buf, fd->size);
-                        break;
-                default:
-                        errno = EINVAL;
-                        goto cleanup;
+static unsigned int b16_scan(const unsigned char *s, unsigned int n)
+{
+        unsigned int i = 0;
+#ifdef __SSE2__
+        for (; i + 16 <= n; i += 16) {
+                __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+                __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+                unsigned int k = first_bad(_mm_or_si128(byte_range(v, '0', '9'),
+                                                        byte_range(lower, 'a', 'f')));
+                if (k < 16) {
+                        return i + k;
+                }
         }
+#endif
+        for (; i < n && B16_VALID(s[i]); i++);
+        return i;
+}
 
-        if (errno != 0) {
-                goto cleanup;
-        }
+/* check a base64 string without decoding it, returns 0 and the exact
+   decoded size in 'size' if b64_dec would accept it, -1 with errno set
+   to EINVAL otherwise. 'bad' receives the offset of the first invalid
+   character, or the input length when the last group is incomplete.
+   'size' and 'bad' can be NULL */
+int b64_validate(const unsigned char *s, unsigned int len, unsigned int *size, unsigned int *bad)
+{
+        unsigned int n = len, q, i, w;
 
-        ofd = open(dst, flags, perms);
-        if (ofd == -1) {
-                goto cleanup;
+        if (s == NULL) {
+                errno = EINVAL;
+                return -1;
         }
-
-        wr = write(ofd, dec_buf, dec);
-        if (wr == -1 || (unsigned int)wr != dec) {
-                goto cleanup;
+        while (n > 0 && (s[n - 1] == '\r' || s[n - 1] == '\n')) {
+                --n;
         }
 
-        status = 0;
+        /* everything before the quad of the first non alphabet character
+           decodes to 3 bytes per quad, padding is handled from there */
+        q = b64_scan(s, n) & ~3U;
+        w = (q / 4) * 3;
+        for (; q + 4 <= n; q += 4) {
+                unsigned char c2 = s[q + 2], c3 = s[q + 3];
 
-cleanup:
-        if (ofd != -1) {
-                close(ofd);
+                if (!B64_VALID(s[q])) {
+                        i = q;
+                        goto invalid;
+                }
+                if (!B64_VALID(s[q + 1])) {
+                        i = q + 1;
+                        goto invalid;
+                }
+                if (c2 != PAD && !B64_VALID(c2)) {
+                        i = q + 2;
+                        goto invalid;
+                }
+                if (c3 != PAD && !B64_VALID(c3)) {
+                        i = q + 3;
+                        goto invalid;
+                }
+                if (!b64_pad_ok(c2, c3, q + 4 == n)) {
+                        i = c2 == PAD && q + 4 < n ? q + 2 : q + 3;
+                        goto invalid;
+                }
+                w += 1 + (c2 != PAD) + (c3 != PAD);
         }
-        free(dec_buf);
-        free_finfo(fd);
-        return status;
+        if (q < n) {
+                for (i = q; i < n && (B64_VALID(s[i]) || s[i] == PAD); i++);
+                goto invalid;
+        }
+        if (size != NULL) {
+                *size = w;
+        }
+        if (bad != NULL) {
+                *bad = len;
+        }
+        return 0;
+
+invalid:
+        if (bad != NULL) {
+                *bad = i;
+        }
+        errno = EINVAL;
+        return -1;
 }
 
+/* b64_validate for base32 strings, following b32_dec */
+int b32_validate(const unsigned char *s, unsigned int len, unsigned int *size, unsigned int *bad)
+{
+        static const unsigned char lkpad[7] = {0,4,0,3,2,0,1};
+        unsigned int n = len, pad = 0, i;
+
+        if (s == NULL) {
+                errno = EINVAL;
+                return -1;
+        }
+        while (n > 0 && (s[n - 1] == '\r' || s[n - 1] == '\n')) {
+                --n;
+        }
+        while (n > 0 && s[n - 1] == PAD) {
+                ++pad;
+                --n;
+        }
+        if ((i = b32_scan(s, n)) < n) {
+                goto invalid;
+        }
+        if (pad && (pad >= sizeof(lkpad) || lkpad[pad] == 0 || (n + pad) % 8 != 0)) {
+                i = n;
+                goto invalid;
+        }
+        if (size != NULL) {
+                *size = (unsigned int)(((unsigned long long)n * 5) / 8);
+        }
+        if (bad != NULL) {
+                *bad = len;
+        }
+        return 0;
 
+invalid:
+        if (bad != NULL) {
+                *bad = i;
+        }
+        errno = EINVAL;
+        return -1;
+}
+
+/* b64_validate for base16 strings, following b16_dec */
+int b16_validate(const char *s, unsigned int len, unsigned int *size, unsigned int *bad)
+{
+        unsigned int i;
+
+        if (s == NULL) {
+                errno = EINVAL;
+                return -1;
+        }
+        i = b16_scan((const unsigned char *)s, len);
+        if (i < len || (len & 1U) != 0) {
+                if (bad != NULL) {
+                        *bad = i;
+                }
+                errno = EINVAL;
+                return -1;
+        }
+        if (size != NULL) {
+                *size = len / 2;
+        }
+        if (bad != NULL) {
+                *bad = len;
+        }
+        return 0;
+}
+
+/* -------------------------------------------------------------------> utilities */
+/*  every allocation of the library goes through 'allocator', by default
+    malloc and free, the free callback receives the size that was requested
+    so simple arena or pool allocators can be plugged in */
+static void *default_alloc(size_t size, void *ctx)
+{
+        (void)ctx;
+        return malloc(size);
+}
+
+static void default_free(void *ptr, size_t size, void *ctx)
+{
+        (void)size;
+        (void)ctx;
+        free(ptr);
+}
+
+static struct codec_allocator allocator = {default_alloc, default_free, NULL};
+
+/* replace the allocator used by the library, NULL restores malloc/free,
+   memory must not be outstanding when it is changed */
+void codec_set_allocator(const struct codec_allocator *a)
+{
+        if (a == NULL || a->alloc == NULL || a->free == NULL) {
+                allocator.alloc = default_alloc;
+                allocator.free = default_free;
+                allocator.ctx = NULL;
+        } else {
+                allocator = *a;
+        }
+}
+
+static void *lib_alloc(size_t size)
+{
+        void *p = allocator.alloc(size, allocator.ctx);
+        if (p == NULL) {
+                errno = ENOMEM;
+        }
+        return p;
+}
+
+static void lib_free(void *ptr, size_t size)
+{
+        if (ptr != NULL) {
+                allocator.free(ptr, size, allocator.ctx);
+        }
+}
+
+/*  large buffers (whole files and their outputs) are mapped on their own
+    when the default allocator is in use, 2 MiB aligned so transparent
+    huge pages can back them, or from the hugetlbfs pool with MEM_HUGETLB,
+    and faulted in with one call before the codecs write to them. This
+    saves most of the page faults and TLB misses of GB sized buffers.
+    Inputs are read with sequential readahead. get_file stays on the
+    allocator, its callers may free what it returns */
+#define BIG_BUF_MIN (4U << 20)
+#define HUGE_PAGE (2U << 20)
+
+static _Atomic int mem_policy = MEM_DEFAULT;
+
+/* select the MEM_* features used for large buffers and file inputs,
+   MEM_DEFAULT restores the default */
+void codec_set_mem_policy(int flags)
+{
+        atomic_store_explicit(&mem_policy, flags, memory_order_relaxed);
+}
+
+static int big_mapped(size_t size)
+{
+        return size >= BIG_BUF_MIN && allocator.alloc == default_alloc;
+}
+
+static size_t big_size(size_t size)
+{
+        return (size + HUGE_PAGE - 1) & ~(size_t)(HUGE_PAGE - 1);
+}
+
+static void big_prefault(char *p, size_t size)
+{
+#ifdef MADV_POPULATE_WRITE
+        if (madvise(p, size, MADV_POPULATE_WRITE) == 0) {
+                return;
+        }
+#endif
+        for (size_t i = 0; i < size; i += 4096) {
+                ((volatile char *)p)[i] = 0;
+        }
+}
+
+static void *big_alloc(size_t size)
+{
+        int flags = atomic_load_explicit(&mem_policy, memory_order_relaxed);
+        size_t len = big_size(size);
+        char *p, *start;
+
+        if (!big_mapped(size)) {
+                return lib_alloc(size);
+        }
+        p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+        if (flags & MEM_HUGETLB) {
+                p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        }
+#endif
+        if (p == MAP_FAILED) {
+                /* over map and keep the aligned part */
+                start = mmap(NULL, len + HUGE_PAGE, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (start == MAP_FAILED) {
+                        errno = ENOMEM;
+                        return NULL;
+                }
+                p = (char *)(((uintptr_t)start + HUGE_PAGE - 1) & ~(uintptr_t)(HUGE_PAGE - 1));
+                if (p > start) {
+                        munmap(start, (size_t)(p - start));
+                }
+                munmap(p + len, (size_t)(start + HUGE_PAGE - p));
+#ifdef MADV_HUGEPAGE
+                /* without the flag the system THP setting applies */
+                if (flags & MEM_HUGEPAGES) {
+                        madvise(p, len, MADV_HUGEPAGE);
+                }
+#endif
+        }
+        if (flags & MEM_PREFAULT) {
+                big_prefault(p, size);
+        }
+        return p;
+}
+
+static void big_free(void *ptr, size_t size)
+{
+        if (ptr != NULL && big_mapped(size)) {
+                munmap(ptr, big_size(size));
+        } else {
+                lib_free(ptr, size);
+        }
+}
+
+/* tell the kernel that 'fd' of 'size' bytes is read once from the start */
+static void advise_input(int fd, size_t size)
+{
+        if (!(atomic_load_explicit(&mem_policy, memory_order_relaxed) & MEM_READAHEAD)) {
+                return;
+        }
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        if (size >= BIG_BUF_MIN) {
+                posix_fadvise(fd, 0, (off_t)size, POSIX_FADV_WILLNEED);
+        }
+}
+
+/* growable working buffer, its contents are not kept when it grows */
+struct iobuf {
+        char *p;
+        size_t cap;
+};
+
+static int iobuf_reserve(struct iobuf *b, size_t size)
+{
+        size_t cap = b->cap + b->cap / 2;
+        char *p;
+
+        if (size <= b->cap) {
+                return 0;
+        }
+        if (cap < size) {
+                cap = size;
+        }
+        if ((p = big_alloc(cap)) == NULL) {
+                return -1;
+        }
+        big_free(b->p, b->cap);
+        b->p = p;
+        b->cap = cap;
+        return 0;
+}
+
+static void iobuf_release(struct iobuf *b)
+{
+        big_free(b->p, b->cap);
+        b->p = NULL;
+        b->cap = 0;
+}
+
+/*  an arena holds the working buffers of the file and memory utilities,
+    once they have grown to the largest input seen, repeated calls with the
+    same arena don't allocate anything */
+struct codec_arena {
+        struct iobuf in;
+        struct iobuf out;
+};
+
+struct codec_arena *codec_arena_create(void)
+{
+        struct codec_arena *a = lib_alloc(sizeof(*a));
+
+        if (a != NULL) {
+                a->in.p = a->out.p = NULL;
+                a->in.cap = a->out.cap = 0;
+        }
+        return a;
+}
+
+void codec_arena_destroy(struct codec_arena *a)
+{
+        if (a == NULL) {
+                return;
+        }
+        iobuf_release(&a->in);
+        iobuf_release(&a->out);
+        lib_free(a, sizeof(*a));
+}
+
+/* the modes with fixed size groups and padding, the block paths (async,
+   pipeline, iovec, checksums, transcoding, ...) split only these */
+#define GROUP_MODE(m) ((m) == BASE64 || (m) == BASE32 || (m) == BASE16)
+
+/* raw bytes and encoded characters of a group, indexed by a GROUP_MODE */
+static const unsigned char raw_group[4] = {0, 3, 5, 1};
+static const unsigned char enc_group[4] = {0, 4, 8, 2};
+
+/* whether 'len' characters at 'in', a block of encoded input that is not
+   the last one, may be decoded on their own. The decoders take padding or
+   line breaks at the end of what they are given as the end of the input,
+   so they can only end the last block */
+static int block_end_ok(const char *in, size_t len)
+{
+        char c = len > 0 ? in[len - 1] : 0;
+
+        return c != PAD && c != '\r' && c != '\n';
+}
+
+/* size of the buffer needed to encode or decode 'len' bytes in 'mode'
+   (null terminator included), 0 with errno set if mode is unknown */
+size_t codec_buf_size(unsigned char mode, int decode, size_t len)
+{
+        if (decode) {
+                if (GROUP_MODE(mode) || mode == BASE85) {
+                        return len + 1;
+                }
+                if (mode == ASCII85) {
+                        return len * 4 + 1;     /* each 'z' is 4 bytes */
+                }
+        } else {
+                switch (mode) {
+                        case BASE64:
+                                return ((len + 2) / 3) * 4 + 1;
+                        case BASE32:
+                                return ((len + 4) / 5) * 8 + 1;
+                        case BASE16:
+                                return len * 2 + 1;
+                        case BASE85:
+                        case ASCII85:
+                                return ((len + 3) / 4) * 5 + 1;
+                }
+        }
+        errno = EINVAL;
+        return 0;
+}
+
+/*  large outputs are produced block by block in a staging buffer that
+    stays in L1 and copied out with non-temporal stores, the destination
+    is not read for ownership and the output, which is only going to be
+    written out, doesn't evict the working set of other threads sharing
+    the last level cache */
+#define NT_BLOCK 3840           /* raw bytes per block, multiple of 3, 5 and 16 */
+#define NT_THRESHOLD (16U << 20)
+
+static _Atomic size_t nt_threshold = NT_THRESHOLD;
+
+/* inputs of at least 'bytes' bytes take the non-temporal path in
+   codec_mem, 0 disables it, SIZE_MAX restores the default */
+void codec_set_nt_threshold(size_t bytes)
+{
+        atomic_store_explicit(&nt_threshold, bytes == SIZE_MAX ? NT_THRESHOLD : bytes,
+                              memory_order_relaxed);
+}
+
+/* copy 'len' bytes to 'dst' bypassing the caches where it is aligned */
+static void stream_copy(char *dst, const char *src, size_t len)
+{
+#ifdef __SSE2__
+        while (len > 0 && ((uintptr_t)dst & 15) != 0) {
+                *dst++ = *src++;
+                len--;
+        }
+        for (; len >= 16; len -= 16, dst += 16, src += 16) {
+                _mm_stream_si128((__m128i *)dst, _mm_loadu_si128((const __m128i *)src));
+        }
+#endif
+        memcpy(dst, src, len);
+}
+
+static int codec_mem_nt(unsigned char mode, int decode, const char *in, size_t len,
+                        char *out, size_t *out_len)
+{
+        /* encoded characters per decoding block, multiple of 8 and 4 */
+        const size_t dblock = NT_BLOCK / 3 * 4;
+        _Alignas(64) char stage[NT_BLOCK * 2 + 1];
+        const size_t step = decode ? dblock : NT_BLOCK;
+        size_t w = 0, n;
+        int status = 0;
+
+        /* as in codec_mem_crc only the last block may end with line breaks
+           or padding */
+        if (decode && mode != BASE16) {
+                while (len > 0 && (in[len - 1] == '\r' || in[len - 1] == '\n')) {
+                        --len;
+                }
+        }
+        for (size_t i = 0; i < len; i += step) {
+                size_t end = len - i < step ? len - i : step;
+
+                if (decode && i + end < len && !block_end_ok(in + i, end)) {
+                        errno = EINVAL;
+                        status = -1;
+                        break;
+                }
+                if (codec_mem(mode, decode, in + i, end, stage, &n) == -1) {
+                        status = -1;
+                        break;
+                }
+                stream_copy(out + w, stage, n);
+                w += n;
+        }
+#ifdef __SSE2__
+        _mm_sfence();
+#endif
+        out[w] = '\0';
+        *out_len = w;
+        return status;
+}
+
+/* codec_mem with the non-temporal threshold 'nt' (0 for never) */
+static int codec_mem_run(unsigned char mode, int decode, const char *in, size_t len,
+                         char *out, size_t *out_len, size_t nt)
+{
+        const unsigned char *s = (const unsigned char *)in;
+
+        if (nt != 0 && len >= nt && len > NT_BLOCK / 3 * 4 && GROUP_MODE(mode)) {
+                return codec_mem_nt(mode, decode, in, len, out, out_len);
+        }
+        if (len > UINT_MAX) {
+                errno = EOVERFLOW;
+                return -1;
+        }
+        if (!decode) {
+                switch (mode) {
+                        case BASE64:
+                                b64_enc(s, out, len);
+                                break;
+                        case BASE32:
+                                b32_enc(s, (unsigned char *)out, len);
+                                break;
+                        case BASE16:
+                                b16_enc(s, out, len);
+                                break;
+                        case BASE85:
+                                *out_len = z85_enc(s, out, (unsigned int)len);
+                                return 0;
+                        case ASCII85:
+                                *out_len = a85_enc(s, out, (unsigned int)len);
+                                return 0;
+                        default:
+                                errno = EINVAL;
+                                return -1;
+                }
+                *out_len = codec_buf_size(mode, 0, len) - 1;
+                return 0;
+        }
+        errno = 0;
+        switch (mode) {
+                case BASE64:
+                        *out_len = b64_dec(s, out, len);
+                        break;
+                case BASE32:
+                        *out_len = b32_dec(s, out, len);
+                        break;
+                case BASE16:
+                        *out_len = b16_dec(in, out, len);
+                        break;
+                case BASE85:
+                        *out_len = z85_dec(in, out, len);
+                        break;
+                case ASCII85:
+                        *out_len = a85_dec(in, out, len);
+                        break;
+                default:
+                        errno = EINVAL;
+                        return -1;
+        }
+        return errno != 0 ? -1 : 0;
+}
+
+/* encode or decode 'len' bytes from 'in' into 'out', which must hold
+   codec_buf_size() bytes, the output size is returned in 'out_len',
+   inputs above the non-temporal threshold bypass the caches on output */
+int codec_mem(unsigned char mode, int decode, const char *in, size_t len,
+              char *out, size_t *out_len)
+{
+        return codec_mem_run(mode, decode, in, len, out, out_len,
+                             atomic_load_explicit(&nt_threshold, memory_order_relaxed));
+}
+
+/*  decoding of text: the output is checked to be UTF-8 block by block,
+    right after each block is decoded and while it is still in L1. With
+    SSSE3 or AVX2, picked at run time, 16 or 32 bytes are checked at a
+    time with the range lookup of Keiser and Lemire ("Validating UTF-8 In
+    Less Than One Instruction Per Byte"): every byte pair is classified
+    by three table lookups, on the high and low nibble of the first byte
+    and the high nibble of the second, an error bit set in all three is
+    an error. What the vectors do not cover, the tail and the chunk where
+    they found an error, goes through the RFC 3629 ranges one byte at a
+    time, which also gives the offset of the bad sequence */
+#if defined(__x86_64__) && defined(__GNUC__)
+#define U8_TOO_SHORT (1 << 0)   /* lead byte not followed by a continuation */
+#define U8_TOO_LONG (1 << 1)    /* continuation after an ASCII byte */
+#define U8_OVERLONG_3 (1 << 2)
+#define U8_TOO_LARGE (1 << 3)   /* past U+10FFFF */
+#define U8_SURROGATE (1 << 4)
+#define U8_OVERLONG_2 (1 << 5)
+#define U8_TOO_LARGE_1000 (1 << 6)
+#define U8_OVERLONG_4 (1 << 6)
+#define U8_TWO_CONTS (1 << 7)   /* continuation after a continuation, fine in 3, 4 byte forms */
+#define U8_CARRY (U8_TOO_SHORT | U8_TOO_LONG | U8_TWO_CONTS)
+
+/* indexed by the high nibble of the first byte of a pair */
+static const unsigned char u8_first_high[16] = {
+        U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG,
+        U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG,
+        U8_TWO_CONTS, U8_TWO_CONTS, U8_TWO_CONTS, U8_TWO_CONTS,
+        U8_TOO_SHORT | U8_OVERLONG_2,
+        U8_TOO_SHORT,
+        U8_TOO_SHORT | U8_OVERLONG_3 | U8_SURROGATE,
+        U8_TOO_SHORT | U8_TOO_LARGE | U8_TOO_LARGE_1000 | U8_OVERLONG_4
+};
+
+/* indexed by the low nibble of the first byte */
+static const unsigned char u8_first_low[16] = {
+        U8_CARRY | U8_OVERLONG_3 | U8_OVERLONG_2 | U8_OVERLONG_4,
+        U8_CARRY | U8_OVERLONG_2,
+        U8_CARRY,
+        U8_CARRY,
+        U8_CARRY | U8_TOO_LARGE,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000 | U8_SURROGATE,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000
+};
+
+/* indexed by the high nibble of the second byte */
+static const unsigned char u8_second_high[16] = {
+        U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT,
+        U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT,
+        U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_OVERLONG_3 | U8_TOO_LARGE_1000 |
+                U8_OVERLONG_4,
+        U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_OVERLONG_3 | U8_TOO_LARGE,
+        U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_SURROGATE | U8_TOO_LARGE,
+        U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_SURROGATE | U8_TOO_LARGE,
+        U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT
+};
+#endif
+
+/* the first 'i' bytes of 's' passed the vector check, which does not look
+   for a sequence cut at 'i'. Returns where the one byte at a time check
+   goes on, the start of that sequence or 'i' */
+static size_t utf8_resume(const unsigned char *s, size_t i)
+{
+        for (size_t k = 1; k <= 3 && k <= i; k++) {
+                unsigned char c = s[i - k];
+
+                if (c < 0x80) {
+                        break;
+                }
+                if (c >= 0xc0) {
+                        return (size_t)(c >= 0xf0 ? 4 : c >= 0xe0 ? 3 : 2) > k ? i - k : i;
+                }
+        }
+        return i;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+__attribute__((target("ssse3")))
+static size_t utf8_valid_ssse3(const unsigned char *s, size_t n)
+{
+        const __m128i first_high = _mm_loadu_si128((const __m128i *)u8_first_high);
+        const __m128i first_low = _mm_loadu_si128((const __m128i *)u8_first_low);
+        const __m128i second_high = _mm_loadu_si128((const __m128i *)u8_second_high);
+        const __m128i nibble = _mm_set1_epi8(0x0f);
+        /* above these, the last bytes of a chunk start a sequence that is cut */
+        const __m128i cut = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                          (char)0xef, (char)0xdf, (char)0xbf);
+        __m128i prev = _mm_setzero_si128(), prev_cut = _mm_setzero_si128();
+        size_t i = 0;
+
+        for (; i + 16 <= n; i += 16) {
+                __m128i in = _mm_loadu_si128((const __m128i *)(s + i)), err;
+
+                if (_mm_movemask_epi8(in) == 0) {
+                        err = prev_cut;
+                } else {
+                        __m128i p1 = _mm_alignr_epi8(in, prev, 15);
+                        __m128i p2 = _mm_alignr_epi8(in, prev, 14);
+                        __m128i p3 = _mm_alignr_epi8(in, prev, 13);
+                        __m128i pairs = _mm_and_si128(
+                                _mm_and_si128(
+                                        _mm_shuffle_epi8(first_high,
+                                                         _mm_and_si128(_mm_srli_epi16(p1, 4), nibble)),
+                                        _mm_shuffle_epi8(first_low, _mm_and_si128(p1, nibble))),
+                                _mm_shuffle_epi8(second_high,
+                                                 _mm_and_si128(_mm_srli_epi16(in, 4), nibble)));
+                        /* third and fourth bytes of a sequence must be continuations */
+                        __m128i must = _mm_or_si128(_mm_subs_epu8(p2, _mm_set1_epi8(0x60)),
+                                                    _mm_subs_epu8(p3, _mm_set1_epi8(0x70)));
+                        err = _mm_xor_si128(_mm_and_si128(must, _mm_set1_epi8((char)0x80)), pairs);
+                }
+                if (_mm_movemask_epi8(_mm_cmpeq_epi8(err, _mm_setzero_si128())) != 0xffff) {
+                        break;
+                }
+                prev = in;
+                prev_cut = _mm_subs_epu8(in, cut);
+        }
+        return utf8_resume(s, i);
+}
+
+__attribute__((target("avx2")))
+static size_t utf8_valid_avx2(const unsigned char *s, size_t n)
+{
+        const __m256i first_high =
+                _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)u8_first_high));
+        const __m256i first_low =
+                _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)u8_first_low));
+        const __m256i second_high =
+                _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)u8_second_high));
+        const __m256i nibble = _mm256_set1_epi8(0x0f);
+        const __m256i cut = _mm256_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                             -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                             -1, -1, -1, (char)0xef, (char)0xdf, (char)0xbf);
+        __m256i prev = _mm256_setzero_si256(), prev_cut = _mm256_setzero_si256();
+        size_t i = 0;
+
+        for (; i + 32 <= n; i += 32) {
+                __m256i in = _mm256_loadu_si256((const __m256i *)(s + i)), err;
+
+                if (_mm256_movemask_epi8(in) == 0) {
+                        err = prev_cut;
+                } else {
+                        /* the byte before each lane comes from the lane before it */
+                        __m256i back = _mm256_permute2x128_si256(prev, in, 0x21);
+                        __m256i p1 = _mm256_alignr_epi8(in, back, 15);
+                        __m256i p2 = _mm256_alignr_epi8(in, back, 14);
+                        __m256i p3 = _mm256_alignr_epi8(in, back, 13);
+                        __m256i pairs = _mm256_and_si256(
+                                _mm256_and_si256(
+                                        _mm256_shuffle_epi8(first_high,
+                                                            _mm256_and_si256(_mm256_srli_epi16(p1, 4),
+                                                                             nibble)),
+                                        _mm256_shuffle_epi8(first_low, _mm256_and_si256(p1, nibble))),
+                                _mm256_shuffle_epi8(second_high,
+                                                    _mm256_and_si256(_mm256_srli_epi16(in, 4), nibble)));
+                        __m256i must = _mm256_or_si256(_mm256_subs_epu8(p2, _mm256_set1_epi8(0x60)),
+                                                       _mm256_subs_epu8(p3, _mm256_set1_epi8(0x70)));
+                        err = _mm256_xor_si256(_mm256_and_si256(must, _mm256_set1_epi8((char)0x80)),
+                                               pairs);
+                }
+                if (!_mm256_testz_si256(err, err)) {
+                        break;
+                }
+                prev = in;
+                prev_cut = _mm256_subs_epu8(in, cut);
+        }
+        return utf8_resume(s, i);
+}
+#endif
+
+static size_t utf8_valid_none(const unsigned char *s, size_t n)
+{
+        (void)s;
+        (void)n;
+        return 0;
+}
+
+/* length of a valid prefix of 's' found by the vector check */
+static size_t (*utf8_valid)(const unsigned char *s, size_t n) = utf8_valid_none;
+static pthread_once_t utf8_once = PTHREAD_ONCE_INIT;
+
+static void utf8_init(void)
+{
+#if defined(__x86_64__) && defined(__GNUC__)
+        if (__builtin_cpu_supports("avx2")) {
+                utf8_valid = utf8_valid_avx2;
+        } else if (__builtin_cpu_supports("ssse3")) {
+                utf8_valid = utf8_valid_ssse3;
+        }
+#endif
+}
+
+/* check 'n' bytes of 's', returns 0 when they are valid, 1 when they end
+   with an incomplete sequence starting at 'pos', -1 when the sequence at
+   'pos' is invalid */
+static int utf8_run(const unsigned char *s, size_t n, size_t *pos)
+{
+        size_t i = utf8_valid(s, n);
+
+        while (i < n) {
+                unsigned char c = s[i], lo = 0x80, hi = 0xbf;
+                size_t need;
+
+#ifdef __SSE2__
+                if (c < 0x80) {
+                        while (i + 16 <= n &&
+                               _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(s + i))) == 0) {
+                                i += 16;
+                        }
+                        for (; i < n && s[i] < 0x80; i++);
+                        continue;
+                }
+#else
+                if (c < 0x80) {
+                        i++;
+                        continue;
+                }
+#endif
+                if (c < 0xc2 || c > 0xf4) {
+                        *pos = i;
+                        return -1;
+                }
+                need = c < 0xe0 ? 1 : c < 0xf0 ? 2 : 3;
+                /* no overlong forms, surrogates or code points past U+10FFFF */
+                if (c == 0xe0) {
+                        lo = 0xa0;
+                } else if (c == 0xed) {
+                        hi = 0x9f;
+                } else if (c == 0xf0) {
+                        lo = 0x90;
+                } else if (c == 0xf4) {
+                        hi = 0x8f;
+                }
+                for (size_t k = 1; k <= need; k++) {
+                        if (i + k == n) {
+                                *pos = i;
+                                return 1;
+                        }
+                        if (s[i + k] < lo || s[i + k] > hi) {
+                                *pos = i;
+                                return -1;
+                        }
+                        lo = 0x80;
+                        hi = 0xbf;
+                }
+                i += need + 1;
+        }
+        return 0;
+}
+
+/* decode 'len' bytes of 'in' like codec_mem, the result must be UTF-8
+   text. Returns 0, or -1 with errno set to EINVAL when the input can't be
+   decoded and to EILSEQ when the output is not UTF-8, 'bad' then gets
+   the offset in the output of the first invalid or incomplete sequence.
+   'out' must hold codec_buf_size() bytes, 'bad' can be NULL */
+int codec_dec_utf8(unsigned char mode, const char *in, size_t len, char *out,
+                   size_t *out_len, size_t *bad)
+{
+        size_t step, w = 0, checked = 0, n, pos;
+        int rc = 0;
+
+        if (in == NULL || out == NULL || out_len == NULL || !GROUP_MODE(mode)) {
+                errno = EINVAL;
+                return -1;
+        }
+        pthread_once(&utf8_once, utf8_init);
+        step = NT_BLOCK / raw_group[mode] * enc_group[mode];
+        if (mode != BASE16) {
+                while (len > 0 && (in[len - 1] == '\r' || in[len - 1] == '\n')) {
+                        --len;
+                }
+        }
+        for (size_t i = 0; i < len; i += step) {
+                size_t end = len - i < step ? len - i : step;
+
+                if (i + end < len && !block_end_ok(in + i, end)) {
+                        errno = EINVAL;
+                        return -1;
+                }
+                if (codec_mem(mode, 1, in + i, end, out + w, &n) == -1) {
+                        return -1;
+                }
+                w += n;
+                /* a sequence cut by the end of the block is checked again
+                   with the next one */
+                if ((rc = utf8_run((const unsigned char *)out + checked, w - checked, &pos)) == -1) {
+                        break;
+                }
+                checked = rc == 1 ? checked + pos : w;
+        }
+        out[w] = '\0';
+        *out_len = w;
+        if (rc != 0) {
+                if (bad != NULL) {
+                        *bad = checked + (rc == -1 ? pos : 0);
+                }
+                errno = EILSEQ;
+                return -1;
+        }
+        return 0;
+}
+
+/*  scatter/gather: the input is a list of segments, whole groups are run
+    in place from each segment and only the groups that straddle two
+    segments go through a small carry buffer, the output is the same as
+    running the codec on the concatenation */
+struct vstate {
+        unsigned char mode;
+        int decode;
+        size_t total;           /* input bytes taken, line breaks at the end excluded */
+        size_t done;            /* input bytes run so far */
+        char *out;
+        size_t w;
+};
+
+static int vrun(struct vstate *v, const char *in, size_t len)
+{
+        size_t n;
+
+        v->done += len;
+        /* as in codec_mem_crc only the last run may end with padding or line
+           breaks, the decoders would trim them */
+        if (v->decode && v->done < v->total && !block_end_ok(in, len)) {
+                errno = EINVAL;
+                return -1;
+        }
+        if (codec_mem(v->mode, v->decode, in, len, v->out + v->w, &n) == -1) {
+                return -1;
+        }
+        v->w += n;
+        return 0;
+}
+
+/* codec_mem on the concatenation of the 'iovcnt' segments of 'iov' */
+int codec_memv(unsigned char mode, int decode, const struct iovec *iov, int iovcnt,
+               char *out, size_t *out_len)
+{
+        struct vstate v = {mode, decode, 0, 0, out, 0};
+        char carry[8];
+        size_t g, nc = 0, left;
+
+        if (!GROUP_MODE(mode) || iovcnt < 0 || (iov == NULL && iovcnt > 0)) {
+                errno = EINVAL;
+                return -1;
+        }
+        g = decode ? enc_group[mode] : raw_group[mode];
+        for (int i = 0; i < iovcnt; i++) {
+                v.total += iov[i].iov_len;
+        }
+        if (decode && mode != BASE16) {
+                for (int i = iovcnt - 1; i >= 0; i--) {
+                        const char *p = iov[i].iov_base;
+                        size_t n = iov[i].iov_len;
+                        while (n > 0 && (p[n - 1] == '\r' || p[n - 1] == '\n')) {
+                                n--;
+                                v.total--;
+                        }
+                        if (n > 0) {
+                                break;
+                        }
+                }
+        }
+
+        left = v.total;
+        for (int i = 0; i < iovcnt && left > 0; i++) {
+                const char *p = iov[i].iov_base;
+                size_t n = iov[i].iov_len < left ? iov[i].iov_len : left;
+                size_t bulk;
+
+                left -= n;
+                if (nc > 0) {
+                        size_t k = g - nc < n ? g - nc : n;
+                        memcpy(carry + nc, p, k);
+                        nc += k;
+                        p += k;
+                        n -= k;
+                        if (nc == g) {
+                                if (vrun(&v, carry, g) == -1) {
+                                        return -1;
+                                }
+                                nc = 0;
+                        }
+                }
+                bulk = n / g * g;
+                if (bulk > 0 && vrun(&v, p, bulk) == -1) {
+                        return -1;
+                }
+                memcpy(carry + nc, p + bulk, n - bulk);
+                nc += n - bulk;
+        }
+        /* a partial group is the tail of the input, padded when encoding
+           and rejected by the decoder when it is incomplete */
+        if (nc > 0 && vrun(&v, carry, nc) == -1) {
+                return -1;
+        }
+        out[v.w] = '\0';
+        *out_len = v.w;
+        return 0;
+}
+
+/* b64_enc and b64_dec over a list of segments, they return the length of
+   the output, the decoders set errno on invalid input */
+size_t b64_encv(const struct iovec *iov, int iovcnt, char b[])
+{
+        size_t n = 0;
+        codec_memv(BASE64, 0, iov, iovcnt, b, &n);
+        return n;
+}
+
+size_t b64_decv(const struct iovec *iov, int iovcnt, char b[])
+{
+        size_t n = 0;
+        errno = 0;
+        if (codec_memv(BASE64, 1, iov, iovcnt, b, &n) == -1) {
+                b[0] = '\0';
+                return 0;
+        }
+        return n;
+}
+
+size_t b32_encv(const struct iovec *iov, int iovcnt, char b[])
+{
+        size_t n = 0;
+        codec_memv(BASE32, 0, iov, iovcnt, b, &n);
+        return n;
+}
+
+size_t b32_decv(const struct iovec *iov, int iovcnt, char b[])
+{
+        size_t n = 0;
+        errno = 0;
+        if (codec_memv(BASE32, 1, iov, iovcnt, b, &n) == -1) {
+                b[0] = '\0';
+                return 0;
+        }
+        return n;
+}
+
+/* read 'size' bytes of the file 'fd' from its start into 'b', the holes
+   of sparse files are not read but filled with zeros, returns the bytes
+   stored, less than 'size' if the file got shorter */
+static ssize_t read_sparse(int fd, char *b, size_t size)
+{
+        struct stat st;
+        size_t off = 0;
+        int sparse = fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+                     (unsigned long long)st.st_blocks * 512 < (unsigned long long)st.st_size;
+
+        while (off < size) {
+                size_t end = size;
+                ssize_t chunk;
+
+#ifdef SEEK_DATA
+                if (sparse) {
+                        off_t data = lseek(fd, (off_t)off, SEEK_DATA), hole;
+
+                        if (data == -1 && errno == ENXIO) {
+                                /* a hole up to the end */
+                                memset(b + off, 0, size - off);
+                                return (ssize_t)size;
+                        }
+                        if (data == -1) {
+                                /* not supported here, read everything */
+                                sparse = 0;
+                                if (lseek(fd, (off_t)off, SEEK_SET) == -1) {
+                                        return -1;
+                                }
+                        } else {
+                                if ((size_t)data > size) {
+                                        data = (off_t)size;
+                                }
+                                memset(b + off, 0, (size_t)data - off);
+                                off = (size_t)data;
+                                hole = lseek(fd, data, SEEK_HOLE);
+                                if (hole != -1 && (size_t)hole < size) {
+                                        end = (size_t)hole;
+                                }
+                                if (lseek(fd, data, SEEK_SET) == -1) {
+                                        return -1;
+                                }
+                        }
+                }
+#endif
+                while (off < end) {
+                        chunk = read(fd, b + off, end - off);
+                        if (chunk < 0) {
+                                if (errno == EINTR) {
+                                        continue;
+                                }
+                                return -1;
+                        }
+                        if (chunk == 0) {
+                                return (ssize_t)off;
+                        }
+                        off += (size_t)chunk;
+                }
+        }
+        return (ssize_t)off;
+}
+
+/* read the whole file 'src' into 'in' (null terminated) */
+static int load_file(const char *src, struct iobuf *in, size_t *len)
+{
+        struct stat st;
+        size_t size, offset;
+        ssize_t got;
+        int fd;
+
+        if (src == NULL) {
+                errno = EINVAL;
+                return -1;
+        }
+        if ((fd = open(src, O_RDONLY)) == -1) {
+                return -1;
+        }
+        if (fstat(fd, &st) == -1) {
+                close(fd);
+                return -1;
+        }
+        if ((unsigned long long)st.st_size > (unsigned long long)(SIZE_MAX - 1)) {
+                close(fd);
+                errno = EOVERFLOW;
+                return -1;
+        }
+        size = (size_t)st.st_size;
+        advise_input(fd, size);
+        if (iobuf_reserve(in, size + 1) == -1) {
+                close(fd);
+                return -1;
+        }
+        if ((got = read_sparse(fd, in->p, size)) == -1) {
+                close(fd);
+                return -1;
+        }
+        offset = (size_t)got;
+        close(fd);
+        in->p[offset] = '\0';
+        *len = offset;
+        return 0;
+}
+
+/* write 'len' bytes of 'b' to 'fd', retrying on short writes */
+static int write_all(int fd, const char *b, size_t len)
+{
+        while (len > 0) {
+                ssize_t wr = write(fd, b, len);
+                if (wr < 0) {
+                        if (errno == EINTR) {
+                                continue;
+                        }
+                        return -1;
+                }
+                b += wr;
+                len -= (size_t)wr;
+        }
+        return 0;
+}
+
+/*  outputs of large inputs are produced straight into a shared mapping
+    of 'dst' sized in advance, which saves the heap buffer and the copy
+    made by write(). The decoders' exact size comes from the validators */
+#define MMAP_OUT_MIN (1U << 20)
+
+/* returns 1 when 'dst' can't be mapped (not a regular file), so the
+   caller writes it the usual way. The output is built in a temporary
+   file next to 'dst' that replaces it only on success, so a failed
+   decode leaves 'dst' as it was. Links are written the usual way, as a
+   rename would break them */
+static int codec_file_mmap(const char *dst, unsigned char mode, int decode,
+                           const char *in, size_t len, uint32_t *crc)
+{
+        const unsigned char *s = (const unsigned char *)in;
+        unsigned int dsize = 0;
+        size_t size, out_len;
+        struct stat st;
+        char tmp[PATH_MAX], *map;
+        int ofd, rc, err, exists;
+
+        if (!decode) {
+                size = codec_buf_size(mode, 0, len) - 1;
+        } else {
+                switch (mode) {
+                        case BASE64:
+                                rc = b64_validate(s, (unsigned int)len, &dsize, NULL);
+                                break;
+                        case BASE32:
+                                rc = b32_validate(s, (unsigned int)len, &dsize, NULL);
+                                break;
+                        default:
+                                rc = b16_validate(in, (unsigned int)len, &dsize, NULL);
+                                break;
+                }
+                if (rc == -1) {
+                        return -1;
+                }
+                size = dsize;
+        }
+        if (!(exists = lstat(dst, &st) == 0) && errno != ENOENT) {
+                return -1;
+        }
+        if ((exists && (!S_ISREG(st.st_mode) || st.st_nlink > 1)) ||
+            snprintf(tmp, sizeof(tmp), "%s.XXXXXX", dst) >= (int)sizeof(tmp)) {
+                return 1;
+        }
+        if ((ofd = mkstemp(tmp)) == -1) {
+                return 1;       /* no room for it in the directory */
+        }
+        if (exists && fchmod(ofd, st.st_mode & 07777) == -1) {
+                goto fail;
+        }
+        /* one more byte for the null terminator written by the codecs,
+           the blocks are allocated now so a full disk is an error here
+           instead of a SIGBUS while writing to the mapping */
+        if (ftruncate(ofd, (off_t)size + 1) == -1) {
+                goto fail;
+        }
+        if ((err = posix_fallocate(ofd, 0, (off_t)size + 1)) == ENOSPC || err == EFBIG) {
+                errno = err;
+                goto fail;
+        }
+        map = mmap(NULL, size + 1, PROT_READ | PROT_WRITE, MAP_SHARED, ofd, 0);
+        if (map == MAP_FAILED) {
+                close(ofd);
+                unlink(tmp);
+                return 1;
+        }
+        if (crc != NULL) {
+                rc = codec_mem_crc(mode, decode, in, len, map, &out_len, crc);
+        } else {
+                rc = codec_mem(mode, decode, in, len, map, &out_len);
+        }
+        err = errno;
+        munmap(map, size + 1);
+        if (rc == -1) {
+                errno = err;
+                goto fail;
+        }
+        if (ftruncate(ofd, (off_t)out_len) == -1) {
+                goto fail;
+        }
+        if (close(ofd) == -1 || rename(tmp, dst) == -1) {
+                err = errno;
+                unlink(tmp);
+                errno = err;
+                return -1;
+        }
+        return 0;
+
+fail:
+        err = errno;
+        close(ofd);
+        unlink(tmp);
+        errno = err;
+        return -1;
+}
+
+/* encode or decode the file 'src' into 'dst' using the working buffers
+   'in' and 'out', which are grown as needed and left to the caller, the
+   CRC32C of the raw data is stored in 'crc' if it is not NULL */
+static int codec_file(const char *src, const char *dst, unsigned char mode,
+                      int decode, struct iobuf *in, struct iobuf *out, uint32_t *crc)
+{
+        size_t len, out_len, buf_len;
+        int ofd;
+
+        if (load_file(src, in, &len) == -1) {
+                return -1;
+        }
+        if ((buf_len = codec_buf_size(mode, decode, len)) == 0) {
+                return -1;
+        }
+        if (len >= MMAP_OUT_MIN && len <= UINT_MAX && GROUP_MODE(mode)) {
+                int rc = codec_file_mmap(dst, mode, decode, in->p, len, crc);
+                if (rc != 1) {
+                        return rc;
+                }
+        }
+        if (iobuf_reserve(out, buf_len) == -1) {
+                return -1;
+        }
+        if (crc != NULL) {
+                if (codec_mem_crc(mode, decode, in->p, len, out->p, &out_len, crc) == -1) {
+                        return -1;
+                }
+        } else if (codec_mem(mode, decode, in->p, len, out->p, &out_len) == -1) {
+                return -1;
+        }
+        if ((ofd = open(dst, O_CREAT | O_WRONLY | O_TRUNC, S_IRUSR | S_IWUSR)) == -1) {
+                return -1;
+        }
+        if (write_all(ofd, out->p, out_len) == -1) {
+                int err = errno;
+                close(ofd);
+                errno = err;
+                return -1;
+        }
+        return close(ofd);
+}
+
+/* encode_wr_file and decode_rd_file using the buffers of the arena 'a' */
+int encode_wr_file_arena(const char *src, const char *dst, unsigned char mode,
+                         struct codec_arena *a)
+{
+        if (a == NULL) {
+                errno = EINVAL;
+                return -1;
+        }
+        return codec_file(src, dst, mode, 0, &a->in, &a->out, NULL);
+}
+
+int decode_rd_file_arena(const char *src, const char *dst, unsigned char mode,
+                         struct codec_arena *a)
+{
+        if (a == NULL) {
+                errno = EINVAL;
+                return -1;
+        }
+        return codec_file(src, dst, mode, 1, &a->in, &a->out, NULL);
+}
+
+/* encode or decode 'len' bytes of 'in' into the output buffer of the arena,
+   the result (null terminated) is valid until the next use of the arena,
+   returns NULL on error */
+char *codec_arena_mem(struct codec_arena *a, unsigned char mode, int decode,
+                      const char *in, size_t len, size_t *out_len)
+{
+        size_t buf_len;
+
+        if (a == NULL || out_len == NULL) {
+                errno = EINVAL;
+                return NULL;
+        }
+        if ((buf_len = codec_buf_size(mode, decode, len)) == 0) {
+                return NULL;
+        }
+        if (iobuf_reserve(&a->out, buf_len) == -1) {
+                return NULL;
+        }
+        if (codec_mem(mode, decode, in, len, a->out.p, out_len) == -1) {
+                return NULL;
+        }
+        return a->out.p;
+}
+
+/* write an input file into a destination file encoded in
+   the base encoding specified in 'mode'. 
+   modes supported : BASE64, BASE32, BASE16 */
+int encode_wr_file(const char *src, const char *dst, unsigned char mode)
+{
+        struct codec_arena a = {{NULL, 0}, {NULL, 0}};
+        int status = codec_file(src, dst, mode, 0, &a.in, &a.out, NULL);
+
+        iobuf_release(&a.in);
+        iobuf_release(&a.out);
+        return status;
+}
+
+/* allocate 'size' bytes with the library allocator, sets errno to
+   ENOMEM and returns NULL on failure, release with 'dealloc' */
+char *alloc(unsigned int size)
+{
+        return (char *)lib_alloc(size);
+}
+
+void dealloc(char *ptr, unsigned int size)
+{
+        lib_free(ptr, size);
+}
+
+/* open a file, get file info, load it to memory and return file 
+   information on memory as a pointer to a structure 'finfo', 
+   returns NULL on error */
+struct finfo *get_file(const char *f)
+{
+        int fd = -1;
+        struct stat fp;
+        char *addr = NULL;
+        struct finfo *st_addr = NULL;
+        size_t to_read = 0;
+        size_t offset = 0;
+        ssize_t got;
+
+        if (f == NULL) {
+                errno = EINVAL;
+                return NULL;
+        }
+
+        fd = open(f, O_RDONLY);
+        if (fd == -1) {
+                return NULL;
+        }
+
+        if (fstat(fd, &fp) == -1) {
+                close(fd);
+                return NULL;
+        }
+
+        if (fp.st_size < 0) {
+                errno = EINVAL;
+                close(fd);
+                return NULL;
+        }
+
+        if ((unsigned long long)fp.st_size > (unsigned long long)(SIZE_MAX - 1)) {
+                errno = EOVERFLOW;
+                close(fd);
+                return NULL;
+        }
+
+        to_read = (size_t)fp.st_size;
+        advise_input(fd, to_read);
+        /* from the allocator, callers may free 'addr' and the finfo themselves */
+        addr = lib_alloc(to_read + 1);
+        if (addr == NULL) {
+                close(fd);
+                return NULL;
+        }
+
+        if ((got = read_sparse(fd, addr, to_read)) == -1) {
+                lib_free(addr, to_read + 1);
+                close(fd);
+                return NULL;
+        }
+        offset = (size_t)got;
+
+        close(fd);
+        addr[offset] = '\0';
+
+        st_addr = lib_alloc(sizeof(*st_addr));
+        if (st_addr == NULL) {
+                lib_free(addr, to_read + 1);
+                return NULL;
+        }
+
+        st_addr->addr = addr;
+        st_addr->size = offset;
+        st_addr->cap = to_read + 1;
+        return st_addr;
+}
+
+void free_finfo(struct finfo *info)
+{
+        if (info == NULL) {
+                return;
+        }
+        lib_free(info->addr, info->cap);
+        lib_free(info, sizeof(*info));
+}
+
+int decode_rd_file(const char *src, const char *dst, unsigned char mode)
+{
+        struct codec_arena a = {{NULL, 0}, {NULL, 0}};
+        int status = codec_file(src, dst, mode, 1, &a.in, &a.out, NULL);
+
+        iobuf_release(&a.in);
+        iobuf_release(&a.out);
+        return status;
+}
+
+/*  the encoding of a growing file only changes after its last complete
+    group, the output 'dst' of an earlier encode of 'src' is cut back to
+    the end of its last complete group and only what follows is encoded
+    and appended. Only the last kept group is checked: a 'src' that
+    shrank, or whose last kept group encodes different bytes, is encoded
+    again from scratch, a rewritten earlier part goes unnoticed */
+#define APPEND_CHUNK (15U * 4096)       /* raw bytes encoded at a time */
+
+int encode_append_file(const char *src, const char *dst, unsigned char mode)
+{
+        size_t g, eg, groups = 0, off = 0, enc_size = codec_buf_size(mode, 0, APPEND_CHUNK);
+        char last[8], check[16], *raw = NULL, *enc = NULL;
+        struct stat ss, ds;
+        int ifd, ofd = -1, status = -1;
+
+        if (src == NULL || dst == NULL || !GROUP_MODE(mode)) {
+                errno = EINVAL;
+                return -1;
+        }
+        g = raw_group[mode];
+        eg = enc_group[mode];
+        if ((ifd = open(src, O_RDONLY)) == -1) {
+                return -1;
+        }
+        if (fstat(ifd, &ss) == -1 ||
+            (ofd = open(dst, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR)) == -1 || fstat(ofd, &ds) == -1) {
+                goto done;
+        }
+
+        /* complete groups already in 'dst', a padded one is redone */
+        if (ds.st_size > 0 && (size_t)ds.st_size % eg == 0 &&
+            pread(ofd, last, eg, ds.st_size - (off_t)eg) == (ssize_t)eg) {
+                groups = (size_t)ds.st_size / eg - (last[eg - 1] == PAD);
+        }
+        off = groups * g;
+        if (off > (size_t)ss.st_size) {
+                off = groups = 0;       /* 'src' shrank, it was replaced */
+        }
+        /* the last complete group must be the encoding of the same bytes */
+        if (groups > 0) {
+                unsigned char b[5];
+                size_t n;
+
+                if (pread(ifd, b, g, (off_t)(off - g)) != (ssize_t)g ||
+                    pread(ofd, last, eg, (off_t)((groups - 1) * eg)) != (ssize_t)eg ||
+                    codec_mem(mode, 0, (char *)b, g, check, &n) == -1 ||
+                    memcmp(check, last, eg) != 0) {
+                        off = groups = 0;
+                }
+        }
+        if (ftruncate(ofd, (off_t)(groups * eg)) == -1 ||
+            lseek(ofd, (off_t)(groups * eg), SEEK_SET) == -1) {
+                goto done;
+        }
+
+        if ((raw = lib_alloc(APPEND_CHUNK)) == NULL || (enc = lib_alloc(enc_size)) == NULL) {
+                goto done;
+        }
+        while (off < (size_t)ss.st_size) {
+                size_t want = (size_t)ss.st_size - off < APPEND_CHUNK ?
+                              (size_t)ss.st_size - off : APPEND_CHUNK;
+                ssize_t rd = pread(ifd, raw, want, (off_t)off);
+                size_t n;
+
+                if (rd < 0 && errno == EINTR) {
+                        continue;
+                }
+                if (rd <= 0) {
+                        if (rd == 0) {
+                                break;  /* 'src' got shorter meanwhile */
+                        }
+                        goto done;
+                }
+                /* only the last chunk may end with a partial group */
+                if ((size_t)rd < want && (size_t)rd % g != 0 && off + (size_t)rd < (size_t)ss.st_size) {
+                        rd -= (ssize_t)((size_t)rd % g);
+                }
+                if (codec_mem(mode, 0, raw, (size_t)rd, enc, &n) == -1 || write_all(ofd, enc, n) == -1) {
+                        goto done;
+                }
+                off += (size_t)rd;
+        }
+        status = 0;
+
+done:
+        {
+                int err = errno;
+                close(ifd);
+                if (ofd != -1 && close(ofd) == -1 && status == 0) {
+                        err = errno;
+                        status = -1;
+                }
+                lib_free(raw, APPEND_CHUNK);
+                lib_free(enc, enc_size);
+                errno = err;
+        }
+        return status;
+}
+
+/* -------------------------------------------------------------------> checksums */
+/*  CRC32C (Castagnoli), with the SSE4.2 crc32 instruction when the cpu has
+    it and slicing-by-8 tables otherwise. The fused codec variants checksum
+    the raw bytes block by block right before encoding them or right after
+    decoding them, while the block is still in L1, instead of making a
+    second pass over the whole buffer */
+#define CRC32C_POLY 0x82f63b78U /* reflected */
+#define CRC_BLOCK 7680          /* raw bytes per block, a multiple of 3 and 5 */
+
+static uint32_t crc_table[8][256];
+static uint32_t (*crc_update)(uint32_t crc, const unsigned char *p, size_t len);
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static uint32_t crc_update_table(uint32_t crc, const unsigned char *p, size_t len)
+{
+        while (len > 0 && ((uintptr_t)p & 7) != 0) {
+                crc = crc_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+                len--;
+        }
+        while (len >= 8) {
+                uint64_t v;
+                memcpy(&v, p, 8);
+                v ^= crc;       /* little endian */
+                crc = crc_table[7][v & 0xff] ^ crc_table[6][(v >> 8) & 0xff] ^
+                      crc_table[5][(v >> 16) & 0xff] ^ crc_table[4][(v >> 24) & 0xff] ^
+                      crc_table[3][(v >> 32) & 0xff] ^ crc_table[2][(v >> 40) & 0xff] ^
+                      crc_table[1][(v >> 48) & 0xff] ^ crc_table[0][v >> 56];
+                p += 8;
+                len -= 8;
+        }
+        while (len--) {
+                crc = crc_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+        }
+        return crc;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+__attribute__((target("sse4.2")))
+static uint32_t crc_update_sse42(uint32_t crc, const unsigned char *p, size_t len)
+{
+        uint64_t c = crc;
+
+        while (len >= 8) {
+                uint64_t v;
+                memcpy(&v, p, 8);
+                c = __builtin_ia32_crc32di(c, v);
+                p += 8;
+                len -= 8;
+        }
+        crc = (uint32_t)c;
+        while (len--) {
+                crc = __builtin_ia32_crc32qi(crc, *p++);
+        }
+        return crc;
+}
+#endif
+
+static void crc_init(void)
+{
+        for (uint32_t i = 0; i < 256; i++) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; k++) {
+                        c = c & 1 ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+                }
+                crc_table[0][i] = c;
+        }
+        for (uint32_t i = 0; i < 256; i++) {
+                for (int t = 1; t < 8; t++) {
+                        crc_table[t][i] = crc_table[0][crc_table[t - 1][i] & 0xff] ^
+                                          (crc_table[t - 1][i] >> 8);
+                }
+        }
+        crc_update = crc_update_table;
+#if defined(__x86_64__) && defined(__GNUC__)
+        if (__builtin_cpu_supports("sse4.2")) {
+                crc_update = crc_update_sse42;
+        }
+#endif
+}
+
+/* CRC32C of 'len' bytes of 'buf' continuing from 'crc', start with 0 */
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len)
+{
+        pthread_once(&crc_once, crc_init);
+        return ~crc_update(~crc, buf, len);
+}
+
+/* codec_mem that also returns in 'crc' the CRC32C of the raw data, the
+   input when encoding and the output when decoding, in the same pass */
+int codec_mem_crc(unsigned char mode, int decode, const char *in, size_t len,
+                  char *out, size_t *out_len, uint32_t *crc)
+{
+        /* encoded characters per decoding block, multiple of 8 and 4 */
+        const size_t dblock = CRC_BLOCK / 5 * 8;
+        uint32_t c = ~0U;
+        size_t w = 0, n;
+
+        pthread_once(&crc_once, crc_init);
+        if (!GROUP_MODE(mode)) {
+                errno = EINVAL;
+                return -1;
+        }
+        if (!decode) {
+                for (size_t i = 0; i < len || i == 0; i += CRC_BLOCK) {
+                        n = len - i < CRC_BLOCK ? len - i : CRC_BLOCK;
+                        c = crc_update(c, (const unsigned char *)in + i, n);
+                        if (codec_mem(mode, 0, in + i, n, out + w, &n) == -1) {
+                                return -1;
+                        }
+                        w += n;
+                }
+                *out_len = w;
+                *crc = ~c;
+                return 0;
+        }
+
+        /* the decoders trim line breaks and padding at the end of what they
+           are given, so only the last block may end with them */
+        if (mode != BASE16) {
+                while (len > 0 && (in[len - 1] == '\r' || in[len - 1] == '\n')) {
+                        --len;
+                }
+        }
+        for (size_t i = 0; i < len || i == 0; i += dblock) {
+                size_t end = len - i < dblock ? len - i : dblock;
+
+                if (i + end < len && !block_end_ok(in + i, end)) {
+                        errno = EINVAL;
+                        return -1;
+                }
+                if (codec_mem(mode, 1, in + i, end, out + w, &n) == -1) {
+                        return -1;
+                }
+                c = crc_update(c, (const unsigned char *)out + w, n);
+                w += n;
+        }
+        *out_len = w;
+        *crc = ~c;
+        return 0;
+}
+
+/* b64_enc and b64_dec computing the CRC32C of the raw data */
+void b64_enc_crc(const unsigned char *s, char b[], unsigned int len, uint32_t *crc)
+{
+        size_t n;
+        codec_mem_crc(BASE64, 0, (const char *)s, len, b, &n, crc);
+}
+
+unsigned int b64_dec_crc(const unsigned char *s, char b[], unsigned int len, uint32_t *crc)
+{
+        size_t n = 0;
+
+        if (s == NULL || b == NULL) {
+                errno = EINVAL;
+                return 0;
+        }
+        if (codec_mem_crc(BASE64, 1, (const char *)s, len, b, &n, crc) == -1) {
+                b[0] = '\0';
+                return 0;
+        }
+        return (unsigned int)n;
+}
+
+/* -------------------------------------------------------------------> ranges */
+/*  decoded byte k of a base64 string comes from quad k / 3, so a range of
+    the output only needs the quads that cover it. Quads are decoded in
+    chunks through a small buffer and the requested bytes copied out */
+#define RANGE_CHUNK 1024        /* quads decoded per step */
+#define IS_WS(c) ((c) == '\n' || (c) == '\r' || (c) == ' ' || (c) == '\t')
+
+/* decode 'nq' quads of 'q' into 'b', only the last one may be padded */
+static int dec_quads(const unsigned char *q, size_t nq, int last, char *b, unsigned int *w)
+{
+        errno = 0;
+        *w = b64_dec_run(q, b, (unsigned int)(nq * 4));
+        if (errno != 0) {
+                return -1;
+        }
+        if (!last && *w != nq * 3) {    /* padding before the end */
+                errno = EINVAL;
+                return -1;
+        }
+        return 0;
+}
+
+/* decode the bytes [off, off + n) of the data encoded in the base64
+   string 's' (no line breaks except at the end) into 'b', which must hold
+   n + 1 bytes. Returns the number of bytes written, less than 'n' if the
+   range goes past the end of the data, or 0 with errno set to EINVAL if a
+   quad of the range is invalid. Cost is proportional to 'n' */
+size_t b64_dec_range(const unsigned char *s, size_t len, size_t off, size_t n, char *b)
+{
+        char tmp[RANGE_CHUNK * 3 + 1];
+        size_t total, q, q_end, w = 0;
+
+        if (s == NULL || b == NULL) {
+                errno = EINVAL;
+                return 0;
+        }
+        errno = 0;
+        b[0] = '\0';
+        while (len > 0 && (s[len - 1] == '\r' || s[len - 1] == '\n')) {
+                --len;
+        }
+        if ((len % 4) != 0) {
+                errno = EINVAL;
+                return 0;
+        }
+        total = (len / 4) * 3;
+        if (len > 0) {
+                total -= (s[len - 1] == PAD) + (s[len - 2] == PAD);
+        }
+        if (off >= total || n == 0) {
+                return 0;
+        }
+        if (n > total - off) {
+                n = total - off;
+        }
+
+        q_end = (off + n - 1) / 3 + 1;
+        for (q = off / 3; q < q_end; q += RANGE_CHUNK) {
+                size_t nq = q_end - q < RANGE_CHUNK ? q_end - q : RANGE_CHUNK;
+                size_t skip = w == 0 ? off % 3 : 0;
+                size_t take;
+                unsigned int got;
+
+                if (dec_quads(s + q * 4, nq, q + nq == len / 4, tmp, &got) == -1) {
+                        b[0] = '\0';
+                        return 0;
+                }
+                take = got - skip < n - w ? got - skip : n - w;
+                memcpy(b + w, tmp + skip, take);
+                w += take;
+        }
+        b[w] = '\0';
+        return w;
+}
+
+/*  for base64 with line breaks or other white space the quads don't sit at
+    fixed offsets, the index records the input offset of every 'stride'-th
+    significant character so a range read only scans from the entry before
+    it. It can be saved next to the encoded file and loaded back */
+struct b64_index {
+        uint64_t stride;        /* significant characters between entries */
+        uint64_t count;         /* number of entries in 'pos' */
+        uint64_t nchars;        /* significant characters in the input */
+        uint64_t size;          /* decoded size */
+        uint64_t *pos;          /* pos[k]: offset of significant char k * stride */
+};
+
+#define INDEX_MAGIC "B64IDX1"
+
+static struct b64_index *index_alloc(uint64_t count)
+{
+        struct b64_index *idx;
+
+        if (count > (SIZE_MAX - sizeof(*idx)) / sizeof(uint64_t)) {
+                errno = EOVERFLOW;
+                return NULL;
+        }
+        if ((idx = lib_alloc(sizeof(*idx))) == NULL) {
+                return NULL;
+        }
+        idx->count = count;
+        if ((idx->pos = lib_alloc(count * sizeof(uint64_t) + 1)) == NULL) {
+                lib_free(idx, sizeof(*idx));
+                return NULL;
+        }
+        return idx;
+}
+
+void b64_index_free(struct b64_index *idx)
+{
+        if (idx == NULL) {
+                return;
+        }
+        lib_free(idx->pos, idx->count * sizeof(uint64_t) + 1);
+        lib_free(idx, sizeof(*idx));
+}
+
+/* build the index of the base64 data in 's', 'stride' is rounded up to a
+   multiple of 4 (0 selects 4096). Fails with EINVAL on characters that
+   are not base64, white space, or padding at the end */
+struct b64_index *b64_index_build(const unsigned char *s, size_t len, size_t stride)
+{
+        struct b64_index *idx;
+        uint64_t nchars = 0, pads = 0;
+        size_t i;
+
+        if (s == NULL) {
+                errno = EINVAL;
+                return NULL;
+        }
+        stride = stride == 0 ? 4096 : (stride + 3) & ~(size_t)3;
+        for (i = 0; i < len; i++) {
+                nchars += !IS_WS(s[i]);
+        }
+        if ((idx = index_alloc((nchars + stride - 1) / stride)) == NULL) {
+                return NULL;
+        }
+        idx->stride = stride;
+        idx->nchars = nchars;
+
+        nchars = 0;
+        for (i = 0; i < len; i++) {
+                unsigned char c = s[i];
+
+                if (IS_WS(c)) {
+                        continue;
+                }
+                if (nchars % stride == 0) {
+                        idx->pos[nchars / stride] = i;
+                }
+                if (c == PAD) {
+                        pads++;
+                } else if (pads != 0 || !B64_VALID(c)) {
+                        goto invalid;
+                }
+                nchars++;
+        }
+        if ((nchars % 4) != 0 || pads > 2) {
+                goto invalid;
+        }
+        idx->size = (nchars / 4) * 3 - pads;
+        return idx;
+
+invalid:
+        b64_index_free(idx);
+        errno = EINVAL;
+        return NULL;
+}
+
+/* decoded size of the data described by 'idx' */
+uint64_t b64_index_size(const struct b64_index *idx)
+{
+        return idx->size;
+}
+
+/* b64_dec_range for input with white space, using the index 'idx' that
+   was built from the same input */
+size_t b64_dec_range_idx(const unsigned char *s, size_t len, const struct b64_index *idx,
+                         size_t off, size_t n, char *b)
+{
+        unsigned char quads[RANGE_CHUNK * 4];
+        char tmp[RANGE_CHUNK * 3 + 1];
+        uint64_t c, q, q_end, last_quad;
+        size_t i, w = 0;
+
+        if (s == NULL || b == NULL || idx == NULL || idx->nchars == 0) {
+                errno = EINVAL;
+                return 0;
+        }
+        errno = 0;
+        b[0] = '\0';
+        if (off >= idx->size || n == 0) {
+                return 0;
+        }
+        if (n > idx->size - off) {
+                n = idx->size - off;
+        }
+
+        q = off / 3;
+        q_end = (off + n - 1) / 3 + 1;
+        last_quad = idx->nchars / 4 - 1;
+
+        /* start at the closest entry and skip to the first quad we need */
+        i = idx->pos[(q * 4) / idx->stride];
+        c = ((q * 4) / idx->stride) * idx->stride;
+        for (; c < q * 4; i++) {
+                if (i >= len) {
+                        errno = EINVAL;
+                        return 0;
+                }
+                c += !IS_WS(s[i]);
+        }
+
+        while (q < q_end) {
+                size_t nq = q_end - q < RANGE_CHUNK ? q_end - q : RANGE_CHUNK;
+                size_t got_chars = 0, skip = w == 0 ? off % 3 : 0, take;
+                unsigned int got;
+
+                while (got_chars < nq * 4 && i < len) {
+                        if (!IS_WS(s[i])) {
+                                quads[got_chars++] = s[i];
+                        }
+                        i++;
+                }
+                if (got_chars < nq * 4 ||
+                    dec_quads(quads, nq, q + nq - 1 == last_quad, tmp, &got) == -1) {
+                        errno = EINVAL;
+                        b[0] = '\0';
+                        return 0;
+                }
+                take = got - skip < n - w ? got - skip : n - w;
+                memcpy(b + w, tmp + skip, take);
+                w += take;
+                q += nq;
+        }
+        b[w] = '\0';
+        return w;
+}
+
+/* write the index to 'path' (native byte order) */
+int b64_index_save(const struct b64_index *idx, const char *path)
+{
+        uint64_t hdr[4];
+        char magic[8] = INDEX_MAGIC;
+        int fd, status;
+
+        if (idx == NULL || path == NULL) {
+                errno = EINVAL;
+                return -1;
+        }
+        if ((fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, S_IRUSR | S_IWUSR)) == -1) {
+                return -1;
+        }
+        hdr[0] = idx->stride;
+        hdr[1] = idx->count;
+        hdr[2] = idx->nchars;
+        hdr[3] = idx->size;
+        status = write_all(fd, magic, sizeof(magic)) == -1 ||
+                 write_all(fd, (const char *)hdr, sizeof(hdr)) == -1 ||
+                 write_all(fd, (const char *)idx->pos, idx->count * sizeof(uint64_t)) == -1 ? -1 : 0;
+        if (status == -1) {
+                int err = errno;
+                close(fd);
+                errno = err;
+                return -1;
+        }
+        return close(fd);
+}
+
+/* load an index written by b64_index_save, NULL on error */
+struct b64_index *b64_index_load(const char *path)
+{
+        struct b64_index *idx = NULL;
+        struct iobuf in = {NULL, 0};
+        uint64_t hdr[4];
+        size_t len;
+
+        if (load_file(path, &in, &len) == -1) {
+                return NULL;
+        }
+        if (len < 8 + sizeof(hdr) || memcmp(in.p, INDEX_MAGIC, 8) != 0) {
+                errno = EINVAL;
+                goto out;
+        }
+        memcpy(hdr, in.p + 8, sizeof(hdr));
+        if (hdr[0] == 0 || (hdr[0] % 4) != 0 || hdr[1] != (len - 8 - sizeof(hdr)) / sizeof(uint64_t) ||
+            hdr[1] != hdr[2] / hdr[0] + (hdr[2] % hdr[0] != 0)) {
+                errno = EINVAL;
+                goto out;
+        }
+        if ((idx = index_alloc(hdr[1])) == NULL) {
+                goto out;
+        }
+        idx->stride = hdr[0];
+        idx->nchars = hdr[2];
+        idx->size = hdr[3];
+        memcpy(idx->pos, in.p + 8 + sizeof(hdr), hdr[1] * sizeof(uint64_t));
+out:
+        iobuf_release(&in);
+        return idx;
+}
+
+/* -------------------------------------------------------------------> batch */
+/*  every worker owns a range [lo, hi) of the job array packed into one
+    word, it takes jobs from the front and once it runs dry it steals the
+    back half of the range of another worker, both with a single CAS */
+#define RANGE(lo, hi) (((uint64_t)(lo) << 32) | (uint32_t)(hi))
+#define RANGE_LO(r) ((uint32_t)((r) >> 32))
+#define RANGE_HI(r) ((uint32_t)(r))
+
+struct batch_deque {
+        _Atomic uint64_t range;
+        char pad[64 - sizeof(uint64_t)]; /* one cache line per worker */
+};
+
+struct batch_worker {
+        pthread_t tid;
+        unsigned int id;
+        struct batch_deque *dq;
+        unsigned int nworkers;
+        struct batch_job *jobs;
+        unsigned char mode;
+        int flags;
+        size_t failed;
+};
+
+static int batch_pop(struct batch_deque *d, uint32_t *idx)
+{
+        uint64_t r = atomic_load_explicit(&d->range, memory_order_acquire);
+
+        while (RANGE_LO(r) < RANGE_HI(r)) {
+                if (atomic_compare_exchange_weak(&d->range, &r,
+                                RANGE(RANGE_LO(r) + 1, RANGE_HI(r)))) {
+                        *idx = RANGE_LO(r);
+                        return 1;
+                }
+        }
+        return 0;
+}
+
+static int batch_steal(struct batch_worker *w, uint32_t *idx)
+{
+        for (unsigned int i = 1; i < w->nworkers; i++) {
+                struct batch_deque *v = &w->dq[(w->id + i) % w->nworkers];
+                uint64_t r = atomic_load_explicit(&v->range, memory_order_acquire);
+
+                while (RANGE_LO(r) < RANGE_HI(r)) {
+                        uint32_t lo = RANGE_LO(r), hi = RANGE_HI(r);
+                        uint32_t take = (hi - lo + 1) / 2;
+
+                        if (atomic_compare_exchange_weak(&v->range, &r, RANGE(lo, hi - take))) {
+                                /* our range is empty so nobody else updates it */
+                                atomic_store_explicit(&w->dq[w->id].range,
+                                                RANGE(hi - take + 1, hi), memory_order_release);
+                                *idx = hi - take;
+                                return 1;
+                        }
+                }
+        }
+        return 0;
+}
+
+static void *batch_run(void *arg)
+{
+        struct batch_worker *w = arg;
+        struct codec_arena a = {{NULL, 0}, {NULL, 0}};
+        uint32_t idx;
+
+        while (batch_pop(&w->dq[w->id], &idx) || batch_steal(w, &idx)) {
+                struct batch_job *job = &w->jobs[idx];
+
+                errno = 0;
+                if (codec_file(job->src, job->dst, w->mode, w->flags & BATCH_DECODE,
+                               &a.in, &a.out, w->flags & BATCH_CRC ? &job->crc : NULL) == -1) {
+                        job->err = errno != 0 ? errno : EIO;
+                        w->failed++;
+                } else {
+                        job->err = 0;
+                }
+        }
+        iobuf_release(&a.in);
+        iobuf_release(&a.out);
+        return NULL;
+}
+
+/* encode or decode (BATCH_DECODE in 'flags') every file of 'jobs' using
+   'nthreads' workers (0 for one per online cpu), a failure does not stop
+   the batch, its errno is left in the 'err' member of the job. With
+   BATCH_CRC the CRC32C of the raw data is left in 'crc'. Returns the
+   number of files that failed or -1 if the batch could not be started */
+long batch_files(struct batch_job *jobs, size_t n, unsigned char mode, int flags,
+                 unsigned int nthreads)
+{
+        struct batch_worker *w;
+        struct batch_deque *dq;
+        char *dq_mem;
+        size_t dq_size;
+        unsigned int started;
+        long failed = 0;
+
+        if ((jobs == NULL && n > 0) || n > UINT32_MAX - 1) {
+                errno = EINVAL;
+                return -1;
+        }
+        if (codec_buf_size(mode, flags & BATCH_DECODE, 0) == 0) {
+                return -1;
+        }
+        if (n == 0) {
+                return 0;
+        }
+        if (nthreads == 0) {
+                long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+                nthreads = cpus > 0 ? (unsigned int)cpus : 1;
+        }
+        if (nthreads > n) {
+                nthreads = (unsigned int)n;
+        }
+
+        /* the deques are aligned by hand, the allocator may not do it */
+        dq_size = (nthreads + 1) * sizeof(*dq);
+        w = lib_alloc(nthreads * sizeof(*w));
+        dq_mem = lib_alloc(dq_size);
+        if (w == NULL || dq_mem == NULL) {
+                lib_free(w, nthreads * sizeof(*w));
+                lib_free(dq_mem, dq_size);
+                errno = ENOMEM;
+                return -1;
+        }
+        memset(w, 0, nthreads * sizeof(*w));
+        dq = (struct batch_deque *)(((uintptr_t)dq_mem + 63) & ~(uintptr_t)63);
+        for (unsigned int i = 0; i < nthreads; i++) {
+                atomic_init(&dq[i].range, RANGE(n * i / nthreads, n * (i + 1) / nthreads));
+                w[i].id = i;
+                w[i].dq = dq;
+                w[i].nworkers = nthreads;
+                w[i].jobs = jobs;
+                w[i].mode = mode;
+                w[i].flags = flags;
+        }
+
+        /* the calling thread is worker 0, if a thread can't be created its
+           jobs are stolen by the others so the batch still completes */
+        for (started = 1; started < nthreads; started++) {
+                if (pthread_create(&w[started].tid, NULL, batch_run, &w[started]) != 0) {
+                        break;
+                }
+        }
+        batch_run(&w[0]);
+        for (unsigned int i = 1; i < started; i++) {
+                pthread_join(w[i].tid, NULL);
+        }
+        for (unsigned int i = 0; i < nthreads; i++) {
+                failed += (long)w[i].failed;
+        }
+        lib_free(w, nthreads * sizeof(*w));
+        lib_free(dq_mem, dq_size);
+        return failed;
+}
+
+/* -------------------------------------------------------------------> async */
+/*  codec jobs run on a pool of threads fed by a bounded queue, submitting
+    blocks when the queue is full (or fails with EAGAIN) so producers can't
+    outrun the pool. Large jobs are cut in pieces that run in parallel,
+    small ones are taken from the queue several at a time. Completion is
+    reported through a callback and/or an eventfd */
+#define ASYNC_ENC_PIECE (15U * 65536)   /* raw bytes, multiple of 3 and 5 */
+#define ASYNC_DEC_PIECE (8U * 131072)   /* encoded characters, multiple of 8 */
+#define ASYNC_GRAB_BYTES (256U * 1024)  /* work taken per visit to the queue */
+#define ASYNC_GRAB_MAX 32
+
+struct async_task {
+        struct codec_job *job;
+        size_t piece;
+};
+
+struct codec_pool {
+        pthread_mutex_t lock;
+        pthread_cond_t not_empty;
+        pthread_cond_t not_full;
+        struct async_task *ring;
+        size_t cap;
+        size_t head;            /* next task to run */
+        size_t count;
+        int stop;
+        unsigned int nthreads;
+        unsigned int tids_cap;
+        pthread_t *tids;
+};
+
+/* bytes of input of the piece 'k' of 'job' */
+static size_t piece_len(const struct codec_job *job, size_t k)
+{
+        size_t off = k * job->piece_size;
+        return job->len - off < job->piece_size ? job->len - off : job->piece_size;
+}
+
+/* output bytes of a piece that is not the last one */
+static size_t piece_out(unsigned char mode, int decode, size_t len)
+{
+        if (!decode) {
+                return codec_buf_size(mode, 0, len) - 1;
+        }
+        switch (mode) {
+                case BASE64:
+                        return len / 4 * 3;
+                case BASE32:
+                        return len / 8 * 5;
+                default:
+                        return len / 2;
+        }
+}
+
+/*  run one piece in place, the codecs write a null after their output
+    which would land on the next piece, so all but the last group of a
+    piece that is not the last one are done in place and that group goes
+    through a small buffer */
+static int piece_run(struct codec_job *job, size_t k, int last)
+{
+        const char *in = job->in + k * job->piece_size;
+        char *out = job->out + k * piece_out(job->mode, job->decode, job->piece_size);
+        size_t len = piece_len(job, k);
+        size_t g, n, tail;
+        char tmp[16];
+
+        if (last) {
+                if (codec_mem(job->mode, job->decode, in, len, out, &n) == -1) {
+                        return -1;
+                }
+                job->last_out = n;
+                return 0;
+        }
+        g = job->decode ? enc_group[job->mode] : raw_group[job->mode];
+        if (job->decode && !block_end_ok(in, len)) {
+                errno = EINVAL;
+                return -1;
+        }
+        if (codec_mem(job->mode, job->decode, in, len - g, out, &n) == -1 ||
+            codec_mem(job->mode, job->decode, in + len - g, g, tmp, &tail) == -1) {
+                return -1;
+        }
+        if (n + tail != piece_out(job->mode, job->decode, len)) {
+                errno = EINVAL;         /* padding before the end */
+                return -1;
+        }
+        memcpy(out + n, tmp, tail);
+        return 0;
+}
+
+static void job_complete(struct codec_job *job)
+{
+        uint64_t one = 1;
+        int efd = job->efd;
+
+        job->err = __atomic_load_n(&job->piece_err, __ATOMIC_ACQUIRE);
+        job->out_len = 0;
+        if (job->err == 0) {
+                job->out_len = (job->npieces - 1) *
+                               piece_out(job->mode, job->decode, job->piece_size) + job->last_out;
+                job->out[job->out_len] = '\0';
+        }
+        /* the job may be released by the callback or by whoever waits on
+           the eventfd, it is not touched after them */
+        if (job->done != NULL) {
+                job->done(job);
+        }
+        if (efd >= 0) {
+                while (write(efd, &one, sizeof(one)) == -1 && errno == EINTR);
+        }
+}
+
+static void task_run(struct async_task *t)
+{
+        struct codec_job *job = t->job;
+        int last = t->piece == job->npieces - 1;
+
+        errno = 0;
+        if (piece_run(job, t->piece, last) == -1) {
+                int zero = 0;
+                __atomic_compare_exchange_n(&job->piece_err, &zero, errno != 0 ? errno : EIO, 0,
+                                            __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+        }
+        if (__atomic_sub_fetch(&job->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+                job_complete(job);
+        }
+}
+
+static void *pool_run(void *arg)
+{
+        struct codec_pool *p = arg;
+        struct async_task grab[ASYNC_GRAB_MAX];
+
+        for (;;) {
+                size_t n = 0, bytes = 0;
+
+                pthread_mutex_lock(&p->lock);
+                while (p->count == 0 && !p->stop) {
+                        pthread_cond_wait(&p->not_empty, &p->lock);
+                }
+                if (p->count == 0) {
+                        pthread_mutex_unlock(&p->lock);
+                        return NULL;
+                }
+                while (p->count > 0 && n < ASYNC_GRAB_MAX && bytes < ASYNC_GRAB_BYTES) {
+                        grab[n] = p->ring[p->head];
+                        bytes += piece_len(grab[n].job, grab[n].piece);
+                        p->head = (p->head + 1) % p->cap;
+                        p->count--;
+                        n++;
+                }
+                pthread_cond_broadcast(&p->not_full);
+                if (p->count > 0) {
+                        pthread_cond_signal(&p->not_empty);
+                }
+                pthread_mutex_unlock(&p->lock);
+
+                for (size_t i = 0; i < n; i++) {
+                        task_run(&grab[i]);
+                }
+        }
+}
+
+/* create a pool of 'nthreads' threads (0 for one per online cpu) with room
+   for 'queue_cap' queued pieces (0 for 1024) */
+struct codec_pool *codec_pool_create(unsigned int nthreads, size_t queue_cap)
+{
+        struct codec_pool *p;
+
+        if (nthreads == 0) {
+                long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+                nthreads = cpus > 0 ? (unsigned int)cpus : 1;
+        }
+        if (queue_cap == 0) {
+                queue_cap = 1024;
+        }
+        if ((p = lib_alloc(sizeof(*p))) == NULL) {
+                return NULL;
+        }
+        memset(p, 0, sizeof(*p));
+        p->cap = queue_cap;
+        p->tids_cap = nthreads;
+        p->ring = lib_alloc(queue_cap * sizeof(*p->ring));
+        p->tids = lib_alloc(nthreads * sizeof(*p->tids));
+        if (p->ring == NULL || p->tids == NULL) {
+                goto fail;
+        }
+        pthread_mutex_init(&p->lock, NULL);
+        pthread_cond_init(&p->not_empty, NULL);
+        pthread_cond_init(&p->not_full, NULL);
+        for (; p->nthreads < nthreads; p->nthreads++) {
+                if (pthread_create(&p->tids[p->nthreads], NULL, pool_run, p) != 0) {
+                        break;
+                }
+        }
+        if (p->nthreads == 0) {
+                pthread_mutex_destroy(&p->lock);
+                pthread_cond_destroy(&p->not_empty);
+                pthread_cond_destroy(&p->not_full);
+                errno = EAGAIN;
+                goto fail;
+        }
+        return p;
+
+fail:
+        lib_free(p->ring, queue_cap * sizeof(*p->ring));
+        lib_free(p->tids, nthreads * sizeof(*p->tids));
+        lib_free(p, sizeof(*p));
+        return NULL;
+}
+
+/* finish every queued job, then stop the threads and free the pool */
+void codec_pool_destroy(struct codec_pool *p)
+{
+        if (p == NULL) {
+                return;
+        }
+        pthread_mutex_lock(&p->lock);
+        p->stop = 1;
+        pthread_cond_broadcast(&p->not_empty);
+        pthread_mutex_unlock(&p->lock);
+        for (unsigned int i = 0; i < p->nthreads; i++) {
+                pthread_join(p->tids[i], NULL);
+        }
+        pthread_mutex_destroy(&p->lock);
+        pthread_cond_destroy(&p->not_empty);
+        pthread_cond_destroy(&p->not_full);
+        lib_free(p->ring, p->cap * sizeof(*p->ring));
+        lib_free(p->tids, p->tids_cap * sizeof(*p->tids));
+        lib_free(p, sizeof(*p));
+}
+
+/* check a job and cut it in pieces, returns the number of pieces */
+static size_t job_prepare(struct codec_job *job)
+{
+        if (job == NULL || job->out == NULL || (job->in == NULL && job->len > 0) ||
+            job->mode < BASE64 || job->mode > BASE16) {
+                errno = EINVAL;
+                return 0;
+        }
+        if (job->decode && job->mode != BASE16) {
+                while (job->len > 0 && (job->in[job->len - 1] == '\r' ||
+                                        job->in[job->len - 1] == '\n')) {
+                        job->len--;
+                }
+        }
+        job->piece_size = job->decode ? ASYNC_DEC_PIECE : ASYNC_ENC_PIECE;
+        job->npieces = job->len == 0 ? 1 : (job->len + job->piece_size - 1) / job->piece_size;
+        job->pending = (unsigned int)job->npieces;
+        job->piece_err = 0;
+        job->last_out = 0;
+        job->err = 0;
+        job->out_len = 0;
+        return job->npieces;
+}
+
+/* queue 'n' jobs taking the lock once, see codec_pool_submit */
+int codec_pool_submit_many(struct codec_pool *p, struct codec_job **jobs, size_t n, int flags)
+{
+        size_t total = 0;
+
+        if (p == NULL || (jobs == NULL && n > 0)) {
+                errno = EINVAL;
+                return -1;
+        }
+        for (size_t i = 0; i < n; i++) {
+                size_t k = job_prepare(jobs[i]);
+                if (k == 0) {
+                        return -1;
+                }
+                total += k;
+        }
+
+        /* would never fit, retrying on EAGAIN would spin forever */
+        if ((flags & CODEC_NOWAIT) && total > p->cap) {
+                errno = EMSGSIZE;
+                return -1;
+        }
+        pthread_mutex_lock(&p->lock);
+        if ((flags & CODEC_NOWAIT) && p->cap - p->count < total) {
+                pthread_mutex_unlock(&p->lock);
+                errno = EAGAIN;
+                return -1;
+        }
+        for (size_t i = 0; i < n; i++) {
+                for (size_t k = 0; k < jobs[i]->npieces; k++) {
+                        while (p->count == p->cap) {
+                                /* let the workers drain what is queued so far */
+                                pthread_cond_broadcast(&p->not_empty);
+                                pthread_cond_wait(&p->not_full, &p->lock);
+                        }
+                        p->ring[(p->head + p->count) % p->cap].job = jobs[i];
+                        p->ring[(p->head + p->count) % p->cap].piece = k;
+                        p->count++;
+                }
+        }
+        if (total > 1) {
+                pthread_cond_broadcast(&p->not_empty);
+        } else {
+                pthread_cond_signal(&p->not_empty);
+        }
+        pthread_mutex_unlock(&p->lock);
+        return 0;
+}
+
+/* queue an encode or decode job, its fields 'mode' .. 'efd' must be set.
+   Blocks while the queue is full unless CODEC_NOWAIT is in 'flags', then
+   it fails with EAGAIN, or with EMSGSIZE for jobs cut in more pieces
+   than the queue holds, which can only be submitted blocking. On
+   completion 'out_len' and 'err' are set, 'out' is null terminated,
+   'done' is called from a pool thread and 1 is written to 'efd' */
+int codec_pool_submit(struct codec_pool *p, struct codec_job *job, int flags)
+{
+        return codec_pool_submit_many(p, &job, 1, flags);
+}
+
+/* -------------------------------------------------------------------> pipeline */
+/*  streams are processed by a reader thread, 'nworkers' codec threads and
+    a writer (the caller) connected by lock-free rings of preallocated
+    blocks, so reading, encoding and writing overlap. Block k goes to the
+    ring of worker k % nworkers, each ring has one producer and one
+    consumer per stage (reader fills, worker codes, writer drains) and the
+    writer visits the rings in turn, so the output keeps the input order.
+    In record mode the blocks end at a delimiter and every record in them
+    is coded on its own */
+#define PIPE_ENC_BLOCK (15U * 16384)    /* raw bytes, multiple of 3 and 5 */
+#define PIPE_DEC_BLOCK (8U * 32768)     /* encoded characters, multiple of 8 */
+#define PIPE_REC_BLOCK (1U << 20)       /* bytes, the longest record */
+#define PIPE_SLOTS 4                    /* blocks per ring */
+
+struct pipe_block {
+        char *in;
+        char *out;
+        size_t len;
+        size_t out_len;
+        int last;
+        int err;
+};
+
+struct pipe_ring {
+        /* the cursors have one writer each, a cache line apart */
+        _Atomic uint64_t filled;
+        char pad0[64 - sizeof(uint64_t)];
+        _Atomic uint64_t coded;
+        char pad1[64 - sizeof(uint64_t)];
+        _Atomic uint64_t drained;
+        char pad2[64 - sizeof(uint64_t)];
+        struct pipe_block slot[PIPE_SLOTS];
+};
+
+struct pipeline {
+        unsigned char mode;
+        int decode;
+        int ifd;
+        int delim;              /* record delimiter, -1 for a plain stream */
+        unsigned int nrings;
+        size_t block;
+        char *carry;            /* partial record moved to the next block */
+        struct pipe_ring *rings;
+        _Atomic int abort;
+        _Atomic int eof;        /* every block has been filled */
+};
+
+struct pipe_worker {
+        struct pipeline *p;
+        unsigned int id;
+};
+
+/* wait until '*c' reaches 'v', spinning first and then backing off so
+   idle stages don't take the cpu from the busy one, 0 when aborted or,
+   with 'upto_eof', when the reader is done and '*c' won't get there */
+static int pipe_wait(struct pipeline *p, _Atomic uint64_t *c, uint64_t v, int upto_eof)
+{
+        for (unsigned int spins = 0; atomic_load_explicit(c, memory_order_acquire) < v; spins++) {
+                if (atomic_load_explicit(&p->abort, memory_order_relaxed)) {
+                        return 0;
+                }
+                if (upto_eof && atomic_load_explicit(&p->eof, memory_order_acquire)) {
+                        return atomic_load_explicit(c, memory_order_acquire) >= v;
+                }
+                if (spins < 128) {
+#ifdef __SSE2__
+                        _mm_pause();
+#endif
+                } else if (spins < 256) {
+                        sched_yield();
+                } else {
+                        struct timespec ts = {0, 20000};
+                        nanosleep(&ts, NULL);
+                }
+        }
+        return 1;
+}
+
+/* fill 'b' from offset 'off', returns the bytes read, less than asked
+   only at the end of the input */
+static ssize_t read_full(int fd, char *b, size_t off, size_t cap)
+{
+        while (off < cap) {
+                ssize_t rd = read(fd, b + off, cap - off);
+                if (rd < 0) {
+                        if (errno == EINTR) {
+                                continue;
+                        }
+                        return -1;
+                }
+                if (rd == 0) {
+                        break;
+                }
+                off += (size_t)rd;
+        }
+        return (ssize_t)off;
+}
+
+/*  the decoders only take line breaks and padding at the end of their
+    input, a block that ends with them is cut before the trailing line
+    breaks and the group holding the padding, and the rest moves to the
+    next block. Returns the bytes to move, a longer run than the carry
+    buffer holds stays and is rejected as it would be mid-stream */
+static size_t pipe_carry(const struct pipeline *p, const char *b, size_t len)
+{
+        size_t g = enc_group[p->mode], n = len;
+
+        while (n > 0 && (b[n - 1] == '\r' || b[n - 1] == '\n')) {
+                n--;
+        }
+        n -= n % g;
+        if (n > 0 && b[n - 1] == PAD) {
+                n -= g;
+        }
+        return len - n;
+}
+
+static void *pipe_reader(void *arg)
+{
+        struct pipeline *p = arg;
+        char small[64], *carry = p->carry != NULL ? p->carry : small;
+        size_t nc = 0;
+
+        for (uint64_t k = 0;; k++) {
+                struct pipe_ring *r = &p->rings[k % p->nrings];
+                uint64_t local = k / p->nrings;
+                struct pipe_block *b = &r->slot[local % PIPE_SLOTS];
+                ssize_t n;
+
+                if (!pipe_wait(p, &r->drained, local + 1 > PIPE_SLOTS ? local + 1 - PIPE_SLOTS : 0, 0)) {
+                        break;
+                }
+                memcpy(b->in, carry, nc);
+                n = read_full(p->ifd, b->in, nc, p->block);
+                b->err = n == -1 ? errno : 0;
+                b->len = n == -1 ? 0 : (size_t)n;
+                b->last = n == -1 || (size_t)n < p->block;
+                nc = 0;
+                if (p->delim >= 0 && !b->last) {
+                        /* the partial record at the end goes to the next block */
+                        const char *d = memrchr(b->in, p->delim, b->len);
+                        if (d == NULL) {
+                                b->err = EMSGSIZE;
+                                b->last = 1;
+                        } else {
+                                nc = b->len - (size_t)(d + 1 - b->in);
+                        }
+                } else if (p->decode && !b->last && p->mode != BASE16) {
+                        size_t m = pipe_carry(p, b->in, b->len);
+                        if (m <= sizeof(small)) {
+                                nc = m;
+                        }
+                }
+                if (nc > 0) {
+                        b->len -= nc;
+                        memcpy(carry, b->in + b->len, nc);
+                }
+                atomic_store_explicit(&r->filled, local + 1, memory_order_release);
+                if (b->last) {
+                        break;
+                }
+        }
+        atomic_store_explicit(&p->eof, 1, memory_order_release);
+        return NULL;
+}
+
+/* code each record of 'b' separately, the delimiters are kept. The
+   records are found with memchr, which the C library vectorizes */
+static int pipe_records(const struct pipeline *p, struct pipe_block *b)
+{
+        const char *s = b->in, *end = b->in + b->len;
+        size_t w = 0, n;
+
+        while (s < end) {
+                const char *d = memchr(s, p->delim, (size_t)(end - s));
+                size_t len = (size_t)((d != NULL ? d : end) - s);
+
+                if (p->decode && p->delim == '\n' && len > 0 && s[len - 1] == '\r') {
+                        len--;
+                }
+                if (codec_mem(p->mode, p->decode, s, len, b->out + w, &n) == -1) {
+                        return -1;
+                }
+                w += n;
+                if (d == NULL) {
+                        break;
+                }
+                b->out[w++] = (char)p->delim;
+                s = d + 1;
+        }
+        b->out_len = w;
+        return 0;
+}
+
+static void *pipe_worker(void *arg)
+{
+        struct pipe_worker *w = arg;
+        struct pipeline *p = w->p;
+        struct pipe_ring *r = &p->rings[w->id];
+
+        for (uint64_t local = 0;; local++) {
+                struct pipe_block *b = &r->slot[local % PIPE_SLOTS];
+
+                /* stop once the reader is done and has nothing more here */
+                if (!pipe_wait(p, &r->filled, local + 1, 1)) {
+                        return NULL;
+                }
+                b->out_len = 0;
+                if (b->err == 0 && p->delim >= 0) {
+                        if (pipe_records(p, b) == -1) {
+                                b->err = errno;
+                        }
+                } else if (b->err == 0) {
+                        if (p->decode && !b->last && !block_end_ok(b->in, b->len)) {
+                                b->err = EINVAL;
+                        } else if (codec_mem(p->mode, p->decode, b->in, b->len, b->out,
+                                             &b->out_len) == -1) {
+                                b->err = errno;
+                        }
+                }
+                atomic_store_explicit(&r->coded, local + 1, memory_order_release);
+        }
+}
+
+static int pipe_run(int ifd, int ofd, unsigned char mode, int decode, int delim,
+                    unsigned int nworkers)
+{
+        struct pipeline p;
+        struct pipe_worker *w;
+        pthread_t reader, *tids;
+        unsigned int started = 0;
+        size_t out_cap, rings_size;
+        void *rings_mem;
+        int err = 0;
+
+        if (nworkers == 0) {
+                /* the reader and the writer keep a core each */
+                long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+                nworkers = cpus > 2 ? (unsigned int)cpus - 2 : 1;
+        }
+        memset(&p, 0, sizeof(p));
+        p.mode = mode;
+        p.decode = decode;
+        advise_input(ifd, 0);
+        p.ifd = ifd;
+        p.delim = delim;
+        p.nrings = nworkers;
+        if (delim >= 0) {
+                /* records of a single byte have the largest encoded size */
+                p.block = PIPE_REC_BLOCK;
+                out_cap = decode ? codec_buf_size(mode, 1, p.block) :
+                          codec_buf_size(mode, 0, p.block) +
+                          (p.block / 2 + 1) * codec_buf_size(mode, 0, 1);
+        } else {
+                p.block = decode ? PIPE_DEC_BLOCK : PIPE_ENC_BLOCK;
+                out_cap = codec_buf_size(mode, decode, p.block);
+        }
+
+        /* the rings are aligned by hand, the allocator may not do it */
+        rings_size = (nworkers + 1) * sizeof(*p.rings);
+        rings_mem = lib_alloc(rings_size);
+        w = lib_alloc(nworkers * sizeof(*w));
+        tids = lib_alloc(nworkers * sizeof(*tids));
+        if (rings_mem == NULL || w == NULL || tids == NULL ||
+            (delim >= 0 && (p.carry = lib_alloc(p.block)) == NULL)) {
+                err = ENOMEM;
+                goto done;
+        }
+        memset(rings_mem, 0, rings_size);
+        p.rings = (struct pipe_ring *)(((uintptr_t)rings_mem + 63) & ~(uintptr_t)63);
+        for (unsigned int i = 0; i < nworkers; i++) {
+                for (int s = 0; s < PIPE_SLOTS; s++) {
+                        struct pipe_block *b = &p.rings[i].slot[s];
+                        if ((b->in = lib_alloc(p.block)) == NULL ||
+                            (b->out = lib_alloc(out_cap)) == NULL) {
+                                err = ENOMEM;
+                                goto done;
+                        }
+                }
+        }
+
+        for (; started < nworkers; started++) {
+                w[started].p = &p;
+                w[started].id = started;
+                if (pthread_create(&tids[started], NULL, pipe_worker, &w[started]) != 0) {
+                        err = EAGAIN;
+                        atomic_store(&p.abort, 1);
+                        goto join;
+                }
+        }
+        if (pthread_create(&reader, NULL, pipe_reader, &p) != 0) {
+                err = EAGAIN;
+                atomic_store(&p.abort, 1);
+                goto join;
+        }
+
+        for (uint64_t k = 0;; k++) {
+                struct pipe_ring *r = &p.rings[k % nworkers];
+                uint64_t local = k / nworkers;
+                struct pipe_block *b = &r->slot[local % PIPE_SLOTS];
+                int last;
+
+                if (!pipe_wait(&p, &r->coded, local + 1, 0)) {
+                        break;
+                }
+                if (b->err != 0) {
+                        err = b->err;
+                } else if (write_all(ofd, b->out, b->out_len) == -1) {
+                        err = errno;
+                }
+                last = b->last;
+                atomic_store_explicit(&r->drained, local + 1, memory_order_release);
+                if (err != 0) {
+                        atomic_store(&p.abort, 1);
+                        break;
+                }
+                if (last) {
+                        break;
+                }
+        }
+        pthread_join(reader, NULL);
+
+join:
+        for (unsigned int i = 0; i < started; i++) {
+                pthread_join(tids[i], NULL);
+        }
+done:
+        if (p.rings != NULL) {
+                for (unsigned int i = 0; i < nworkers; i++) {
+                        for (int s = 0; s < PIPE_SLOTS; s++) {
+                                lib_free(p.rings[i].slot[s].in, p.block);
+                                lib_free(p.rings[i].slot[s].out, out_cap);
+                        }
+                }
+        }
+        lib_free(rings_mem, rings_size);
+        lib_free(w, nworkers * sizeof(*w));
+        lib_free(tids, nworkers * sizeof(*tids));
+        lib_free(p.carry, p.block);
+        if (err != 0) {
+                errno = err;
+                return -1;
+        }
+        return 0;
+}
+
+/* encode or decode everything read from 'ifd' into 'ofd' with a reader,
+   'nworkers' codec threads (0 for two fewer than the online cpus, the
+   reader and the writer get a core each, at least one) and the calling
+   thread writing the output, the input need not fit in memory */
+int codec_pipe(int ifd, int ofd, unsigned char mode, int decode, unsigned int nworkers)
+{
+        if (!GROUP_MODE(mode) || ifd < 0 || ofd < 0) {
+                errno = EINVAL;
+                return -1;
+        }
+        return pipe_run(ifd, ofd, mode, decode, -1, nworkers);
+}
+
+/* codec_pipe for a stream of records ended by 'delim' (a byte value),
+   every record is encoded or decoded on its own and written followed by
+   the delimiter, in the input order. On decoding a CR before a '\n'
+   delimiter is dropped. A record longer than 1 MiB fails with EMSGSIZE */
+int codec_records(int ifd, int ofd, unsigned char mode, int decode, int delim,
+                  unsigned int nworkers)
+{
+        if (codec_buf_size(mode, decode, 0) == 0 || delim < 0 || delim > 255 ||
+            ifd < 0 || ofd < 0) {
+                errno = EINVAL;
+                return -1;
+        }
+        return pipe_run(ifd, ofd, mode, decode, delim, nworkers);
+}
+
+/* -------------------------------------------------------------------> tuning */
+/*  the fastest way to run a call depends on its size and on the machine,
+    so instead of fixed thresholds the variants are measured once per cpu
+    model: one thread with the output through the caches, one thread with
+    streaming stores and the input split over 2, 4 .. threads. The winner
+    for each power of two size and the size from which streaming wins are
+    kept in a cache file, one line per cpu model, and codec_mem_auto
+    dispatches on them. Only codec_tune measures, without a cache line
+    codec_mem_auto is codec_mem */
+#define TUNE_MIN_LOG 12                 /* 4 KiB, smaller calls run on one thread */
+#define TUNE_MAX_LOG 22                 /* 4 MiB, larger calls use this bucket */
+#define TUNE_BUCKETS (TUNE_MAX_LOG - TUNE_MIN_LOG + 1)
+#define TUNE_MAX_THREADS 16
+
+struct tune_table {
+        char key[160];                  /* cpu model and count */
+        size_t nt_threshold;
+        unsigned char threads[2][TUNE_BUCKETS]; /* [decode][log2 size] */
+};
+
+/* written by codec_tune while other threads may be dispatching on it */
+static struct tune_table tuned;
+static pthread_rwlock_t tune_lock = PTHREAD_RWLOCK_INITIALIZER;
+static pthread_once_t tune_once = PTHREAD_ONCE_INIT;
+
+static double tune_now(void)
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void tune_key(char *key, size_t size)
+{
+        char line[256], model[128] = "unknown";
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        FILE *fp = fopen("/proc/cpuinfo", "r");
+
+        while (fp != NULL && fgets(line, sizeof(line), fp) != NULL) {
+                char *v = strchr(line, ':');
+                if (v != NULL && strncmp(line, "model name", 10) == 0) {
+                        v += strspn(v + 1, " ") + 1;
+                        v[strcspn(v, "\t\n")] = '\0';
+                        snprintf(model, sizeof(model), "%s", v);
+                        break;
+                }
+        }
+        if (fp != NULL) {
+                fclose(fp);
+        }
+        snprintf(key, size, "%s/%ld", model, cpus > 0 ? cpus : 1);
+}
+
+/* the value of the environment variable 'name', NULL if unset or empty */
+static const char *tune_env(const char *name)
+{
+        const char *p = getenv(name);
+        return p != NULL && *p != '\0' ? p : NULL;
+}
+
+/* the cache file, B64_TUNE_CACHE or $XDG_CACHE_HOME or ~/.cache. Fails
+   with ENOENT without any of them and ENAMETOOLONG when it does not fit
+   'size' */
+static int tune_path(char *path, size_t size)
+{
+        const char *p;
+        int n;
+
+        if ((p = tune_env("B64_TUNE_CACHE")) != NULL) {
+                n = snprintf(path, size, "%s", p);
+        } else if ((p = tune_env("XDG_CACHE_HOME")) != NULL) {
+                n = snprintf(path, size, "%s/base64.tune", p);
+        } else if ((p = tune_env("HOME")) != NULL) {
+                n = snprintf(path, size, "%s/.cache/base64.tune", p);
+        } else {
+                errno = ENOENT;
+                return -1;
+        }
+        if (n < 0 || (size_t)n >= size) {
+                errno = ENAMETOOLONG;
+                return -1;
+        }
+        return 0;
+}
+
+/* codec_mem with the input split over 'nthreads' threads, the caller
+   runs the first piece */
+static void *mt_run(void *arg)
+{
+        task_run(arg);
+        return NULL;
+}
+
+static int codec_mem_mt(unsigned char mode, int decode, const char *in, size_t len,
+                        char *out, size_t *out_len, unsigned int nthreads)
+{
+        struct codec_job job;
+        struct async_task tasks[TUNE_MAX_THREADS];
+        pthread_t tids[TUNE_MAX_THREADS];
+        size_t unit = decode ? 8 : 15, started = 1;
+
+        memset(&job, 0, sizeof(job));
+        job.mode = mode;
+        job.decode = decode;
+        job.in = in;
+        job.len = len;
+        job.out = out;
+        job.efd = -1;
+        if (job_prepare(&job) == 0) {
+                return -1;
+        }
+        if (nthreads > TUNE_MAX_THREADS) {
+                nthreads = TUNE_MAX_THREADS;
+        }
+        job.piece_size = ((job.len + nthreads - 1) / nthreads + unit - 1) / unit * unit;
+        if (job.piece_size == 0) {
+                job.piece_size = unit;
+        }
+        job.npieces = job.len == 0 ? 1 : (job.len + job.piece_size - 1) / job.piece_size;
+        job.pending = (unsigned int)job.npieces;
+
+        for (size_t k = 0; k < job.npieces; k++) {
+                tasks[k].job = &job;
+                tasks[k].piece = k;
+        }
+        for (; started < job.npieces; started++) {
+                if (pthread_create(&tids[started], NULL, mt_run, &tasks[started]) != 0) {
+                        break;
+                }
+        }
+        for (size_t k = started; k < job.npieces; k++) {
+                task_run(&tasks[k]);
+        }
+        task_run(&tasks[0]);
+        for (size_t k = 1; k < started; k++) {
+                pthread_join(tids[k], NULL);
+        }
+        if (job.err != 0) {
+                errno = job.err;
+                return -1;
+        }
+        *out_len = job.out_len;
+        return 0;
+}
+
+/* best of 'reps' runs of a variant, 'nt' streaming, 'nthreads' split */
+static double tune_time(int decode, const char *in, size_t len, char *out, int nt,
+                        unsigned int nthreads, int reps)
+{
+        double best = 1e30;
+        size_t n;
+
+        for (int r = 0; r < reps; r++) {
+                double t0 = tune_now();
+                if (nthreads > 1) {
+                        codec_mem_mt(BASE64, decode, in, len, out, &n, nthreads);
+                } else {
+                        codec_mem_run(BASE64, decode, in, len, out, &n, nt ? 1 : 0);
+                }
+                t0 = tune_now() - t0;
+                best = t0 < best ? t0 : best;
+        }
+        return best;
+}
+
+static int tune_measure(struct tune_table *t)
+{
+        const size_t max = (size_t)1 << TUNE_MAX_LOG;
+        const size_t enc_max = codec_buf_size(BASE64, 0, max);
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        unsigned int maxt = cpus > 1 ? (unsigned int)cpus : 1;
+        char *raw, *enc, *out;
+        size_t nt_from = 0;
+
+        raw = lib_alloc(max);
+        enc = lib_alloc(enc_max);
+        out = lib_alloc(enc_max);
+        if (raw == NULL || enc == NULL || out == NULL) {
+                lib_free(raw, max);
+                lib_free(enc, enc_max);
+                lib_free(out, enc_max);
+                return -1;
+        }
+        for (size_t i = 0; i < max; i++) {
+                raw[i] = (char)(i * 131 + (i >> 9));
+        }
+        maxt = maxt < TUNE_MAX_THREADS ? maxt : TUNE_MAX_THREADS;
+
+        for (int b = 0; b < TUNE_BUCKETS; b++) {
+                size_t len = (size_t)1 << (TUNE_MIN_LOG + b);
+                int reps = len < ((size_t)1 << 20) ? 5 : 2;
+
+                for (int d = 0; d < 2; d++) {
+                        const char *in = d ? enc : raw;
+                        size_t n = len;
+                        double best, bt;
+
+                        if (d) {
+                                codec_mem_run(BASE64, 0, raw, len, enc, &n, 0);
+                        }
+                        best = tune_time(d, in, n, out, 0, 1, reps);
+                        t->threads[d][b] = 1;
+                        for (unsigned int k = 2; k <= maxt; k *= 2) {
+                                if ((bt = tune_time(d, in, n, out, 0, k, reps)) < best) {
+                                        best = bt;
+                                        t->threads[d][b] = (unsigned char)k;
+                                }
+                        }
+                        /* streaming has to keep winning up to the largest size */
+                        if (!d) {
+                                if (tune_time(0, in, n, out, 1, 1, reps) < tune_time(0, in, n, out, 0, 1, reps)) {
+                                        nt_from = nt_from ? nt_from : len;
+                                } else {
+                                        nt_from = 0;
+                                }
+                        }
+                }
+        }
+        /* without a win at the largest size measured, the cache effects
+           that make streaming pay off are beyond it */
+        t->nt_threshold = nt_from ? nt_from : NT_THRESHOLD;
+
+        lib_free(raw, max);
+        lib_free(enc, enc_max);
+        lib_free(out, enc_max);
+        return 0;
+}
+
+static int tune_load(const char *path, struct tune_table *t)
+{
+        char line[512];
+        size_t klen = strlen(t->key);
+        FILE *fp = fopen(path, "r");
+        int found = -1;
+
+        while (fp != NULL && found == -1 && fgets(line, sizeof(line), fp) != NULL) {
+                char *p = line + klen + 1;
+
+                if (strncmp(line, t->key, klen) != 0 || line[klen] != '\t') {
+                        continue;
+                }
+                t->nt_threshold = (size_t)strtoull(p, &p, 10);
+                found = 0;
+                for (int d = 0; d < 2; d++) {
+                        for (int b = 0; b < TUNE_BUCKETS; b++) {
+                                unsigned long v = strtoul(p, &p, 10);
+                                if (v == 0 || v > TUNE_MAX_THREADS) {
+                                        found = -1;
+                                }
+                                t->threads[d][b] = (unsigned char)v;
+                        }
+                }
+        }
+        if (fp != NULL) {
+                fclose(fp);
+        }
+        return found;
+}
+
+/* create the directories leading to the file 'path', as mkdir -p */
+static int tune_mkdirs(const char *path)
+{
+        char dir[4096];
+
+        if (snprintf(dir, sizeof(dir), "%s", path) >= (int)sizeof(dir)) {
+                errno = ENAMETOOLONG;
+                return -1;
+        }
+        for (char *p = strchr(dir + 1, '/'); p != NULL; p = strchr(p + 1, '/')) {
+                *p = '\0';
+                if (mkdir(dir, S_IRWXU) == -1 && errno != EEXIST) {
+                        return -1;
+                }
+                *p = '/';
+        }
+        return 0;
+}
+
+/* replace the line of this cpu in the cache file, keeping the others */
+static int tune_save(const char *path, const struct tune_table *t)
+{
+        char tmp[4096 + 8], line[512];
+        size_t klen = strlen(t->key);
+        FILE *in, *out;
+
+        if (tune_mkdirs(path) == -1) {
+                return -1;
+        }
+        if (snprintf(tmp, sizeof(tmp), "%s.%ld", path, (long)getpid()) >= (int)sizeof(tmp)) {
+                errno = ENAMETOOLONG;
+                return -1;
+        }
+        if ((out = fopen(tmp, "w")) == NULL) {
+                return -1;
+        }
+        if ((in = fopen(path, "r")) != NULL) {
+                while (fgets(line, sizeof(line), in) != NULL) {
+                        if (strncmp(line, t->key, klen) != 0 || line[klen] != '\t') {
+                                fputs(line, out);
+                        }
+                }
+                fclose(in);
+        }
+        fprintf(out, "%s\t%zu", t->key, t->nt_threshold);
+        for (int d = 0; d < 2; d++) {
+                for (int b = 0; b < TUNE_BUCKETS; b++) {
+                        fprintf(out, " %u", t->threads[d][b]);
+                }
+        }
+        fputc('\n', out);
+        if (fclose(out) == EOF || rename(tmp, path) == -1) {
+                unlink(tmp);
+                return -1;
+        }
+        return 0;
+}
+
+static void tune_init(void);
+
+/* measure the variants now and save the results to 'path' (NULL for the
+   default cache file), they are used by codec_mem_auto from then on,
+   also by calls already running in other threads */
+int codec_tune(const char *path)
+{
+        struct tune_table t;
+        char def[4096];
+
+        memset(&t, 0, sizeof(t));
+        tune_key(t.key, sizeof(t.key));
+        if (tune_measure(&t) == -1) {
+                return -1;
+        }
+        /* so that a later first use does not load over the results */
+        pthread_once(&tune_once, tune_init);
+        pthread_rwlock_wrlock(&tune_lock);
+        tuned = t;
+        pthread_rwlock_unlock(&tune_lock);
+        if (path == NULL) {
+                if (tune_path(def, sizeof(def)) == 0) {
+                        path = def;
+                } else if (errno == ENAMETOOLONG) {
+                        return -1;
+                }
+        }
+        return path != NULL ? tune_save(path, &t) : 0;
+}
+
+/* on first use the results for this cpu come from the cache file, the
+   defaults (one thread, the codec_mem threshold) are used without one */
+static void tune_init(void)
+{
+        char path[4096];
+
+        memset(&tuned, 0, sizeof(tuned));
+        tune_key(tuned.key, sizeof(tuned.key));
+        if (tune_path(path, sizeof(path)) == 0 && tune_load(path, &tuned) == 0) {
+                return;
+        }
+        memset(tuned.threads, 1, sizeof(tuned.threads));
+        tuned.nt_threshold = 0;
+}
+
+/* the thread count for 'len' bytes and the streaming threshold, read
+   together under the lock, 'len' is at least the smallest bucket */
+static unsigned int tune_lookup(int decode, size_t len, size_t *nt)
+{
+        unsigned int t;
+        int b = 0;
+
+        pthread_once(&tune_once, tune_init);
+        while (b < TUNE_BUCKETS - 1 && (len >> (TUNE_MIN_LOG + b + 1)) != 0) {
+                b++;
+        }
+        pthread_rwlock_rdlock(&tune_lock);
+        t = tuned.threads[decode ? 1 : 0][b];
+        *nt = tuned.nt_threshold;
+        pthread_rwlock_unlock(&tune_lock);
+        return t;
+}
+
+/* the thread count codec_mem_auto uses for 'len' bytes */
+unsigned int codec_tune_threads(int decode, size_t len)
+{
+        size_t nt;
+
+        if (len < ((size_t)1 << TUNE_MIN_LOG)) {
+                return 1;
+        }
+        return tune_lookup(decode, len, &nt);
+}
+
+/* codec_mem taking the path measured fastest on this machine for 'len' */
+int codec_mem_auto(unsigned char mode, int decode, const char *in, size_t len,
+                   char *out, size_t *out_len)
+{
+        unsigned int t;
+        size_t nt;
+
+        if (len < ((size_t)1 << TUNE_MIN_LOG)) {
+                return codec_mem(mode, decode, in, len, out, out_len);
+        }
+        t = tune_lookup(decode, len, &nt);
+        if (t > 1 && GROUP_MODE(mode)) {
+                return codec_mem_mt(mode, decode, in, len, out, out_len, t);
+        }
+        /* the streaming threshold measured here, unless it was disabled */
+        if (nt != 0 && atomic_load_explicit(&nt_threshold, memory_order_relaxed) != 0) {
+                return codec_mem_run(mode, decode, in, len, out, out_len, nt);
+        }
+        return codec_mem(mode, decode, in, len, out, out_len);
+}
+
+/* -------------------------------------------------------------------> cache */
+/*  opt-in on-disk cache of file results. Objects are stored under
+    'dir/obj' named by the size and a hash of the input, and 'dir/meta'
+    holds symlinks to them named by (dev, ino, size, mtime) of the
+    sources, so an unchanged file is found with a readlink and never read.
+    A renamed or touched but identical file is found by its content. Hits
+    are copied to the destination (hardlinked with CACHE_LINK). Objects
+    are read-only, their mtime is their last use and the least recently
+    used go first when the cache grows past its cap */
+#define CACHE_DEF_MAX (256ULL << 20)
+
+struct codec_cache {
+        char *dir;
+        uint64_t max;
+        int flags;
+        struct codec_arena a;
+};
+
+struct cache_ent {
+        char name[128];
+        uint64_t size;
+        struct timespec used;
+};
+
+/* open or create the cache in 'dir' holding up to 'max' bytes (0 for 256
+   MiB), with CACHE_LINK hits are hardlinked instead of copied, and the
+   destination then is the read-only object itself */
+struct codec_cache *codec_cache_open(const char *dir, uint64_t max, int flags)
+{
+        struct codec_cache *c;
+        char path[PATH_MAX];
+        size_t len;
+
+        if (dir == NULL || (len = strlen(dir)) + 8 >= sizeof(path)) {
+                errno = EINVAL;
+                return NULL;
+        }
+        mkdir(dir, S_IRWXU);
+        snprintf(path, sizeof(path), "%s/obj", dir);
+        if (mkdir(path, S_IRWXU) == -1 && errno != EEXIST) {
+                return NULL;
+        }
+        snprintf(path, sizeof(path), "%s/meta", dir);
+        if (mkdir(path, S_IRWXU) == -1 && errno != EEXIST) {
+                return NULL;
+        }
+        if ((c = lib_alloc(sizeof(*c))) == NULL) {
+                return NULL;
+        }
+        if ((c->dir = lib_alloc(len + 1)) == NULL) {
+                lib_free(c, sizeof(*c));
+                return NULL;
+        }
+        memcpy(c->dir, dir, len + 1);
+        c->max = max ? max : CACHE_DEF_MAX;
+        c->flags = flags;
+        c->a.in.p = c->a.out.p = NULL;
+        c->a.in.cap = c->a.out.cap = 0;
+        return c;
+}
+
+void codec_cache_close(struct codec_cache *c)
+{
+        if (c == NULL) {
+                return;
+        }
+        iobuf_release(&c->a.in);
+        iobuf_release(&c->a.out);
+        lib_free(c->dir, strlen(c->dir) + 1);
+        lib_free(c, sizeof(*c));
+}
+
+/* 64 bit hash of the content, paired with its crc32c and size */
+static uint64_t cache_hash(const char *p, size_t len)
+{
+        uint64_t h = 0x9e3779b97f4a7c15ULL ^ len, v;
+        size_t i = 0;
+
+        for (; i + 8 <= len; i += 8) {
+                memcpy(&v, p + i, 8);
+                h = (h ^ v) * 0xff51afd7ed558ccdULL;
+                h ^= h >> 32;
+        }
+        for (; i < len; i++) {
+                h = (h ^ (unsigned char)p[i]) * 0xc4ceb9fe1a85ec53ULL;
+        }
+        h ^= h >> 33;
+        return h * 0xff51afd7ed558ccdULL;
+}
+
+/* copy the object 'obj' to 'dst', with CACHE_LINK hardlink it. A copy
+   is a file of its own, writing to it leaves the cache alone, and with
+   copy_file_range it shares the blocks where the filesystem can */
+static int cache_place(const struct codec_cache *c, const char *obj, const char *dst)
+{
+        struct iobuf none = {NULL, 0};
+        struct stat st;
+        off_t off = 0;
+        size_t len;
+        int ifd, ofd, rc = 0, err;
+
+        if ((ifd = open(obj, O_RDONLY)) == -1) {
+                return -1;
+        }
+        if (fstat(ifd, &st) == -1 || (unlink(dst) == -1 && errno != ENOENT)) {
+                goto fail_in;
+        }
+        if ((c->flags & CACHE_LINK) && link(obj, dst) == 0) {
+                close(ifd);
+                return 0;
+        }
+        if ((ofd = open(dst, O_CREAT | O_WRONLY | O_TRUNC, S_IRUSR | S_IWUSR)) == -1) {
+                goto fail_in;
+        }
+        while (rc == 0 && off < st.st_size) {
+                ssize_t n = copy_file_range(ifd, &off, ofd, NULL, (size_t)(st.st_size - off), 0);
+
+                if (n > 0) {
+                        continue;
+                }
+                if (n == 0) {
+                        errno = EIO;    /* the object shrank */
+                        rc = -1;
+                } else if (off == 0 && (errno == EXDEV || errno == ENOSYS ||
+                                        errno == EINVAL || errno == EOPNOTSUPP)) {
+                        /* no copy_file_range between these filesystems */
+                        if (load_file(obj, &none, &len) == -1) {
+                                rc = -1;
+                        } else {
+                                rc = write_all(ofd, none.p, len);
+                                iobuf_release(&none);
+                        }
+                        break;
+                } else {
+                        rc = -1;
+                }
+        }
+        err = errno;
+        close(ifd);
+        if (close(ofd) == -1 && rc == 0) {
+                return -1;
+        }
+        errno = err;
+        return rc;
+
+fail_in:
+        err = errno;
+        close(ifd);
+        errno = err;
+        return -1;
+}
+
+/* point the meta entry 'meta' at the object 'name', atomically */
+static void cache_meta(const char *meta, const char *name)
+{
+        char target[160], tmp[PATH_MAX + 16];
+
+        snprintf(target, sizeof(target), "../obj/%s", name);
+        snprintf(tmp, sizeof(tmp), "%s.%ld", meta, (long)getpid());
+        unlink(tmp);
+        if (symlink(target, tmp) == 0 && rename(tmp, meta) == -1) {
+                unlink(tmp);
+        }
+}
+
+static int cache_ent_cmp(const void *x, const void *y)
+{
+        const struct cache_ent *a = x, *b = y;
+
+        if (a->used.tv_sec != b->used.tv_sec) {
+                return a->used.tv_sec < b->used.tv_sec ? -1 : 1;
+        }
+        return a->used.tv_nsec < b->used.tv_nsec ? -1 : a->used.tv_nsec > b->used.tv_nsec;
+}
+
+/* drop the least recently used objects until the cache fits its cap, and
+   the meta entries left pointing at nothing */
+static void cache_evict(const struct codec_cache *c)
+{
+        char path[PATH_MAX];
+        struct cache_ent *ents = NULL;
+        size_t n = 0, cap = 0;
+        uint64_t total = 0;
+        struct dirent *de;
+        DIR *d;
+
+        snprintf(path, sizeof(path), "%s/obj", c->dir);
+        if ((d = opendir(path)) == NULL) {
+                return;
+        }
+        while ((de = readdir(d)) != NULL) {
+                struct stat st;
+
+                if (de->d_name[0] == '.' || strlen(de->d_name) >= sizeof(ents->name) ||
+                    fstatat(dirfd(d), de->d_name, &st, 0) == -1 || !S_ISREG(st.st_mode)) {
+                        continue;
+                }
+                if (n == cap) {
+                        size_t ncap = cap ? cap * 2 : 64;
+                        struct cache_ent *e = lib_alloc(ncap * sizeof(*e));
+                        if (e == NULL) {
+                                break;
+                        }
+                        memcpy(e, ents, n * sizeof(*e));
+                        lib_free(ents, cap * sizeof(*ents));
+                        ents = e;
+                        cap = ncap;
+                }
+                strcpy(ents[n].name, de->d_name);
+                ents[n].size = (uint64_t)st.st_size;
+                ents[n].used = st.st_mtim;
+                total += ents[n].size;
+                n++;
+        }
+        if (total > c->max) {
+                qsort(ents, n, sizeof(*ents), cache_ent_cmp);
+                for (size_t i = 0; i < n && total > c->max; i++) {
+                        if (unlinkat(dirfd(d), ents[i].name, 0) == 0) {
+                                total -= ents[i].size;
+                        }
+                }
+        }
+        closedir(d);
+        lib_free(ents, cap * sizeof(*ents));
+
+        snprintf(path, sizeof(path), "%s/meta", c->dir);
+        if ((d = opendir(path)) == NULL) {
+                return;
+        }
+        while ((de = readdir(d)) != NULL) {
+                struct stat st;
+                if (de->d_name[0] != '.' && fstatat(dirfd(d), de->d_name, &st, 0) == -1 &&
+                    errno == ENOENT) {
+                        unlinkat(dirfd(d), de->d_name, 0);
+                }
+        }
+        closedir(d);
+}
+
+/* encode_wr_file or decode_rd_file going through the cache 'c', results
+   of sources seen before, or with the same content, are not computed
+   again. Not safe to share a cache handle between threads, processes
+   can share the directory */
+int codec_cache_file(struct codec_cache *c, const char *src, const char *dst,
+                     unsigned char mode, int decode)
+{
+        char meta[PATH_MAX], obj[PATH_MAX], tmp[PATH_MAX + 16], name[128], link_to[160];
+        size_t len, out_len;
+        struct stat st;
+        ssize_t n;
+        int ofd, rc;
+
+        if (c == NULL || src == NULL || dst == NULL || codec_buf_size(mode, decode, 0) == 0) {
+                errno = EINVAL;
+                return -1;
+        }
+        if (stat(src, &st) == -1) {
+                return -1;
+        }
+        snprintf(meta, sizeof(meta), "%s/meta/%llx-%llx-%llx-%lld.%09ld-%u%d", c->dir,
+                 (unsigned long long)st.st_dev, (unsigned long long)st.st_ino,
+                 (unsigned long long)st.st_size, (long long)st.st_mtim.tv_sec,
+                 st.st_mtim.tv_nsec, mode, decode ? 1 : 0);
+
+        /* same file as before, unchanged */
+        if ((n = readlink(meta, link_to, sizeof(link_to) - 1)) > 0) {
+                link_to[n] = '\0';
+                snprintf(obj, sizeof(obj), "%s/meta/%s", c->dir, link_to);
+                if (cache_place(c, obj, dst) == 0) {
+                        utimensat(AT_FDCWD, obj, NULL, 0);
+                        return 0;
+                }
+                if (errno != ENOENT) {
+                        return -1;
+                }
+                unlink(meta);   /* the object was evicted */
+        }
+
+        /* same content as before */
+        if (load_file(src, &c->a.in, &len) == -1) {
+                return -1;
+        }
+        snprintf(name, sizeof(name), "%zx-%08x-%016llx-%u%d", len, crc32c(0, c->a.in.p, len),
+                 (unsigned long long)cache_hash(c->a.in.p, len), mode, decode ? 1 : 0);
+        snprintf(obj, sizeof(obj), "%s/obj/%s", c->dir, name);
+        if (cache_place(c, obj, dst) == 0) {
+                utimensat(AT_FDCWD, obj, NULL, 0);
+                cache_meta(meta, name);
+                return 0;
+        }
+        if (errno != ENOENT) {
+                return -1;
+        }
+
+        /* new, compute it and keep it read-only in the cache */
+        if (iobuf_reserve(&c->a.out, codec_buf_size(mode, decode, len)) == -1 ||
+            codec_mem(mode, decode, c->a.in.p, len, c->a.out.p, &out_len) == -1) {
+                return -1;
+        }
+        snprintf(tmp, sizeof(tmp), "%s.%ld", obj, (long)getpid());
+        if ((ofd = open(tmp, O_CREAT | O_WRONLY | O_TRUNC, S_IRUSR)) == -1) {
+                return -1;
+        }
+        rc = write_all(ofd, c->a.out.p, out_len);
+        if (close(ofd) == -1) {
+                rc = -1;
+        }
+        if (rc == -1 || rename(tmp, obj) == -1) {
+                int err = errno;
+                unlink(tmp);
+                errno = err;
+                return -1;
+        }
+        cache_meta(meta, name);
+        if (cache_place(c, obj, dst) == -1) {
+                return -1;
+        }
+        cache_evict(c);
+        return 0;
+}
+
+/* -------------------------------------------------------------------> transcode */
+/*  conversions between two encodings run block by block, each block is
+    decoded into a small scratch buffer that stays in L1 and encoded from
+    there straight into the output, so there is no pass over a binary
+    copy of the whole input. The raw block is a multiple of 3, 4 and 5,
+    the encoded blocks then join without padding in between. Base85 can
+    be a target but not a source, its Ascii85 groups vary in size */
+#define TC_BLOCK 3840           /* raw bytes per block */
+#define TC_BLOCKS 16            /* blocks read at a time by codec_transcode_fd */
+
+/* size of the buffer needed to transcode 'len' characters from 'from'
+   to 'to' (null terminator included), 0 with errno set for an unknown
+   mode or a Base85 'from' */
+size_t transcode_buf_size(unsigned char from, unsigned char to, size_t len)
+{
+        if (!GROUP_MODE(from)) {
+                errno = EINVAL;
+                return 0;
+        }
+        return codec_buf_size(to, 0,
+                              (len + enc_group[from] - 1) / enc_group[from] * raw_group[from]);
+}
+
+/* transcode 'len' characters of 'in', only the end of the input, when
+   'last' is set, may hold line breaks or padding */
+static int transcode_run(unsigned char from, unsigned char to, const char *in, size_t len,
+                         int last, char *out, size_t *out_len)
+{
+        const size_t step = TC_BLOCK / raw_group[from] * enc_group[from];
+        _Alignas(64) char raw[TC_BLOCK + 1];
+        size_t w = 0, n, k;
+
+        if (last && from != BASE16) {
+                while (len > 0 && (in[len - 1] == '\r' || in[len - 1] == '\n')) {
+                        --len;
+                }
+        }
+        for (size_t i = 0; i < len; i += step) {
+                size_t end = len - i < step ? len - i : step;
+
+                if ((!last || i + end < len) && !block_end_ok(in + i, end)) {
+                        errno = EINVAL;
+                        return -1;
+                }
+                if (codec_mem(from, 1, in + i, end, raw, &n) == -1 ||
+                    codec_mem(to, 0, raw, n, out + w, &k) == -1) {
+                        return -1;
+                }
+                w += k;
+        }
+        out[w] = '\0';
+        *out_len = w;
+        return 0;
+}
+
+/* convert 'len' characters of 'in' from the encoding 'from' to the
+   encoding 'to', 'out' must hold transcode_buf_size() bytes, the size
+   of the result is returned in 'out_len'. Returns 0, or -1 with errno
+   set to EINVAL when the input is not valid in 'from' */
+int codec_transcode(unsigned char from, unsigned char to, const char *in, size_t len,
+                    char *out, size_t *out_len)
+{
+        if (in == NULL || out == NULL || out_len == NULL ||
+            !GROUP_MODE(from) || codec_buf_size(to, 0, 0) == 0) {
+                errno = EINVAL;
+                return -1;
+        }
+        return transcode_run(from, to, in, len, 1, out, out_len);
+}
+
+/* transcode everything read from 'ifd' into 'ofd' in a single pass with
+   fixed buffers, the input need not fit in memory. The last block read
+   is held back until the next read, so the end of the input, where line
+   breaks and padding are allowed, is always in the final call */
+int codec_transcode_fd(int ifd, int ofd, unsigned char from, unsigned char to)
+{
+        size_t step, cap, out_cap, have = 0, n;
+        char *in = NULL, *out = NULL;
+        int status = -1;
+
+        if (!GROUP_MODE(from) || codec_buf_size(to, 0, 0) == 0) {
+                errno = EINVAL;
+                return -1;
+        }
+        step = TC_BLOCK / raw_group[from] * enc_group[from];
+        cap = step * TC_BLOCKS;
+        out_cap = transcode_buf_size(from, to, cap);
+        if ((in = lib_alloc(cap)) == NULL || (out = lib_alloc(out_cap)) == NULL) {
+                goto done;
+        }
+        for (;;) {
+                ssize_t rd = read_full(ifd, in, have, cap);
+
+                if (rd < 0) {
+                        goto done;
+                }
+                if ((size_t)rd < cap) {
+                        if (transcode_run(from, to, in, (size_t)rd, 1, out, &n) == -1 ||
+                            write_all(ofd, out, n) == -1) {
+                                goto done;
+                        }
+                        break;
+                }
+                if (transcode_run(from, to, in, cap - step, 0, out, &n) == -1 ||
+                    write_all(ofd, out, n) == -1) {
+                        goto done;
+                }
+                memmove(in, in + cap - step, step);
+                have = step;
+        }
+        status = 0;
+
+done:
+        {
+                int err = errno;
+                lib_free(in, cap);
+                lib_free(out, out_cap);
+                errno = err;
+        }
+        return status;
+}
+
+/* -------------------------------------------------------------------> mime */
+/*  a single walk over a raw RFC 5322 message: the headers of every entity
+    are read as they come, multipart boundaries are kept on a small stack,
+    and the lines of each base64 body are decoded as they are reached,
+    with the groups split by line breaks joined through a 4 byte carry */
+#define MIME_DEPTH 16           /* nested multiparts followed */
+#define MIME_BOUNDARY 70        /* longest boundary, RFC 2046 */
+
+struct mime_hdrs {
+        int b64;
+        int multipart;
+        int message;            /* message/rfc822, the body is a message */
+        const char *type;
+        size_t type_len;
+        const char *name;
+        size_t name_len;
+        const char *boundary;
+        size_t boundary_len;
+};
+
+struct mime_dec {
+        char carry[4];
+        unsigned int nc;
+        int ended;              /* padding seen, nothing may follow */
+        int err;
+        size_t w;
+};
+
+/* 'p' starts with the header name 'h' followed by a colon */
+static int mime_is(const char *p, const char *end, const char *h)
+{
+        size_t n = strlen(h);
+
+        return (size_t)(end - p) > n && strncasecmp(p, h, n) == 0 && p[n] == ':';
+}
+
+static int mime_space(char c)
+{
+        return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+/* value of the parameter 'key' in the header value [p, end), quotes
+   removed, NULL when it is not there */
+static const char *mime_param(const char *p, const char *end, const char *key, size_t *len)
+{
+        size_t n = strlen(key);
+
+        while ((p = memchr(p, ';', (size_t)(end - p))) != NULL) {
+                const char *v;
+
+                for (p++; p < end && mime_space(*p); p++);
+                if ((size_t)(end - p) <= n || strncasecmp(p, key, n) != 0 || p[n] != '=') {
+                        continue;
+                }
+                v = p + n + 1;
+                if (v < end && *v == '"') {
+                        const char *q;
+
+                        v++;
+                        q = memchr(v, '"', (size_t)(end - v));
+                        p = q != NULL ? q : end;
+                } else {
+                        for (p = v; p < end && *p != ';' && !mime_space(*p); p++);
+                }
+                *len = (size_t)(p - v);
+                return v;
+        }
+        return NULL;
+}
+
+/* take the header [p, end), continuation lines included */
+static void mime_header(struct mime_hdrs *h, const char *p, const char *end)
+{
+        const char *v;
+
+        if (mime_is(p, end, "Content-Transfer-Encoding")) {
+                for (v = p + 26; v < end && mime_space(*v); v++);
+                h->b64 = (size_t)(end - v) >= 6 && strncasecmp(v, "base64", 6) == 0 &&
+                         (end - v == 6 || mime_space(v[6]) || v[6] == ';');
+        } else if (mime_is(p, end, "Content-Type")) {
+                for (v = p + 13; v < end && mime_space(*v); v++);
+                for (h->type = v; v < end && *v != ';' && !mime_space(*v); v++);
+                h->type_len = (size_t)(v - h->type);
+                h->multipart = h->type_len > 10 && strncasecmp(h->type, "multipart/", 10) == 0;
+                h->message = h->type_len == 14 && strncasecmp(h->type, "message/rfc822", 14) == 0;
+                h->boundary = mime_param(v, end, "boundary", &h->boundary_len);
+                if (h->name == NULL) {
+                        h->name = mime_param(v, end, "name", &h->name_len);
+                }
+        } else if (mime_is(p, end, "Content-Disposition")) {
+                /* filename takes precedence over the name of Content-Type */
+                size_t n;
+                if ((v = mime_param(p, end, "filename", &n)) != NULL) {
+                        h->name = v;
+                        h->name_len = n;
+                }
+        }
+}
+
+/* decode one line of a base64 body into 'out' */
+static void mime_line(struct mime_dec *d, const char *p, size_t n, char *out)
+{
+        size_t k, whole;
+
+        while (n > 0 && mime_space(p[n - 1])) {
+                n--;
+        }
+        if (n == 0 || d->err) {
+                return;
+        }
+        if (d->ended) {
+                d->err = EINVAL;
+                return;
+        }
+        if (d->nc > 0) {
+                while (d->nc < 4 && n > 0) {
+                        d->carry[d->nc++] = *p++;
+                        n--;
+                }
+                if (d->nc < 4) {
+                        return;
+                }
+                if (codec_mem(BASE64, 1, d->carry, 4, out + d->w, &k) == -1) {
+                        d->err = errno;
+                        return;
+                }
+                d->w += k;
+                d->nc = 0;
+                d->ended = d->carry[3] == PAD;
+                if (n > 0 && d->ended) {
+                        d->err = EINVAL;
+                        return;
+                }
+        }
+        whole = n & ~(size_t)3;
+        if (whole > 0) {
+                if (codec_mem(BASE64, 1, p, whole, out + d->w, &k) == -1) {
+                        d->err = errno;
+                        return;
+                }
+                d->w += k;
+                d->ended = p[whole - 1] == PAD;
+        }
+        if (whole < n) {
+                if (d->ended) {
+                        d->err = EINVAL;
+                        return;
+                }
+                memcpy(d->carry, p + whole, n - whole);
+                d->nc = (unsigned int)(n - whole);
+        }
+}
+
+/* the line [p, end) is '--boundary' or '--boundary--' of an open
+   multipart, returns its level or -1 */
+static int mime_boundary(const char *p, const char *end, const char *const *b,
+                         const size_t *blen, int depth, int *closing)
+{
+        if (end - p < 3 || p[0] != '-' || p[1] != '-') {
+                return -1;
+        }
+        p += 2;
+        for (int k = depth - 1; k >= 0; k--) {
+                const char *q = p + blen[k];
+
+                if ((size_t)(end - p) < blen[k] || memcmp(p, b[k], blen[k]) != 0) {
+                        continue;
+                }
+                *closing = end - q >= 2 && q[0] == '-' && q[1] == '-';
+                if (*closing) {
+                        q += 2;
+                }
+                for (; q < end && mime_space(*q); q++);
+                if (q == end) {
+                        return k;
+                }
+        }
+        return -1;
+}
+
+/* hand the finished part to 'cb', -1 with errno set when it refuses it */
+static int mime_emit(const struct mime_hdrs *h, struct mime_dec *d, size_t body, const char *out,
+                     long index, mime_cb cb, void *arg)
+{
+        struct mime_part part;
+
+        /* a group cut short by the end of the body */
+        if (d->nc != 0 && d->err == 0) {
+                d->err = EINVAL;
+        }
+        part.index = (size_t)index;
+        part.type = h->type;
+        part.type_len = h->type_len;
+        part.name = h->name;
+        part.name_len = h->name_len;
+        part.offset = body;
+        part.data = out;
+        part.len = d->err ? 0 : d->w;
+        part.err = d->err;
+        errno = 0;
+        if (cb(&part, arg) != 0) {
+                if (errno == 0) {
+                        errno = ECANCELED;
+                }
+                return -1;
+        }
+        return 0;
+}
+
+/* walk the message 'msg' of 'len' bytes and decode every part with
+   Content-Transfer-Encoding: base64, each one is handed to 'cb' when its
+   body ends. A part that is not valid base64 is reported with 'err' set
+   and the walk goes on. Returns the number of base64 parts, or -1 with
+   errno set when memory runs out or when 'cb' returns non-zero */
+long mime_scan(const char *msg, size_t len, mime_cb cb, void *arg)
+{
+        const char *b[MIME_DEPTH];
+        size_t blen[MIME_DEPTH];
+        const char *end = msg + len, *p = msg, *hdr = NULL;
+        struct mime_hdrs h;
+        struct mime_dec d;
+        struct iobuf out = {NULL, 0};
+        int depth = 0, in_headers = 1, in_b64 = 0;
+        long parts = 0;
+        size_t body = 0;
+
+        if (msg == NULL || cb == NULL) {
+                errno = EINVAL;
+                return -1;
+        }
+        memset(&h, 0, sizeof(h));
+        while (p < end) {
+                const char *nl = memchr(p, '\n', (size_t)(end - p));
+                const char *eol = nl != NULL ? nl + 1 : end;
+                int level, closing = 0;
+
+                if (in_headers) {
+                        if (hdr != NULL && p < eol && (*p == ' ' || *p == '\t')) {
+                                p = eol;        /* continuation of 'hdr' */
+                                continue;
+                        }
+                        if (hdr != NULL) {
+                                mime_header(&h, hdr, p);
+                                hdr = NULL;
+                        }
+                        if (*p == '\n' || (*p == '\r' && eol - p == 2 && p[1] == '\n')) {
+                                /* the blank line ending the headers */
+                                in_headers = 0;
+                                if (h.message && !h.b64) {
+                                        /* the headers of the attached message follow */
+                                        memset(&h, 0, sizeof(h));
+                                        in_headers = 1;
+                                } else if (h.multipart && h.boundary != NULL && h.boundary_len > 0 &&
+                                    h.boundary_len <= MIME_BOUNDARY && depth < MIME_DEPTH) {
+                                        b[depth] = h.boundary;
+                                        blen[depth++] = h.boundary_len;
+                                } else if (h.b64) {
+                                        in_b64 = 1;
+                                        body = (size_t)(eol - msg);
+                                        memset(&d, 0, sizeof(d));
+                                        if (iobuf_reserve(&out, (len - body) / 4 * 3 + 4) == -1) {
+                                                goto fail;
+                                        }
+                                }
+                        } else {
+                                hdr = p;
+                        }
+                        p = eol;
+                        continue;
+                }
+
+                level = depth > 0 ? mime_boundary(p, eol, b, blen, depth, &closing) : -1;
+                if (level < 0) {
+                        if (in_b64) {
+                                mime_line(&d, p, (size_t)(eol - p), out.p);
+                        }
+                        p = eol;
+                        continue;
+                }
+                if (in_b64) {
+                        if (mime_emit(&h, &d, body, out.p, parts++, cb, arg) == -1) {
+                                goto fail;
+                        }
+                        in_b64 = 0;
+                }
+                depth = closing ? level : level + 1;
+                in_headers = !closing;
+                memset(&h, 0, sizeof(h));
+                p = eol;
+        }
+        if (hdr != NULL) {
+                mime_header(&h, hdr, end);
+        }
+        /* a single part message or a missing closing boundary */
+        if (in_b64 && mime_emit(&h, &d, body, out.p, parts++, cb, arg) == -1) {
+                goto fail;
+        }
+        iobuf_release(&out);
+        return parts;
+
+fail:
+        {
+                int err = errno;
+                iobuf_release(&out);
+                errno = err;
+        }
+        return -1;
+}
+
+/* mime_scan on the file 'path', mapped instead of read */
+long mime_scan_file(const char *path, mime_cb cb, void *arg)
+{
+        struct stat st;
+        void *m;
+        long n;
+        int fd, err;
+
+        if (path == NULL) {
+                errno = EINVAL;
+                return -1;
+        }
+        if ((fd = open(path, O_RDONLY)) == -1) {
+                return -1;
+        }
+        if (fstat(fd, &st) == -1) {
+                err = errno;
+                close(fd);
+                errno = err;
+                return -1;
+        }
+        if (st.st_size == 0) {
+                close(fd);
+                return mime_scan("", 0, cb, arg);
+        }
+        m = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        err = errno;
+        close(fd);
+        if (m == MAP_FAILED) {
+                errno = err;
+                return -1;
+        }
+        madvise(m, (size_t)st.st_size, MADV_SEQUENTIAL);
+        n = mime_scan(m, (size_t)st.st_size, cb, arg);
+        err = errno;
+        munmap(m, (size_t)st.st_size);
+        errno = err;
+        return n;
+}
+
+/* -------------------------------------------------------------------> dump */
+/*  xxd style dumps: every line is the offset, the bytes in hex split in
+    groups and the printable bytes in a gutter. The hex digits and the
+    gutter are made 16 bytes at a time with SSE2, the reverse reads the
+    hex columns of each line back and skips offsets and gutters */
+#define DUMP_COLS 16
+#define DUMP_GROUP 2
+#define DUMP_MAX_COLS 256
+#define DUMP_LINES 4096         /* lines made at a time by b16_dump_fd */
+
+static const char hex_lower[16] = "0123456789abcdef";
+
+/* 2 * 'n' lowercase hex digits of 's' */
+static void hex_run(const unsigned char *s, size_t n, char *b)
+{
+        size_t i = 0;
+#ifdef __SSE2__
+        const __m128i mask = _mm_set1_epi8(0x0f), nine = _mm_set1_epi8(9);
+        const __m128i zero = _mm_set1_epi8('0'), gap = _mm_set1_epi8('a' - '0' - 10);
+
+        for (; i + 16 <= n; i += 16) {
+                __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+                __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+                __m128i lo = _mm_and_si128(v, mask);
+                __m128i a = _mm_unpacklo_epi8(hi, lo), c = _mm_unpackhi_epi8(hi, lo);
+
+                a = _mm_add_epi8(_mm_add_epi8(a, zero), _mm_and_si128(_mm_cmpgt_epi8(a, nine), gap));
+                c = _mm_add_epi8(_mm_add_epi8(c, zero), _mm_and_si128(_mm_cmpgt_epi8(c, nine), gap));
+                _mm_storeu_si128((__m128i *)(b + 2 * i), a);
+                _mm_storeu_si128((__m128i *)(b + 2 * i + 16), c);
+        }
+#endif
+        for (; i < n; i++) {
+                b[2 * i] = hex_lower[s[i] >> 4];
+                b[2 * i + 1] = hex_lower[s[i] & 0x0f];
+        }
+}
+
+/* the gutter, bytes outside of 0x20-0x7e are shown as '.' */
+static void dump_gutter(const unsigned char *s, size_t n, char *b)
+{
+        size_t i = 0;
+#ifdef __SSE2__
+        const __m128i dot = _mm_set1_epi8('.');
+
+        for (; i + 16 <= n; i += 16) {
+                __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+                /* signed compares, bytes of 0x80 and up are negative */
+                __m128i ok = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(0x1f)),
+                                           _mm_cmplt_epi8(v, _mm_set1_epi8(0x7f)));
+                _mm_storeu_si128((__m128i *)(b + i),
+                                 _mm_or_si128(_mm_and_si128(ok, v), _mm_andnot_si128(ok, dot)));
+        }
+#endif
+        for (; i < n; i++) {
+                b[i] = s[i] >= 0x20 && s[i] < 0x7f ? (char)s[i] : '.';
+        }
+}
+
+static int dump_args(unsigned int *cols, unsigned int *group)
+{
+        if (*cols == 0) {
+                *cols = DUMP_COLS;
+        }
+        if (*cols > DUMP_MAX_COLS) {
+                errno = EINVAL;
+                return -1;
+        }
+        if (*group == 0) {
+                *group = DUMP_GROUP;
+        }
+        if (*group > *cols) {
+                *group = *cols;
+        }
+        return 0;
+}
+
+/* longest line for 'cols' bytes in groups of 'group' */
+static size_t dump_line_size(unsigned int cols, unsigned int group)
+{
+        return 16 + 2 + cols * 2 + (cols + group - 1) / group + 1 + cols + 1;
+}
+
+/* size of the buffer needed by b16_dump for 'len' bytes, 0 when 'cols'
+   is over 256 */
+size_t b16_dump_size(size_t len, unsigned int cols, unsigned int group)
+{
+        if (dump_args(&cols, &group) == -1) {
+                return 0;
+        }
+        return (len + cols - 1) / cols * dump_line_size(cols, group) + 1;
+}
+
+/* write the dump of 'len' bytes of 's' to 'b', the first byte is shown at
+   offset 'off'. 'cols' bytes per line in groups of 'group' bytes, 0 for
+   either selects the xxd defaults (16 and 2), a group of 'cols' or more
+   bytes leaves the hex unbroken. Returns the characters written, the
+   dump is null terminated, or 0 with errno set to EINVAL for over 256
+   columns */
+size_t b16_dump(const unsigned char *s, size_t len, uint64_t off, unsigned int cols,
+                unsigned int group, char *b)
+{
+        char hex[DUMP_MAX_COLS * 2 + 32];
+        char *w = b;
+
+        if (s == NULL || b == NULL || dump_args(&cols, &group) == -1) {
+                errno = EINVAL;
+                return 0;
+        }
+        for (size_t i = 0; i < len; i += cols, off += cols) {
+                size_t n = len - i < cols ? len - i : cols;
+                int digits = 8;
+
+                while (digits < 16 && (off >> (4 * digits)) != 0) {
+                        digits++;
+                }
+                for (int d = digits - 1; d >= 0; d--) {
+                        *w++ = hex_lower[(off >> (4 * d)) & 0x0f];
+                }
+                *w++ = ':';
+                *w++ = ' ';
+                hex_run(s + i, n, hex);
+                for (size_t g = 0; g < cols; g += group) {
+                        size_t k = g >= n ? 0 : n - g < group ? n - g : group;
+                        size_t full = cols - g < group ? cols - g : group;
+
+                        memcpy(w, hex + 2 * g, 2 * k);
+                        memset(w + 2 * k, ' ', 2 * (full - k) + 1);
+                        w += 2 * full + 1;
+                }
+                *w++ = ' ';
+                dump_gutter(s + i, n, w);
+                w += n;
+                *w++ = '\n';
+        }
+        *w = '\0';
+        return (size_t)(w - b);
+}
+
+static int hex_nibble(unsigned char c)
+{
+        if ((unsigned)(c - '0') < 10U) {
+                return c - '0';
+        }
+        c |= 0x20;
+        return (unsigned)(c - 'a') < 6U ? c - 'a' + 10 : -1;
+}
+
+/* bytes of the line [p, end) into 'b', a line that starts with hex
+   digits and a colon is a dump line, otherwise the line is plain hex */
+static int undump_line(const char *p, const char *end, char *b, size_t *w)
+{
+        const char *q = p;
+        int dump = 0;
+
+        while (q < end && q - p <= 16 && hex_nibble((unsigned char)*q) >= 0) {
+                q++;
+        }
+        if (q > p && q < end && *q == ':') {
+                p = q + 1;
+                dump = 1;
+        }
+        while (p < end) {
+                int hi, lo;
+
+                if (*p == ' ' || *p == '\t') {
+                        /* in a dump two blanks in a row end the hex columns */
+                        if (++p < end && dump && (*p == ' ' || *p == '\t')) {
+                                break;
+                        }
+                        continue;
+                }
+                if (*p == '\r' || *p == '\n') {
+                        break;
+                }
+                if (end - p < 2 || (hi = hex_nibble((unsigned char)p[0])) < 0 ||
+                    (lo = hex_nibble((unsigned char)p[1])) < 0) {
+                        errno = EINVAL;
+                        return -1;
+                }
+                b[(*w)++] = (char)(hi << 4 | lo);
+                p += 2;
+        }
+        return 0;
+}
+
+/* read back a dump made by b16_dump or xxd (offsets and gutters are
+   skipped, lines without an offset are taken as plain hex), 'b' needs
+   'len' / 2 + 1 bytes. Returns 0 and the size of the data in 'out_len',
+   or -1 with errno set to EINVAL for a malformed line */
+int b16_undump(const char *s, size_t len, char *b, size_t *out_len)
+{
+        const char *p = s, *end = s + len;
+        size_t w = 0;
+
+        if (s == NULL || b == NULL || out_len == NULL) {
+                errno = EINVAL;
+                return -1;
+        }
+        while (p < end) {
+                const char *nl = memchr(p, '\n', (size_t)(end - p));
+                const char *eol = nl != NULL ? nl : end;
+
+                if (undump_line(p, eol, b, &w) == -1) {
+                        *out_len = w;
+                        return -1;
+                }
+                p = nl != NULL ? nl + 1 : end;
+        }
+        b[w] = '\0';
+        *out_len = w;
+        return 0;
+}
+
+/* b16_dump from 'ifd' to 'ofd' with fixed buffers */
+int b16_dump_fd(int ifd, int ofd, unsigned int cols, unsigned int group)
+{
+        size_t in_cap, out_cap;
+        char *in = NULL, *out = NULL;
+        uint64_t off = 0;
+        int status = -1;
+
+        if (dump_args(&cols, &group) == -1) {
+                return -1;
+        }
+        in_cap = (size_t)cols * DUMP_LINES;
+        out_cap = b16_dump_size(in_cap, cols, group);
+        if ((in = lib_alloc(in_cap)) == NULL || (out = lib_alloc(out_cap)) == NULL) {
+                goto done;
+        }
+        for (;;) {
+                ssize_t rd = read_full(ifd, in, 0, in_cap);
+
+                if (rd < 0) {
+                        goto done;
+                }
+                if (write_all(ofd, out, b16_dump((unsigned char *)in, (size_t)rd, off, cols,
+                                                 group, out)) == -1) {
+                        goto done;
+                }
+                off += (uint64_t)rd;
+                if ((size_t)rd < in_cap) {
+                        break;
+                }
+        }
+        status = 0;
+
+done:
+        {
+                int err = errno;
+                lib_free(in, in_cap);
+                lib_free(out, out_cap);
+                errno = err;
+        }
+        return status;
+}
+
+/* b16_undump from 'ifd' to 'ofd' with fixed buffers, the lines cut by
+   the end of a read are carried to the next one */
+int b16_undump_fd(int ifd, int ofd)
+{
+        const size_t cap = (size_t)DUMP_LINES * 256;
+        char *in = NULL, *out = NULL;
+        size_t have = 0, n;
+        int status = -1;
+
+        if ((in = lib_alloc(cap)) == NULL || (out = lib_alloc(cap / 2 + 1)) == NULL) {
+                goto done;
+        }
+        for (;;) {
+                ssize_t rd = read_full(ifd, in, have, cap);
+                const char *nl;
+                size_t take;
+
+                if (rd < 0) {
+                        goto done;
+                }
+                if ((size_t)rd < cap) {
+                        take = (size_t)rd;
+                } else if ((nl = memrchr(in, '\n', cap)) != NULL) {
+                        take = (size_t)(nl - in) + 1;
+                } else {
+                        errno = EINVAL;         /* a line longer than the buffer */
+                        goto done;
+                }
+                if (b16_undump(in, take, out, &n) == -1 || write_all(ofd, out, n) == -1) {
+                        goto done;
+                }
+                if ((size_t)rd < cap) {
+                        break;
+                }
+                have = cap - take;
+                memmove(in, in + take, have);
+        }
+        status = 0;
+
+done:
+        {
+                int err = errno;
+                lib_free(in, cap);
+                lib_free(out, cap / 2 + 1);
+                errno = err;
+        }
+        return status;
+}
@@ -4,9 +4,62 @@
  *
  * encoding modes used by utilities functions
  */
+#ifndef BASE64_H
+#define BASE64_H
+
 #define BASE64 1
 #define BASE32 2
 #define BASE16 3
+#define BASE85 4   /* Z85 alphabet */
+#define ASCII85 5
+
+/* flags of 'codec_pool_submit' */
+#define CODEC_NOWAIT 1
+
+/* flags of 'codec_cache_open' */
+#define CACHE_LINK 1   /* hardlink hits, read-only and shared with the cache */
+
+/* flags of 'codec_set_mem_policy' */
+#define MEM_HUGEPAGES 1  /* transparent huge pages for large buffers */
+#define MEM_HUGETLB 2    /* try the hugetlbfs pool first */
+#define MEM_PREFAULT 4   /* fault large buffers in when they are allocated */
+#define MEM_READAHEAD 8  /* sequential access and readahead hints on inputs */
+#define MEM_DEFAULT (MEM_HUGEPAGES | MEM_PREFAULT | MEM_READAHEAD)
+
+/* flags of 'batch_files' */
+#define BATCH_DECODE 1
+#define BATCH_CRC 2
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct batch_job;
+struct codec_stats;
+struct codec_arena;
+struct codec_allocator;
+struct b64_index;
+struct codec_pool;
+struct codec_job;
+struct iovec;
+struct codec_cache;
+struct mime_part;
+
+/* receives each base64 part found by 'mime_scan', non-zero stops the scan */
+typedef int (*mime_cb)(const struct mime_part *part, void *arg);
+
+/* codecs counted by the statistics, see codec_stats_snapshot() */
+#define STATS_B64_ENC 0
+#define STATS_B64_DEC 1
+#define STATS_B32_ENC 2
+#define STATS_B32_DEC 3
+#define STATS_B16_ENC 4
+#define STATS_B16_DEC 5
+#define STATS_NCODECS 6
+#define STATS_BUCKETS 32
 
 void base16_encoder(char *s, char b[]);
 void base16_decoder(char *b16, char b[]);
@@ -18,20 +71,155 @@ int get_token_pos(char tk, unsigned char len, const char alp[]);
 void b64_enc(const unsigned char *s, char b[], unsigned int len);
 unsigned int b64_dec(const unsigned char *s, char b[], unsigned int len);
 unsigned int get_data_size(char *s, unsigned int len);
+int b64_validate(const unsigned char *s, unsigned int len, unsigned int *size, unsigned int *bad);
+int b32_validate(const unsigned char *s, unsigned int len, unsigned int *size, unsigned int *bad);
+int b16_validate(const char *s, unsigned int len, unsigned int *size, unsigned int *bad);
+size_t b64_dec_range(const unsigned char *s, size_t len, size_t off, size_t n, char *b);
+struct b64_index *b64_index_build(const unsigned char *s, size_t len, size_t stride);
+size_t b64_dec_range_idx(const unsigned char *s, size_t len, const struct b64_index *idx,
+                         size_t off, size_t n, char *b);
+uint64_t b64_index_size(const struct b64_index *idx);
+int b64_index_save(const struct b64_index *idx, const char *path);
+struct b64_index *b64_index_load(const char *path);
+void b64_index_free(struct b64_index *idx);
 unsigned int b64_enc_size(unsigned int input_len);
 unsigned int b64_dec_size(unsigned int input_len);
 void b32_enc(const unsigned char *s, unsigned char *b, unsigned int len);
 unsigned int b32_dec(const unsigned char *s, char *b, unsigned int len);
 void b16_enc(const unsigned char *s, char *b, unsigned int len);
 unsigned int b16_dec(const char *s, char *b, unsigned int len);
+unsigned int z85_enc(const unsigned char *s, char *b, unsigned int len);
+unsigned int z85_dec(const char *s, char *b, unsigned int len);
+unsigned int a85_enc(const unsigned char *s, char *b, unsigned int len);
+unsigned int a85_dec(const char *s, char *b, unsigned int len);
 int encode_wr_file(const char *src, const char *dst, unsigned char mode);
 int decode_rd_file(const char *src, const char *dst, unsigned char mode);
+int encode_append_file(const char *src, const char *dst, unsigned char mode);
 struct finfo *get_file(const char *f);
 void free_finfo(struct finfo *info);
 char *alloc(unsigned int size);
+void dealloc(char *ptr, unsigned int size);
+void codec_set_allocator(const struct codec_allocator *a);
+struct codec_arena *codec_arena_create(void);
+void codec_arena_destroy(struct codec_arena *a);
+int encode_wr_file_arena(const char *src, const char *dst, unsigned char mode,
+                         struct codec_arena *a);
+int decode_rd_file_arena(const char *src, const char *dst, unsigned char mode,
+                         struct codec_arena *a);
+char *codec_arena_mem(struct codec_arena *a, unsigned char mode, int decode,
+                      const char *in, size_t len, size_t *out_len);
+size_t codec_buf_size(unsigned char mode, int decode, size_t len);
+void codec_set_nt_threshold(size_t bytes);
+void codec_set_mem_policy(int flags);
+int codec_mem(unsigned char mode, int decode, const char *in, size_t len,
+              char *out, size_t *out_len);
+int codec_dec_utf8(unsigned char mode, const char *in, size_t len, char *out,
+                   size_t *out_len, size_t *bad);
+int codec_memv(unsigned char mode, int decode, const struct iovec *iov, int iovcnt,
+               char *out, size_t *out_len);
+size_t b64_encv(const struct iovec *iov, int iovcnt, char b[]);
+size_t b64_decv(const struct iovec *iov, int iovcnt, char b[]);
+size_t b32_encv(const struct iovec *iov, int iovcnt, char b[]);
+size_t b32_decv(const struct iovec *iov, int iovcnt, char b[]);
+int codec_stats_snapshot(struct codec_stats *st);
+void codec_stats_reset(void);
+const char *codec_stats_name(int codec);
+long batch_files(struct batch_job *jobs, size_t n, unsigned char mode, int flags,
+                 unsigned int nthreads);
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len);
+int codec_mem_crc(unsigned char mode, int decode, const char *in, size_t len,
+                  char *out, size_t *out_len, uint32_t *crc);
+void b64_enc_crc(const unsigned char *s, char b[], unsigned int len, uint32_t *crc);
+unsigned int b64_dec_crc(const unsigned char *s, char b[], unsigned int len, uint32_t *crc);
+struct codec_pool *codec_pool_create(unsigned int nthreads, size_t queue_cap);
+void codec_pool_destroy(struct codec_pool *p);
+int codec_pool_submit(struct codec_pool *p, struct codec_job *job, int flags);
+int codec_pool_submit_many(struct codec_pool *p, struct codec_job **jobs, size_t n, int flags);
+int codec_pipe(int ifd, int ofd, unsigned char mode, int decode, unsigned int nworkers);
+int codec_records(int ifd, int ofd, unsigned char mode, int decode, int delim,
+                  unsigned int nworkers);
+int codec_tune(const char *path);
+int codec_mem_auto(unsigned char mode, int decode, const char *in, size_t len,
+                   char *out, size_t *out_len);
+unsigned int codec_tune_threads(int decode, size_t len);
+struct codec_cache *codec_cache_open(const char *dir, uint64_t max, int flags);
+void codec_cache_close(struct codec_cache *c);
+int codec_cache_file(struct codec_cache *c, const char *src, const char *dst,
+                     unsigned char mode, int decode);
+size_t transcode_buf_size(unsigned char from, unsigned char to, size_t len);
+int codec_transcode(unsigned char from, unsigned char to, const char *in, size_t len,
+                    char *out, size_t *out_len);
+int codec_transcode_fd(int ifd, int ofd, unsigned char from, unsigned char to);
+long mime_scan(const char *msg, size_t len, mime_cb cb, void *arg);
+long mime_scan_file(const char *path, mime_cb cb, void *arg);
+size_t b16_dump_size(size_t len, unsigned int cols, unsigned int group);
+size_t b16_dump(const unsigned char *s, size_t len, uint64_t off, unsigned int cols,
+                unsigned int group, char *b);
+int b16_undump(const char *s, size_t len, char *b, size_t *out_len);
+int b16_dump_fd(int ifd, int ofd, unsigned int cols, unsigned int group);
+int b16_undump_fd(int ifd, int ofd);
 
 struct finfo {  /* used by 'get_file' to return file information */
 	char *addr;  /* file is loaded here */
 	size_t size; /* size of file is returned here */
+	size_t cap;  /* bytes allocated at 'addr' */
 };
 
+struct codec_allocator {  /* see 'codec_set_allocator' */
+	void *(*alloc)(size_t size, void *ctx);
+	void (*free)(void *ptr, size_t size, void *ctx);
+	void *ctx;        /* passed to both callbacks */
+};
+
+struct batch_job {  /* one file of a batch processed by 'batch_files' */
+	const char *src;  /* file to encode or decode */
+	const char *dst;  /* where the output is written */
+	int err;          /* 0 on success, errno of the failure otherwise */
+	uint32_t crc;     /* CRC32C of the raw data with BATCH_CRC */
+};
+
+struct codec_stats {  /* counters of one codec, built with -DBASE64_STATS */
+	unsigned long long calls;
+	unsigned long long bytes_in;
+	unsigned long long bytes_out;
+	unsigned long long invalid;  /* calls that rejected their input */
+	unsigned long long nsec;     /* time spent in the codec */
+	unsigned long long hist[STATS_BUCKETS]; /* calls by log2 of latency in ns */
+};
+
+struct codec_job {  /* an asynchronous job, see 'codec_pool_submit' */
+	unsigned char mode;  /* BASE64, BASE32 or BASE16 */
+	int decode;
+	const char *in;
+	size_t len;
+	char *out;           /* at least codec_buf_size() bytes */
+	void (*done)(struct codec_job *job);  /* called when finished, or NULL */
+	void *arg;           /* for the caller */
+	int efd;             /* eventfd signaled when finished, -1 for none */
+	size_t out_len;      /* set when finished */
+	int err;             /* set when finished, 0 or errno of the failure */
+	/* used by the pool */
+	size_t piece_size;
+	size_t npieces;
+	size_t last_out;
+	unsigned int pending;
+	int piece_err;
+};
+
+struct mime_part {  /* a base64 part of a message, see 'mime_scan' */
+	size_t index;        /* 0 for the first base64 part of the message */
+	const char *type;    /* media type, not null terminated */
+	size_t type_len;
+	const char *name;    /* filename or name parameter, or NULL */
+	size_t name_len;
+	size_t offset;       /* where the body starts in the message */
+	const char *data;    /* the decoded body, valid until 'cb' returns */
+	size_t len;
+	int err;             /* 0, or EINVAL when the body is not valid base64 */
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
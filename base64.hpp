@@ -0,0 +1,391 @@
+/*
+ * C++17/20 interface of the base64 library
+ * Copyright Orestes Leal Rodriguez 2015-2025
+ *
+ * header only, on top of base64.h:
+ *
+ *  - encode_literal / decode_literal run at compile time for base64
+ *    literals, the result is a 'fixed' array, so embedded constants
+ *    cost nothing at run time
+ *  - encode / decode take std::string_view (and std::span of bytes with
+ *    C++20) and write into a caller buffer, a std::string or a
+ *    b64::buffer. Strings are grown without zeroing when the library has
+ *    resize_and_overwrite (C++23), buffers always are
+ *  - the run time functions call codec_mem (codec_mem_auto from 4 KiB,
+ *    the smallest size codec_tune measures) directly on the input and
+ *    the output storage, there are no intermediate copies
+ *
+ * errors are std::system_error with the errno of the C library (EINVAL
+ * for invalid input), or an std::error_code for the overloads taking one
+ */
+#ifndef BASE64_HPP
+#define BASE64_HPP
+
+#include <cerrno>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#if __cplusplus >= 202002L && __has_include(<span>)
+#include <span>
+#define B64_HAS_SPAN 1
+#endif
+
+#include "base64.h"
+
+namespace b64 {
+
+enum class encoding : unsigned char {
+        base64 = BASE64,
+        base32 = BASE32,
+        base16 = BASE16,
+        z85 = BASE85,
+        ascii85 = ASCII85
+};
+
+/* ------------------------------------------------------------> compile time */
+
+/* result of encode_literal / decode_literal, null terminated */
+template <std::size_t N>
+struct fixed {
+        char buf[N + 1] = {};
+        std::size_t len = 0;
+
+        constexpr const char *data() const noexcept { return buf; }
+        constexpr const char *c_str() const noexcept { return buf; }
+        constexpr std::size_t size() const noexcept { return len; }
+        constexpr const char *begin() const noexcept { return buf; }
+        constexpr const char *end() const noexcept { return buf + len; }
+        constexpr std::string_view view() const noexcept { return {buf, len}; }
+        constexpr operator std::string_view() const noexcept { return view(); }
+};
+
+namespace detail {
+
+inline constexpr char alphabet[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+constexpr int value(char c) noexcept
+{
+        if (c >= 'A' && c <= 'Z') {
+                return c - 'A';
+        }
+        if (c >= 'a' && c <= 'z') {
+                return c - 'a' + 26;
+        }
+        if (c >= '0' && c <= '9') {
+                return c - '0' + 52;
+        }
+        return c == '+' ? 62 : c == '/' ? 63 : -1;
+}
+
+} // namespace detail
+
+constexpr std::size_t encoded_size(std::size_t n) noexcept
+{
+        return (n + 2) / 3 * 4;
+}
+
+/* base64 of a string literal (without its terminator) at compile time:
+       constexpr auto auth = b64::encode_literal("user:secret"); */
+template <std::size_t N>
+constexpr fixed<encoded_size(N - 1)> encode_literal(const char (&s)[N])
+{
+        fixed<encoded_size(N - 1)> r;
+        std::size_t i = 0;
+
+        for (; i + 3 <= N - 1; i += 3) {
+                unsigned int x = (unsigned int)(unsigned char)s[i] << 16 |
+                                 (unsigned int)(unsigned char)s[i + 1] << 8 |
+                                 (unsigned char)s[i + 2];
+                r.buf[r.len++] = detail::alphabet[x >> 18];
+                r.buf[r.len++] = detail::alphabet[(x >> 12) & 63];
+                r.buf[r.len++] = detail::alphabet[(x >> 6) & 63];
+                r.buf[r.len++] = detail::alphabet[x & 63];
+        }
+        if (i < N - 1) {
+                unsigned int x = (unsigned int)(unsigned char)s[i] << 16;
+                if (i + 1 < N - 1) {
+                        x |= (unsigned int)(unsigned char)s[i + 1] << 8;
+                }
+                r.buf[r.len++] = detail::alphabet[x >> 18];
+                r.buf[r.len++] = detail::alphabet[(x >> 12) & 63];
+                r.buf[r.len++] = i + 1 < N - 1 ? detail::alphabet[(x >> 6) & 63] : '=';
+                r.buf[r.len++] = '=';
+        }
+        return r;
+}
+
+/* decoding of a padded base64 literal at compile time, invalid input
+   does not compile when the result is declared constexpr */
+template <std::size_t N>
+constexpr fixed<(N - 1) / 4 * 3> decode_literal(const char (&s)[N])
+{
+        fixed<(N - 1) / 4 * 3> r;
+        std::size_t n = N - 1;
+
+        if (n % 4 != 0) {
+                throw std::invalid_argument("b64::decode_literal: length not a multiple of 4");
+        }
+        for (std::size_t i = 0; i < n; i += 4) {
+                int v[4] = {0, 0, 0, 0};
+                int pad = 0;
+
+                for (int k = 0; k < 4; k++) {
+                        if (s[i + k] == '=' && i + 4 == n && k >= 2 && (k == 3 || s[i + 3] == '=')) {
+                                pad++;
+                        } else if ((v[k] = detail::value(s[i + k])) < 0) {
+                                throw std::invalid_argument("b64::decode_literal: invalid character");
+                        }
+                }
+                unsigned int x = (unsigned int)v[0] << 18 | (unsigned int)v[1] << 12 |
+                                 (unsigned int)v[2] << 6 | (unsigned int)v[3];
+                r.buf[r.len++] = (char)(x >> 16);
+                if (pad < 2) {
+                        r.buf[r.len++] = (char)(x >> 8);
+                }
+                if (pad < 1) {
+                        r.buf[r.len++] = (char)x;
+                }
+        }
+        return r;
+}
+
+/* ------------------------------------------------------------> run time */
+
+/* growable byte buffer that is never zeroed, its contents are not kept
+   when it grows */
+class buffer {
+public:
+        char *data() noexcept { return p_.get(); }
+        const char *data() const noexcept { return p_.get(); }
+        std::size_t size() const noexcept { return len_; }
+        std::size_t capacity() const noexcept { return cap_; }
+        const char *begin() const noexcept { return p_.get(); }
+        const char *end() const noexcept { return p_.get() + len_; }
+        std::string_view view() const noexcept { return {p_.get(), len_}; }
+        operator std::string_view() const noexcept { return view(); }
+        void clear() noexcept { len_ = 0; }
+
+        /* room for 'n' bytes, the size is set by 'commit' */
+        char *prepare(std::size_t n)
+        {
+                if (n > cap_) {
+                        p_.reset(new char[n]);
+                        cap_ = n;
+                }
+                len_ = 0;
+                return p_.get();
+        }
+        void commit(std::size_t n) noexcept { len_ = n; }
+
+private:
+        std::unique_ptr<char[]> p_;
+        std::size_t len_ = 0;
+        std::size_t cap_ = 0;
+};
+
+/* bytes needed to encode or decode 'n' bytes, including the terminator
+   the codecs write, 0 for an unknown encoding */
+inline std::size_t encode_bound(std::size_t n, encoding e = encoding::base64) noexcept
+{
+        return codec_buf_size(static_cast<unsigned char>(e), 0, n);
+}
+
+inline std::size_t decode_bound(std::size_t n, encoding e = encoding::base64) noexcept
+{
+        return codec_buf_size(static_cast<unsigned char>(e), 1, n);
+}
+
+namespace detail {
+
+/* smaller calls are not worth the tuning table lookup */
+inline constexpr std::size_t auto_min = 4096;
+
+inline std::size_t run(encoding e, int decode, std::string_view in, char *out,
+                       std::size_t cap, std::error_code &ec) noexcept
+{
+        std::size_t need = codec_buf_size(static_cast<unsigned char>(e), decode, in.size());
+        std::size_t n = 0;
+
+        ec.clear();
+        if (need == 0) {
+                ec = std::make_error_code(std::errc::invalid_argument);
+                return 0;
+        }
+        if (cap < need) {
+                ec = std::make_error_code(std::errc::no_buffer_space);
+                return 0;
+        }
+        int r = in.size() < auto_min
+                ? codec_mem(static_cast<unsigned char>(e), decode, in.data(), in.size(), out, &n)
+                : codec_mem_auto(static_cast<unsigned char>(e), decode, in.data(), in.size(),
+                                 out, &n);
+        if (r == -1) {
+                ec = std::error_code(errno, std::generic_category());
+                return 0;
+        }
+        return n;
+}
+
+inline std::size_t check(std::size_t n, const std::error_code &ec, const char *what)
+{
+        if (ec) {
+                throw std::system_error(ec, what);
+        }
+        return n;
+}
+
+/* resize 's' to the result of coding into it without zeroing it first
+   when the standard library allows it */
+inline void run_into(std::string &s, encoding e, int decode, std::string_view in)
+{
+        std::size_t cap = codec_buf_size(static_cast<unsigned char>(e), decode, in.size());
+        std::error_code ec;
+
+        if (cap == 0) {
+                throw std::system_error(std::make_error_code(std::errc::invalid_argument), "b64");
+        }
+#if defined(__cpp_lib_string_resize_and_overwrite)
+        /* the terminator goes to p[cap - 1], which the string owns */
+        s.resize_and_overwrite(cap - 1, [&](char *p, std::size_t) noexcept {
+                return run(e, decode, in, p, cap, ec);
+        });
+#else
+        s.resize(cap - 1);
+        s.resize(run(e, decode, in, s.data(), cap, ec));
+#endif
+        check(0, ec, "b64");
+}
+
+inline void run_into(buffer &b, encoding e, int decode, std::string_view in)
+{
+        std::size_t cap = codec_buf_size(static_cast<unsigned char>(e), decode, in.size());
+        std::error_code ec;
+
+        if (cap == 0) {
+                throw std::system_error(std::make_error_code(std::errc::invalid_argument), "b64");
+        }
+        b.commit(check(run(e, decode, in, b.prepare(cap), cap, ec), ec, "b64"));
+}
+
+#ifdef B64_HAS_SPAN
+template <class T>
+std::string_view bytes(std::span<const T> s) noexcept
+{
+        return {reinterpret_cast<const char *>(s.data()), s.size()};
+}
+#endif
+
+} // namespace detail
+
+/* into 'cap' bytes at 'out' (see encode_bound / decode_bound), returns
+   the length of the result, which is followed by a null byte */
+inline std::size_t encode(std::string_view in, char *out, std::size_t cap,
+                          encoding e, std::error_code &ec) noexcept
+{
+        return detail::run(e, 0, in, out, cap, ec);
+}
+
+inline std::size_t decode(std::string_view in, char *out, std::size_t cap,
+                          encoding e, std::error_code &ec) noexcept
+{
+        return detail::run(e, 1, in, out, cap, ec);
+}
+
+inline std::size_t encode(std::string_view in, char *out, std::size_t cap,
+                          encoding e = encoding::base64)
+{
+        std::error_code ec;
+        return detail::check(encode(in, out, cap, e, ec), ec, "b64::encode");
+}
+
+inline std::size_t decode(std::string_view in, char *out, std::size_t cap,
+                          encoding e = encoding::base64)
+{
+        std::error_code ec;
+        return detail::check(decode(in, out, cap, e, ec), ec, "b64::decode");
+}
+
+/* replace the contents of 'out', reusing its storage */
+inline void encode_into(std::string &out, std::string_view in, encoding e = encoding::base64)
+{
+        detail::run_into(out, e, 0, in);
+}
+
+inline void decode_into(std::string &out, std::string_view in, encoding e = encoding::base64)
+{
+        detail::run_into(out, e, 1, in);
+}
+
+inline void encode_into(buffer &out, std::string_view in, encoding e = encoding::base64)
+{
+        detail::run_into(out, e, 0, in);
+}
+
+inline void decode_into(buffer &out, std::string_view in, encoding e = encoding::base64)
+{
+        detail::run_into(out, e, 1, in);
+}
+
+inline std::string encode(std::string_view in, encoding e = encoding::base64)
+{
+        std::string s;
+        encode_into(s, in, e);
+        return s;
+}
+
+inline std::string decode(std::string_view in, encoding e = encoding::base64)
+{
+        std::string s;
+        decode_into(s, in, e);
+        return s;
+}
+
+#ifdef B64_HAS_SPAN
+inline std::size_t encode(std::span<const unsigned char> in, std::span<char> out,
+                          encoding e = encoding::base64)
+{
+        return encode(detail::bytes(in), out.data(), out.size(), e);
+}
+
+inline std::size_t encode(std::span<const std::byte> in, std::span<char> out,
+                          encoding e = encoding::base64)
+{
+        return encode(detail::bytes(in), out.data(), out.size(), e);
+}
+
+inline std::size_t decode(std::string_view in, std::span<char> out,
+                          encoding e = encoding::base64)
+{
+        return decode(in, out.data(), out.size(), e);
+}
+
+inline std::string encode(std::span<const unsigned char> in, encoding e = encoding::base64)
+{
+        return encode(detail::bytes(in), e);
+}
+
+inline std::string encode(std::span<const std::byte> in, encoding e = encoding::base64)
+{
+        return encode(detail::bytes(in), e);
+}
+
+inline void encode_into(buffer &out, std::span<const unsigned char> in,
+                        encoding e = encoding::base64)
+{
+        encode_into(out, detail::bytes(in), e);
+}
+
+inline void encode_into(buffer &out, std::span<const std::byte> in,
+                        encoding e = encoding::base64)
+{
+        encode_into(out, detail::bytes(in), e);
+}
+#endif
+
+} // namespace b64
+
+#endif
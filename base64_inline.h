@@ -0,0 +1,258 @@
+/*
+ * Base64 encoding/decoding of small fixed-size inputs (keys, hashes)
+ * Copyright Orestes Leal Rodriguez 2015-2025
+ *
+ * header only, every function is static inline and fully unrolled: there
+ * are no loops and the only branch is the error check at the end of the
+ * decoders. Output is identical to b64_enc / b64_dec. Sizes provided:
+ * 16, 20, 32 and 64 bytes (128-bit keys, SHA-1, SHA-256, SHA-512)
+ */
+#ifndef BASE64_INLINE_H
+#define BASE64_INLINE_H
+
+#include <stdint.h>
+#include <errno.h>
+
+static const char b64i_alp[64] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/* alphabet position + 1, 0 for characters outside the alphabet, so after
+   subtracting 1 an invalid character has the high bits set */
+static const unsigned char b64i_val[256] = {
+        ['A'] = 1, ['B'] = 2, ['C'] = 3, ['D'] = 4, ['E'] = 5, ['F'] = 6,
+        ['G'] = 7, ['H'] = 8, ['I'] = 9, ['J'] = 10, ['K'] = 11, ['L'] = 12,
+        ['M'] = 13, ['N'] = 14, ['O'] = 15, ['P'] = 16, ['Q'] = 17, ['R'] = 18,
+        ['S'] = 19, ['T'] = 20, ['U'] = 21, ['V'] = 22, ['W'] = 23, ['X'] = 24,
+        ['Y'] = 25, ['Z'] = 26, ['a'] = 27, ['b'] = 28, ['c'] = 29, ['d'] = 30,
+        ['e'] = 31, ['f'] = 32, ['g'] = 33, ['h'] = 34, ['i'] = 35, ['j'] = 36,
+        ['k'] = 37, ['l'] = 38, ['m'] = 39, ['n'] = 40, ['o'] = 41, ['p'] = 42,
+        ['q'] = 43, ['r'] = 44, ['s'] = 45, ['t'] = 46, ['u'] = 47, ['v'] = 48,
+        ['w'] = 49, ['x'] = 50, ['y'] = 51, ['z'] = 52, ['0'] = 53, ['1'] = 54,
+        ['2'] = 55, ['3'] = 56, ['4'] = 57, ['5'] = 58, ['6'] = 59, ['7'] = 60,
+        ['8'] = 61, ['9'] = 62, ['+'] = 63, ['/'] = 64
+};
+
+#define B64I_ENC3(s, b) do { \
+        uint32_t x_ = ((uint32_t)(s)[0] << 16) | ((uint32_t)(s)[1] << 8) | (s)[2]; \
+        (b)[0] = b64i_alp[x_ >> 18]; \
+        (b)[1] = b64i_alp[(x_ >> 12) & 63]; \
+        (b)[2] = b64i_alp[(x_ >> 6) & 63]; \
+        (b)[3] = b64i_alp[x_ & 63]; \
+} while (0)
+
+#define B64I_VAL(c) ((uint32_t)(unsigned char)(b64i_val[(unsigned char)(c)] - 1))
+
+#define B64I_DEC4(s, b, err) do { \
+        uint32_t a_ = B64I_VAL((s)[0]), b_ = B64I_VAL((s)[1]); \
+        uint32_t c_ = B64I_VAL((s)[2]), d_ = B64I_VAL((s)[3]); \
+        uint32_t x_ = (a_ << 18) | (b_ << 12) | (c_ << 6) | d_; \
+        (err) |= a_ | b_ | c_ | d_; \
+        (b)[0] = (unsigned char)(x_ >> 16); \
+        (b)[1] = (unsigned char)(x_ >> 8); \
+        (b)[2] = (unsigned char)x_; \
+} while (0)
+
+static inline void b64i_enc_tail1(const unsigned char *s, char *b)
+{
+        b[0] = b64i_alp[s[0] >> 2];
+        b[1] = b64i_alp[(s[0] & 3) << 4];
+        b[2] = '=';
+        b[3] = '=';
+}
+
+static inline void b64i_enc_tail2(const unsigned char *s, char *b)
+{
+        uint32_t x = ((uint32_t)s[0] << 8) | s[1];
+        b[0] = b64i_alp[x >> 10];
+        b[1] = b64i_alp[(x >> 4) & 63];
+        b[2] = b64i_alp[(x << 2) & 63];
+        b[3] = '=';
+}
+
+/* the tail decoders return the error bits of their quad, a wrong
+   padding character is reported as an invalid value */
+static inline uint32_t b64i_dec_tail1(const char *s, unsigned char *b)
+{
+        uint32_t a = B64I_VAL(s[0]), c = B64I_VAL(s[1]);
+        b[0] = (unsigned char)((a << 2) | (c >> 4));
+        return a | c | ((uint32_t)(s[2] != '=') << 6) | ((uint32_t)(s[3] != '=') << 6);
+}
+
+static inline uint32_t b64i_dec_tail2(const char *s, unsigned char *b)
+{
+        uint32_t a = B64I_VAL(s[0]), c = B64I_VAL(s[1]), d = B64I_VAL(s[2]);
+        uint32_t x = (a << 12) | (c << 6) | d;
+        b[0] = (unsigned char)(x >> 10);
+        b[1] = (unsigned char)(x >> 2);
+        return a | c | d | ((uint32_t)(s[3] != '=') << 6);
+}
+
+/* encode exactly 16 bytes into 24 characters (plus null) */
+static inline void b64_enc16(const unsigned char *s, char *b)
+{
+        B64I_ENC3(s + 0, b + 0);
+        B64I_ENC3(s + 3, b + 4);
+        B64I_ENC3(s + 6, b + 8);
+        B64I_ENC3(s + 9, b + 12);
+        B64I_ENC3(s + 12, b + 16);
+        b64i_enc_tail1(s + 15, b + 20);
+        b[24] = '\0';
+}
+
+/* decode the 24 characters encoding 16 bytes, padding included,
+   returns 0 or -1 with errno set to EINVAL if the input is invalid */
+static inline int b64_dec16(const char *s, unsigned char *b)
+{
+        uint32_t err = 0;
+
+        B64I_DEC4(s + 0, b + 0, err);
+        B64I_DEC4(s + 4, b + 3, err);
+        B64I_DEC4(s + 8, b + 6, err);
+        B64I_DEC4(s + 12, b + 9, err);
+        B64I_DEC4(s + 16, b + 12, err);
+        err |= b64i_dec_tail1(s + 20, b + 15);
+        if (err & ~63U) {
+                errno = EINVAL;
+                return -1;
+        }
+        return 0;
+}
+
+/* encode exactly 20 bytes into 28 characters (plus null) */
+static inline void b64_enc20(const unsigned char *s, char *b)
+{
+        B64I_ENC3(s + 0, b + 0);
+        B64I_ENC3(s + 3, b + 4);
+        B64I_ENC3(s + 6, b + 8);
+        B64I_ENC3(s + 9, b + 12);
+        B64I_ENC3(s + 12, b + 16);
+        B64I_ENC3(s + 15, b + 20);
+        b64i_enc_tail2(s + 18, b + 24);
+        b[28] = '\0';
+}
+
+/* decode the 28 characters encoding 20 bytes, padding included,
+   returns 0 or -1 with errno set to EINVAL if the input is invalid */
+static inline int b64_dec20(const char *s, unsigned char *b)
+{
+        uint32_t err = 0;
+
+        B64I_DEC4(s + 0, b + 0, err);
+        B64I_DEC4(s + 4, b + 3, err);
+        B64I_DEC4(s + 8, b + 6, err);
+        B64I_DEC4(s + 12, b + 9, err);
+        B64I_DEC4(s + 16, b + 12, err);
+        B64I_DEC4(s + 20, b + 15, err);
+        err |= b64i_dec_tail2(s + 24, b + 18);
+        if (err & ~63U) {
+                errno = EINVAL;
+                return -1;
+        }
+        return 0;
+}
+
+/* encode exactly 32 bytes into 44 characters (plus null) */
+static inline void b64_enc32(const unsigned char *s, char *b)
+{
+        B64I_ENC3(s + 0, b + 0);
+        B64I_ENC3(s + 3, b + 4);
+        B64I_ENC3(s + 6, b + 8);
+        B64I_ENC3(s + 9, b + 12);
+        B64I_ENC3(s + 12, b + 16);
+        B64I_ENC3(s + 15, b + 20);
+        B64I_ENC3(s + 18, b + 24);
+        B64I_ENC3(s + 21, b + 28);
+        B64I_ENC3(s + 24, b + 32);
+        B64I_ENC3(s + 27, b + 36);
+        b64i_enc_tail2(s + 30, b + 40);
+        b[44] = '\0';
+}
+
+/* decode the 44 characters encoding 32 bytes, padding included,
+   returns 0 or -1 with errno set to EINVAL if the input is invalid */
+static inline int b64_dec32(const char *s, unsigned char *b)
+{
+        uint32_t err = 0;
+
+        B64I_DEC4(s + 0, b + 0, err);
+        B64I_DEC4(s + 4, b + 3, err);
+        B64I_DEC4(s + 8, b + 6, err);
+        B64I_DEC4(s + 12, b + 9, err);
+        B64I_DEC4(s + 16, b + 12, err);
+        B64I_DEC4(s + 20, b + 15, err);
+        B64I_DEC4(s + 24, b + 18, err);
+        B64I_DEC4(s + 28, b + 21, err);
+        B64I_DEC4(s + 32, b + 24, err);
+        B64I_DEC4(s + 36, b + 27, err);
+        err |= b64i_dec_tail2(s + 40, b + 30);
+        if (err & ~63U) {
+                errno = EINVAL;
+                return -1;
+        }
+        return 0;
+}
+
+/* encode exactly 64 bytes into 88 characters (plus null) */
+static inline void b64_enc64(const unsigned char *s, char *b)
+{
+        B64I_ENC3(s + 0, b + 0);
+        B64I_ENC3(s + 3, b + 4);
+        B64I_ENC3(s + 6, b + 8);
+        B64I_ENC3(s + 9, b + 12);
+        B64I_ENC3(s + 12, b + 16);
+        B64I_ENC3(s + 15, b + 20);
+        B64I_ENC3(s + 18, b + 24);
+        B64I_ENC3(s + 21, b + 28);
+        B64I_ENC3(s + 24, b + 32);
+        B64I_ENC3(s + 27, b + 36);
+        B64I_ENC3(s + 30, b + 40);
+        B64I_ENC3(s + 33, b + 44);
+        B64I_ENC3(s + 36, b + 48);
+        B64I_ENC3(s + 39, b + 52);
+        B64I_ENC3(s + 42, b + 56);
+        B64I_ENC3(s + 45, b + 60);
+        B64I_ENC3(s + 48, b + 64);
+        B64I_ENC3(s + 51, b + 68);
+        B64I_ENC3(s + 54, b + 72);
+        B64I_ENC3(s + 57, b + 76);
+        B64I_ENC3(s + 60, b + 80);
+        b64i_enc_tail1(s + 63, b + 84);
+        b[88] = '\0';
+}
+
+/* decode the 88 characters encoding 64 bytes, padding included,
+   returns 0 or -1 with errno set to EINVAL if the input is invalid */
+static inline int b64_dec64(const char *s, unsigned char *b)
+{
+        uint32_t err = 0;
+
+        B64I_DEC4(s + 0, b + 0, err);
+        B64I_DEC4(s + 4, b + 3, err);
+        B64I_DEC4(s + 8, b + 6, err);
+        B64I_DEC4(s + 12, b + 9, err);
+        B64I_DEC4(s + 16, b + 12, err);
+        B64I_DEC4(s + 20, b + 15, err);
+        B64I_DEC4(s + 24, b + 18, err);
+        B64I_DEC4(s + 28, b + 21, err);
+        B64I_DEC4(s + 32, b + 24, err);
+        B64I_DEC4(s + 36, b + 27, err);
+        B64I_DEC4(s + 40, b + 30, err);
+        B64I_DEC4(s + 44, b + 33, err);
+        B64I_DEC4(s + 48, b + 36, err);
+        B64I_DEC4(s + 52, b + 39, err);
+        B64I_DEC4(s + 56, b + 42, err);
+        B64I_DEC4(s + 60, b + 45, err);
+        B64I_DEC4(s + 64, b + 48, err);
+        B64I_DEC4(s + 68, b + 51, err);
+        B64I_DEC4(s + 72, b + 54, err);
+        B64I_DEC4(s + 76, b + 57, err);
+        B64I_DEC4(s + 80, b + 60, err);
+        err |= b64i_dec_tail1(s + 84, b + 63);
+        if (err & ~63U) {
+                errno = EINVAL;
+                return -1;
+        }
+        return 0;
+}
+
+#endif
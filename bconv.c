@@ -0,0 +1,93 @@
+/*
+ *      converts between base16, base32 and base64 in a single pass,
+ *      without decoding the input to a binary file first.
+ *
+ *      usage: bconv -f 64|32|16 -t 64|32|16|85|a85 src dst
+ *
+ *  Copyright Orestes Leal Rodriguez 2015-2025 <lukes357@gmail.com>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "base64.h"
+
+static unsigned char parse_mode(const char *s)
+{
+        return strcmp(s, "64") == 0 ? BASE64 : strcmp(s, "32") == 0 ? BASE32 :
+               strcmp(s, "16") == 0 ? BASE16 : strcmp(s, "85") == 0 ? BASE85 :
+               strcmp(s, "a85") == 0 ? ASCII85 : 0;
+}
+
+static void usage(const char *prog)
+{
+        fprintf(stderr,
+                "usage: %s -f 64|32|16 -t 64|32|16|85|a85 src dst\n"
+                "\n"
+                "  -f base   encoding of src\n"
+                "  -t base   encoding written to dst, also 85 (Z85) or a85 (Ascii85)\n"
+                "\n"
+                "src and dst may be '-' for stdin and stdout\n",
+                prog);
+}
+
+int main(int argc, char *argv[])
+{
+        unsigned char from = 0, to = 0;
+        const char *src, *dst;
+        int opt, ifd = STDIN_FILENO, ofd = STDOUT_FILENO;
+        int status = EXIT_FAILURE;
+
+        while ((opt = getopt(argc, argv, "f:t:h")) != -1) {
+                switch (opt) {
+                        case 'f':
+                                from = parse_mode(optarg);
+                                break;
+                        case 't':
+                                to = parse_mode(optarg);
+                                break;
+                        default:
+                                usage(argv[0]);
+                                return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+                }
+        }
+        if (from == 0 || to == 0 || argc - optind != 2) {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+        src = argv[optind];
+        dst = argv[optind + 1];
+
+        if (strcmp(src, "-") != 0 && (ifd = open(src, O_RDONLY)) == -1) {
+                fprintf(stderr, "%s: %s: %s\n", argv[0], src, strerror(errno));
+                return EXIT_FAILURE;
+        }
+        if (strcmp(dst, "-") != 0 &&
+            (ofd = open(dst, O_CREAT | O_WRONLY | O_TRUNC, S_IRUSR | S_IWUSR)) == -1) {
+                fprintf(stderr, "%s: %s: %s\n", argv[0], dst, strerror(errno));
+                goto cleanup;
+        }
+        if (codec_transcode_fd(ifd, ofd, from, to) == -1) {
+                fprintf(stderr, "%s: %s: %s\n", argv[0], src, strerror(errno));
+                goto cleanup;
+        }
+        if (ofd != STDOUT_FILENO && close(ofd) == -1) {
+                ofd = STDOUT_FILENO;
+                fprintf(stderr, "%s: %s: %s\n", argv[0], dst, strerror(errno));
+                goto cleanup;
+        }
+        ofd = STDOUT_FILENO;
+        status = EXIT_SUCCESS;
+
+cleanup:
+        if (ifd != STDIN_FILENO) {
+                close(ifd);
+        }
+        if (ofd != STDOUT_FILENO) {
+                close(ofd);
+        }
+        return status;
+}
@@ -0,0 +1,275 @@
+/*
+ * Benchmarks of the base64 library
+ * Run with: make bench
+ *
+ *  non-temporal stores: encodes and decodes a large buffer with the
+ *  output going through the caches and with the streaming path, while a
+ *  co-tenant thread keeps walking a working set that fits in the last
+ *  level cache. The codec bandwidth and what the co-tenant pays (time
+ *  per cache line and, when perf counters are available, its cache
+ *  misses) are reported for both.
+ *
+ *  memory policy: encode_wr_file and decode_rd_file of a file of the
+ *  same size with malloc as the allocator and with the library's own
+ *  large buffers under MEM_DEFAULT, the output goes to /dev/null so the
+ *  heap buffers are used. The time, the
+ *  minor page faults and, with perf counters, the dTLB load misses of
+ *  each run are reported.
+ *
+ *  usage: bench_base64 [MiB of input] [KiB of co-tenant working set]
+ *
+ * Copyright Orestes Leal Rodriguez 2015-2025
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <linux/perf_event.h>
+#include "base64.h"
+
+#define LINE 64
+
+struct cotenant {
+        unsigned char *set;
+        size_t size;
+        atomic_int run;
+        unsigned long long lines;
+        unsigned long long misses;      /* ~0 when not available */
+        double secs;
+};
+
+static double now(void)
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/* a counter of the calling thread, -1 when perf is not usable */
+static int open_counter(unsigned int type, unsigned long long config)
+{
+        struct perf_event_attr pe;
+
+        memset(&pe, 0, sizeof(pe));
+        pe.type = type;
+        pe.size = sizeof(pe);
+        pe.config = config;
+        pe.disabled = 1;
+        pe.exclude_kernel = 1;
+        pe.exclude_hv = 1;
+        return (int)syscall(SYS_perf_event_open, &pe, 0, -1, -1, 0);
+}
+
+static int open_misses(void)
+{
+        return open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+}
+
+static long minor_faults(void)
+{
+        struct rusage ru;
+        getrusage(RUSAGE_SELF, &ru);
+        return ru.ru_minflt;
+}
+
+static void *cotenant_run(void *arg)
+{
+        struct cotenant *ct = arg;
+        volatile unsigned char sink = 0;
+        int pfd = open_misses();
+        double t0;
+
+        ct->lines = 0;
+        if (pfd != -1) {
+                ioctl(pfd, PERF_EVENT_IOC_RESET, 0);
+                ioctl(pfd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+        t0 = now();
+        while (atomic_load_explicit(&ct->run, memory_order_relaxed)) {
+                for (size_t i = 0; i < ct->size; i += LINE) {
+                        sink += ct->set[i];
+                }
+                ct->lines += ct->size / LINE;
+        }
+        ct->secs = now() - t0;
+        ct->misses = ~0ULL;
+        if (pfd != -1) {
+                long long v;
+                ioctl(pfd, PERF_EVENT_IOC_DISABLE, 0);
+                if (read(pfd, &v, sizeof(v)) == sizeof(v)) {
+                        ct->misses = (unsigned long long)v;
+                }
+                close(pfd);
+        }
+        (void)sink;
+        return NULL;
+}
+
+static void run(const char *name, unsigned char mode, int decode, const char *in,
+                size_t len, char *out, size_t nt, struct cotenant *ct)
+{
+        pthread_t tid;
+        size_t out_len;
+        double t0, t1;
+
+        codec_set_nt_threshold(nt);
+        atomic_store(&ct->run, 1);
+        pthread_create(&tid, NULL, cotenant_run, ct);
+        usleep(50000);          /* let the co-tenant warm its working set */
+        t0 = now();
+        codec_mem(mode, decode, in, len, out, &out_len);
+        t1 = now();
+        atomic_store(&ct->run, 0);
+        pthread_join(tid, NULL);
+
+        printf("%-16s %-9s %8.3f GB/s   co-tenant %7.2f ns/line", name,
+               nt != 0 ? "streaming" : "cached", (double)len / (t1 - t0) / 1e9,
+               ct->secs * 1e9 / (double)(ct->lines ? ct->lines : 1));
+        if (ct->misses != ~0ULL) {
+                printf("  %6.2f misses/kline", (double)ct->misses * 1000.0 /
+                       (double)(ct->lines ? ct->lines : 1));
+        }
+        putchar('\n');
+}
+
+static void *heap_alloc(size_t size, void *ctx)
+{
+        (void)ctx;
+        return malloc(size);
+}
+
+static void heap_free(void *ptr, size_t size, void *ctx)
+{
+        (void)size;
+        (void)ctx;
+        free(ptr);
+}
+
+/* with 'mapped' clear every buffer comes from malloc and no MEM_* feature
+   is used, the baseline of the library's large buffers */
+static void run_file(const char *name, const char *src, unsigned char mode, int decode,
+                     size_t len, int mapped)
+{
+        static const struct codec_allocator heap = {heap_alloc, heap_free, NULL};
+        int pfd = open_counter(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB |
+                               (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                               (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+        long f0, f1;
+        double t0, t1;
+        int rc;
+
+        codec_set_allocator(mapped ? NULL : &heap);
+        codec_set_mem_policy(mapped ? MEM_DEFAULT : 0);
+        if (pfd != -1) {
+                ioctl(pfd, PERF_EVENT_IOC_RESET, 0);
+                ioctl(pfd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+        f0 = minor_faults();
+        t0 = now();
+        rc = decode ? decode_rd_file(src, "/dev/null", mode) : encode_wr_file(src, "/dev/null", mode);
+        t1 = now();
+        f1 = minor_faults();
+
+        printf("%-16s %-9s %8.3f GB/s   %8ld faults", name, mapped ? "policy" : "malloc",
+               rc == 0 ? (double)len / (t1 - t0) / 1e9 : 0.0, f1 - f0);
+        if (pfd != -1) {
+                long long v;
+                ioctl(pfd, PERF_EVENT_IOC_DISABLE, 0);
+                if (read(pfd, &v, sizeof(v)) == sizeof(v)) {
+                        printf("  %10lld dTLB misses", v);
+                }
+                close(pfd);
+        }
+        putchar('\n');
+}
+
+/* write 'len' bytes of 'b' to a new temporary file, returns its name */
+static char *temp_file(const char *b, size_t len)
+{
+        static char names[2][32];
+        static int next;
+        char *name = names[next++ % 2];
+        FILE *fp;
+        int fd;
+
+        strcpy(name, "/tmp/b64benchXXXXXX");
+        if ((fd = mkstemp(name)) == -1 || (fp = fdopen(fd, "w")) == NULL) {
+                return NULL;
+        }
+        if (fwrite(b, 1, len, fp) != len) {
+                fclose(fp);
+                unlink(name);
+                return NULL;
+        }
+        fclose(fp);
+        return name;
+}
+
+int main(int argc, char *argv[])
+{
+        size_t len = (argc > 1 ? strtoull(argv[1], NULL, 10) : 256) << 20;
+        size_t set = (argc > 2 ? strtoull(argv[2], NULL, 10) : 4096) << 10;
+        struct cotenant ct;
+        char *raw = malloc(len);
+        char *enc = malloc(codec_buf_size(BASE64, 0, len));
+        char *dec = malloc(len + 1);
+        size_t enc_len;
+        char *src, *src_enc;
+
+        ct.set = malloc(set);
+        ct.size = set;
+        if (raw == NULL || enc == NULL || dec == NULL || ct.set == NULL || len == 0) {
+                perror(argv[0]);
+                return EXIT_FAILURE;
+        }
+        for (size_t i = 0; i < len; i++) {
+                raw[i] = (char)(i * 131 + (i >> 11));
+        }
+        memset(ct.set, 1, set);
+        /* fault the output pages in so both runs pay the same */
+        memset(enc, 0, codec_buf_size(BASE64, 0, len));
+        memset(dec, 0, len + 1);
+        codec_set_nt_threshold(0);
+        codec_mem(BASE64, 0, raw, len, enc, &enc_len);
+
+        printf("input %zu MiB, co-tenant working set %zu KiB\n\n", len >> 20, set >> 10);
+        run("base64 encode", BASE64, 0, raw, len, enc, 0, &ct);
+        run("base64 encode", BASE64, 0, raw, len, enc, 1, &ct);
+        run("base64 decode", BASE64, 1, enc, enc_len, dec, 0, &ct);
+        run("base64 decode", BASE64, 1, enc, enc_len, dec, 1, &ct);
+        run("base16 encode", BASE16, 0, raw, len / 2, enc, 0, &ct);
+        run("base16 encode", BASE16, 0, raw, len / 2, enc, 1, &ct);
+
+        /* the base16 runs overwrote the encoding */
+        codec_mem(BASE64, 0, raw, len, enc, &enc_len);
+        src = temp_file(raw, len);
+        src_enc = temp_file(enc, enc_len);
+        if (src == NULL || src_enc == NULL) {
+                perror(argv[0]);
+                return EXIT_FAILURE;
+        }
+        codec_set_nt_threshold(SIZE_MAX);
+        putchar('\n');
+        /* twice, the first round also brings the files into the page cache */
+        for (int k = 0; k < 2; k++) {
+                run_file("file encode", src, BASE64, 0, len, 0);
+                run_file("file encode", src, BASE64, 0, len, 1);
+                run_file("file decode", src_enc, BASE64, 1, enc_len, 0);
+                run_file("file decode", src_enc, BASE64, 1, enc_len, 1);
+        }
+        unlink(src);
+        unlink(src_enc);
+
+        free(raw);
+        free(enc);
+        free(dec);
+        free(ct.set);
+        return EXIT_SUCCESS;
+}
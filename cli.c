@@ -0,0 +1,709 @@
+/*
+ *      command line options shared by the b64enc, b64dec, b32enc,
+ *      b32dec, b16enc and b16dec utilities, the utilities call
+ *      'cli_run' when the first argument is an option.
+ *
+ *  Copyright Orestes Leal Rodriguez 2015-2025 <lukes357@gmail.com>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "base64.h"
+#include "cli.h"
+
+struct cli_opts {
+        const char *prog;
+        unsigned char mode;
+        int decode;
+        int batch;
+        int pipe;
+        int records;
+        int delim;
+        int append;
+        int stats;
+        int crc;
+        int utf8;
+        int dump;
+        unsigned int cols;
+        unsigned int group;
+        unsigned int nthreads;
+        const char *manifest;
+        const char *cache;
+};
+
+struct job_list {
+        struct batch_job *jobs;
+        size_t n;
+        size_t cap;
+};
+
+static const char *suffix(unsigned char mode)
+{
+        switch (mode) {
+                case BASE64:
+                        return ".b64";
+                case BASE32:
+                        return ".b32";
+                case BASE85:
+                        return ".z85";
+                case ASCII85:
+                        return ".a85";
+                default:
+                        return ".b16";
+        }
+}
+
+static void usage(const char *prog, unsigned char mode)
+{
+        /* the Base85 groups vary in size, the block based modes need fixed ones */
+        int groups = mode != BASE85 && mode != ASCII85;
+
+        fprintf(stderr, "usage: %s [--stats]%s [--cache dir] src dst\n"
+                "       %s --tune\n", prog, groups ? " [--crc] [--utf8]" : "", prog);
+        if (groups) {
+                fprintf(stderr, "       %s -p [--stats] [-j threads] src dst\n", prog);
+        }
+        fprintf(stderr, "       %s -r [-d delim] [--stats] [-j threads] src dst\n", prog);
+        if (groups) {
+                fprintf(stderr, "       %s -a [--stats] src dst\n", prog);
+        }
+        if (mode == BASE16) {
+                fprintf(stderr, "       %s -x [-c cols] [-g bytes] src dst\n", prog);
+        }
+        fprintf(stderr, "       %s -b [--stats]%s [-j threads] [-m manifest] [file ...]\n"
+                "\n"
+                "  --stats      print the time of each phase and the throughput\n",
+                prog, groups ? " [--crc]" : "");
+        if (groups) {
+                fprintf(stderr,
+                        "  --crc        print the CRC32C of the raw data of every file\n"
+                        "  --utf8       decoders only, fail unless the output is UTF-8 text\n");
+        } else {
+                fprintf(stderr,
+                        "  --ascii85    Ascii85 instead of the Z85 alphabet\n");
+        }
+        fprintf(stderr,
+                "  --cache dir  reuse earlier results kept in 'dir' for unchanged inputs,\n"
+                "               B64_CACHE_MAX in the environment caps it (bytes), not\n"
+                "               with --crc, --utf8, -b, -a or -x\n"
+                "  --tune       measure the fastest way to run each input size on this\n"
+                "               machine and save it to the cache used from then on\n"
+                "  -b           batch mode, every file is processed in this run, the list\n"
+                "               is taken from the arguments, a manifest or stdin ('-')\n");
+        if (groups) {
+                fprintf(stderr,
+                        "  -p           pipeline mode, the input is read, coded and written by\n"
+                        "               concurrent threads in blocks, so it need not fit in\n"
+                        "               memory, src and dst may be '-' for stdin and stdout\n");
+        }
+        fprintf(stderr,
+                "  -r           record mode, a pipeline where every line is coded on\n"
+                "               its own and written on a line of the output\n"
+                "  -d delim     record delimiter instead of the newline, one character\n"
+                "               or one of the escapes \\n, \\t, \\r and \\0\n");
+        if (groups) {
+                fprintf(stderr,
+                        "  -a           append mode, 'dst' holds the encoding of an earlier,\n"
+                        "               shorter 'src', only the bytes added since are encoded\n");
+        }
+        if (mode == BASE16) {
+                fprintf(stderr,
+                        "  -x           xxd style dump with offsets, grouped hex and a text\n"
+                        "               gutter, the decoder reads dumps back\n"
+                        "  -c cols      bytes per line of the dump (default 16, up to 256)\n"
+                        "  -g bytes     bytes per group of the dump (default 2, 0 for none)\n");
+        }
+        fprintf(stderr,
+                "  -j threads   workers used by batch and pipeline modes (default: one\n"
+                "               per cpu, two fewer with -p and -r, whose reader and\n"
+                "               writer keep a cpu each)\n"
+                "  -m manifest  file list with one 'src' or 'src<TAB>dst' per line\n"
+                "\n"
+                "in batch mode without an explicit dst the encoders write 'src%s', the\n"
+                "decoders remove that suffix or append '.dec' when it is not present\n",
+                suffix(mode));
+}
+
+/* byte value of the record delimiter given to -d, -1 when not valid */
+static int parse_delim(const char *s)
+{
+        if (s[0] != '\0' && s[1] == '\0') {
+                return (unsigned char)s[0];
+        }
+        if (s[0] == '\\' && s[1] != '\0' && s[2] == '\0') {
+                switch (s[1]) {
+                        case 'n':
+                                return '\n';
+                        case 't':
+                                return '\t';
+                        case 'r':
+                                return '\r';
+                        case '0':
+                                return '\0';
+                        case '\\':
+                                return '\\';
+                }
+        }
+        return -1;
+}
+
+/* output name for 'src' when the batch entry does not give one */
+static char *default_dst(const char *src, unsigned char mode, int decode)
+{
+        const char *sfx = suffix(mode);
+        size_t len = strlen(src);
+        size_t slen = strlen(sfx);
+        char *dst = malloc(len + slen + 1);
+
+        if (dst == NULL) {
+                return NULL;
+        }
+        if (!decode) {
+                memcpy(dst, src, len);
+                memcpy(dst + len, sfx, slen + 1);
+        } else if (len > slen && strcmp(src + len - slen, sfx) == 0) {
+                memcpy(dst, src, len - slen);
+                dst[len - slen] = '\0';
+        } else {
+                memcpy(dst, src, len);
+                memcpy(dst + len, ".dec", 5);
+        }
+        return dst;
+}
+
+static int add_job(struct job_list *l, const char *src, const char *dst,
+                   unsigned char mode, int decode)
+{
+        char *s, *d;
+
+        if (l->n == l->cap) {
+                size_t cap = l->cap ? l->cap * 2 : 64;
+                struct batch_job *jobs = realloc(l->jobs, cap * sizeof(*jobs));
+                if (jobs == NULL) {
+                        return -1;
+                }
+                l->jobs = jobs;
+                l->cap = cap;
+        }
+        s = strdup(src);
+        d = dst != NULL ? strdup(dst) : default_dst(src, mode, decode);
+        if (s == NULL || d == NULL) {
+                free(s);
+                free(d);
+                return -1;
+        }
+        l->jobs[l->n].src = s;
+        l->jobs[l->n].dst = d;
+        l->jobs[l->n].err = 0;
+        l->n++;
+        return 0;
+}
+
+/* read a list of 'src' or 'src<TAB>dst' lines, empty lines are ignored */
+static int read_list(FILE *fp, struct job_list *l, unsigned char mode, int decode)
+{
+        char *line = NULL;
+        size_t cap = 0;
+        ssize_t len;
+        int status = 0;
+
+        while ((len = getline(&line, &cap, fp)) != -1) {
+                char *tab;
+
+                while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+                        line[--len] = '\0';
+                }
+                if (len == 0) {
+                        continue;
+                }
+                if ((tab = strchr(line, '\t')) != NULL) {
+                        *tab++ = '\0';
+                }
+                if (add_job(l, line, tab, mode, decode) == -1) {
+                        status = -1;
+                        break;
+                }
+        }
+        if (ferror(fp)) {
+                status = -1;
+        }
+        free(line);
+        return status;
+}
+
+static void free_list(struct job_list *l)
+{
+        for (size_t i = 0; i < l->n; i++) {
+                free((char *)l->jobs[i].src);
+                free((char *)l->jobs[i].dst);
+        }
+        free(l->jobs);
+}
+
+static double now(void)
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void print_phase(const char *name, double secs, size_t bytes)
+{
+        fprintf(stderr, "%-6s %12.6f s", name, secs);
+        if (bytes > 0 && secs > 0) {
+                fprintf(stderr, "  %8.3f GB/s", (double)bytes / secs / 1e9);
+        }
+        fputc('\n', stderr);
+}
+
+/* per-codec counters, only available when the library is built with
+   -DBASE64_STATS */
+static void print_codec_stats(void)
+{
+        struct codec_stats st[STATS_NCODECS];
+
+        if (codec_stats_snapshot(st) == -1) {
+                return;
+        }
+        fprintf(stderr, "\n%-8s %10s %14s %14s %8s %12s\n",
+                "codec", "calls", "bytes in", "bytes out", "invalid", "time (s)");
+        for (int c = 0; c < STATS_NCODECS; c++) {
+                if (st[c].calls == 0) {
+                        continue;
+                }
+                fprintf(stderr, "%-8s %10llu %14llu %14llu %8llu %12.6f\n",
+                        codec_stats_name(c), st[c].calls, st[c].bytes_in, st[c].bytes_out,
+                        st[c].invalid, (double)st[c].nsec / 1e9);
+                fprintf(stderr, "  latency:");
+                for (int b = 0; b < STATS_BUCKETS; b++) {
+                        if (st[c].hist[b] != 0) {
+                                fprintf(stderr, " <2^%d ns: %llu", b + 1, st[c].hist[b]);
+                        }
+                }
+                fputc('\n', stderr);
+        }
+}
+
+static int run_single(const struct cli_opts *o, const char *src, const char *dst)
+{
+        const char *prog = o->prog;
+        unsigned char mode = o->mode;
+        int decode = o->decode;
+        uint32_t crc = 0;
+        struct finfo *fd;
+        char *out = NULL;
+        size_t out_len, buf_len, bad = 0;
+        int rc;
+        double t0, t1, t2, t3;
+        int ofd = -1;
+        int status = EXIT_FAILURE;
+
+        t0 = now();
+        if ((fd = get_file(src)) == NULL) {
+                fprintf(stderr, "%s: %s: %s\n", prog, src, strerror(errno));
+                return EXIT_FAILURE;
+        }
+        t1 = now();
+        if ((buf_len = codec_buf_size(mode, decode, fd->size)) == 0 ||
+            (out = malloc(buf_len)) == NULL) {
+                perror(prog);
+                goto cleanup;
+        }
+        if (o->utf8) {
+                rc = codec_dec_utf8(mode, fd->addr, fd->size, out, &out_len, &bad);
+        } else if (o->crc) {
+                rc = codec_mem_crc(mode, decode, fd->addr, fd->size, out, &out_len, &crc);
+        } else {
+                rc = codec_mem_auto(mode, decode, fd->addr, fd->size, out, &out_len);
+        }
+        if (rc == -1) {
+                if (errno == EILSEQ) {
+                        fprintf(stderr, "%s: %s: invalid UTF-8 at byte %zu\n", prog, src, bad);
+                } else {
+                        fprintf(stderr, "%s: %s: %s\n", prog, src, strerror(errno));
+                }
+                goto cleanup;
+        }
+        t2 = now();
+        if ((ofd = open(dst, O_CREAT | O_WRONLY | O_TRUNC, S_IRUSR | S_IWUSR)) == -1) {
+                fprintf(stderr, "%s: %s: %s\n", prog, dst, strerror(errno));
+                goto cleanup;
+        }
+        for (size_t off = 0; off < out_len;) {
+                ssize_t wr = write(ofd, out + off, out_len - off);
+                if (wr < 0) {
+                        if (errno == EINTR) {
+                                continue;
+                        }
+                        fprintf(stderr, "%s: %s: %s\n", prog, dst, strerror(errno));
+                        goto cleanup;
+                }
+                off += (size_t)wr;
+        }
+        if (close(ofd) == -1) {
+                ofd = -1;
+                fprintf(stderr, "%s: %s: %s\n", prog, dst, strerror(errno));
+                goto cleanup;
+        }
+        ofd = -1;
+        t3 = now();
+        status = EXIT_SUCCESS;
+
+        if (o->crc && !o->utf8) {
+                printf("%08x  %s\n", crc, src);
+        }
+        if (o->stats) {
+                print_phase("load", t1 - t0, fd->size);
+                print_phase("codec", t2 - t1, fd->size);
+                print_phase("write", t3 - t2, out_len);
+                print_phase("total", t3 - t0, fd->size);
+                print_codec_stats();
+        }
+
+cleanup:
+        if (ofd != -1) {
+                close(ofd);
+        }
+        free(out);
+        free_finfo(fd);
+        return status;
+}
+
+static int run_cached(const struct cli_opts *o, const char *src, const char *dst)
+{
+        const char *max = getenv("B64_CACHE_MAX");
+        struct codec_cache *c;
+        double t0, t1;
+        int rc;
+
+        if ((c = codec_cache_open(o->cache, max ? strtoull(max, NULL, 10) : 0, 0)) == NULL) {
+                fprintf(stderr, "%s: %s: %s\n", o->prog, o->cache, strerror(errno));
+                return EXIT_FAILURE;
+        }
+        t0 = now();
+        rc = codec_cache_file(c, src, dst, o->mode, o->decode);
+        t1 = now();
+        if (rc == -1) {
+                fprintf(stderr, "%s: %s: %s\n", o->prog, src, strerror(errno));
+        } else if (o->stats) {
+                print_phase("total", t1 - t0, 0);
+        }
+        codec_cache_close(c);
+        return rc == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int run_append(const struct cli_opts *o, const char *src, const char *dst)
+{
+        double t0, t1;
+
+        if (o->decode) {
+                fprintf(stderr, "%s: -a: only the encoders append\n", o->prog);
+                return EXIT_FAILURE;
+        }
+        t0 = now();
+        if (encode_append_file(src, dst, o->mode) == -1) {
+                fprintf(stderr, "%s: %s: %s\n", o->prog, src, strerror(errno));
+                return EXIT_FAILURE;
+        }
+        t1 = now();
+        if (o->stats) {
+                print_phase("total", t1 - t0, 0);
+                print_codec_stats();
+        }
+        return EXIT_SUCCESS;
+}
+
+static int run_dump(const struct cli_opts *o, const char *src, const char *dst)
+{
+        int ifd = STDIN_FILENO, ofd = STDOUT_FILENO;
+        int status = EXIT_FAILURE;
+
+        if (o->mode != BASE16) {
+                fprintf(stderr, "%s: -x: dumps are base16 only\n", o->prog);
+                return EXIT_FAILURE;
+        }
+        if (strcmp(src, "-") != 0 && (ifd = open(src, O_RDONLY)) == -1) {
+                fprintf(stderr, "%s: %s: %s\n", o->prog, src, strerror(errno));
+                return EXIT_FAILURE;
+        }
+        if (strcmp(dst, "-") != 0 &&
+            (ofd = open(dst, O_CREAT | O_WRONLY | O_TRUNC, S_IRUSR | S_IWUSR)) == -1) {
+                fprintf(stderr, "%s: %s: %s\n", o->prog, dst, strerror(errno));
+                goto cleanup;
+        }
+        if ((o->decode ? b16_undump_fd(ifd, ofd)
+                       : b16_dump_fd(ifd, ofd, o->cols, o->group)) == -1) {
+                fprintf(stderr, "%s: %s: %s\n", o->prog, src, strerror(errno));
+                goto cleanup;
+        }
+        if (ofd != STDOUT_FILENO && close(ofd) == -1) {
+                ofd = STDOUT_FILENO;
+                fprintf(stderr, "%s: %s: %s\n", o->prog, dst, strerror(errno));
+                goto cleanup;
+        }
+        ofd = STDOUT_FILENO;
+        status = EXIT_SUCCESS;
+
+cleanup:
+        if (ifd != STDIN_FILENO) {
+                close(ifd);
+        }
+        if (ofd != STDOUT_FILENO) {
+                close(ofd);
+        }
+        return status;
+}
+
+static int run_pipe(const struct cli_opts *o, const char *src, const char *dst)
+{
+        int ifd = STDIN_FILENO, ofd = STDOUT_FILENO;
+        int status = EXIT_FAILURE;
+        double t0, t1;
+
+        if (strcmp(src, "-") != 0 && (ifd = open(src, O_RDONLY)) == -1) {
+                fprintf(stderr, "%s: %s: %s\n", o->prog, src, strerror(errno));
+                return EXIT_FAILURE;
+        }
+        if (strcmp(dst, "-") != 0 &&
+            (ofd = open(dst, O_CREAT | O_WRONLY | O_TRUNC, S_IRUSR | S_IWUSR)) == -1) {
+                fprintf(stderr, "%s: %s: %s\n", o->prog, dst, strerror(errno));
+                goto cleanup;
+        }
+        t0 = now();
+        if ((o->records ? codec_records(ifd, ofd, o->mode, o->decode, o->delim, o->nthreads) :
+             codec_pipe(ifd, ofd, o->mode, o->decode, o->nthreads)) == -1) {
+                fprintf(stderr, "%s: %s: %s\n", o->prog, src, strerror(errno));
+                goto cleanup;
+        }
+        t1 = now();
+        if (ofd != STDOUT_FILENO && close(ofd) == -1) {
+                ofd = STDOUT_FILENO;
+                fprintf(stderr, "%s: %s: %s\n", o->prog, dst, strerror(errno));
+                goto cleanup;
+        }
+        ofd = STDOUT_FILENO;
+        status = EXIT_SUCCESS;
+        if (o->stats) {
+                print_phase("total", t1 - t0, 0);
+                print_codec_stats();
+        }
+
+cleanup:
+        if (ifd != STDIN_FILENO) {
+                close(ifd);
+        }
+        if (ofd != STDOUT_FILENO) {
+                close(ofd);
+        }
+        return status;
+}
+
+static int run_batch(const struct cli_opts *o, int argc, char *argv[])
+{
+        const char *prog = o->prog;
+        const char *manifest = o->manifest;
+        unsigned char mode = o->mode;
+        int decode = o->decode;
+        struct job_list l = {NULL, 0, 0};
+        int from_stdin = manifest == NULL && argc == 0;
+        double t0, t1;
+        long failed;
+
+        for (int i = 0; i < argc; i++) {
+                if (strcmp(argv[i], "-") == 0) {
+                        from_stdin = 1;
+                } else if (add_job(&l, argv[i], NULL, mode, decode) == -1) {
+                        perror(prog);
+                        free_list(&l);
+                        return EXIT_FAILURE;
+                }
+        }
+        if (manifest != NULL) {
+                FILE *fp = fopen(manifest, "r");
+                if (fp == NULL || read_list(fp, &l, mode, decode) == -1) {
+                        fprintf(stderr, "%s: %s: %s\n", prog, manifest, strerror(errno));
+                        if (fp != NULL) {
+                                fclose(fp);
+                        }
+                        free_list(&l);
+                        return EXIT_FAILURE;
+                }
+                fclose(fp);
+        }
+        if (from_stdin && read_list(stdin, &l, mode, decode) == -1) {
+                fprintf(stderr, "%s: stdin: %s\n", prog, strerror(errno));
+                free_list(&l);
+                return EXIT_FAILURE;
+        }
+
+        t0 = now();
+        failed = batch_files(l.jobs, l.n, mode, (decode ? BATCH_DECODE : 0) |
+                             (o->crc ? BATCH_CRC : 0), o->nthreads);
+        t1 = now();
+        if (failed == -1) {
+                perror(prog);
+                free_list(&l);
+                return EXIT_FAILURE;
+        }
+        for (size_t i = 0; i < l.n; i++) {
+                if (l.jobs[i].err != 0) {
+                        fprintf(stderr, "%s: %s: %s\n", prog, l.jobs[i].src,
+                                strerror(l.jobs[i].err));
+                } else if (o->crc) {
+                        printf("%08x  %s\n", l.jobs[i].crc, l.jobs[i].src);
+                }
+        }
+        if (o->stats) {
+                fprintf(stderr, "%zu files, %ld failed\n", l.n, failed);
+                print_phase("total", t1 - t0, 0);
+                print_codec_stats();
+        }
+        free_list(&l);
+        return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* measure the codec variants on this machine and save the results */
+static int run_tune(const struct cli_opts *o)
+{
+        if (codec_tune(NULL) == -1) {
+                perror(o->prog);
+                return EXIT_FAILURE;
+        }
+        fprintf(stderr, "%12s %16s %16s\n", "size", "encode threads", "decode threads");
+        for (size_t len = 4096; len <= ((size_t)1 << 22); len *= 2) {
+                fprintf(stderr, "%12zu %16u %16u\n", len, codec_tune_threads(0, len),
+                        codec_tune_threads(1, len));
+        }
+        return EXIT_SUCCESS;
+}
+
+int cli_run(int argc, char *argv[], unsigned char mode, int decode)
+{
+        static const struct option longopts[] = {
+                {"stats", no_argument, NULL, 's'},
+                {"crc", no_argument, NULL, 'K'},
+                {"tune", no_argument, NULL, 't'},
+                {"cache", required_argument, NULL, 'C'},
+                {"utf8", no_argument, NULL, 'u'},
+                {"ascii85", no_argument, NULL, 'A'},
+                {"help", no_argument, NULL, 'h'},
+                {NULL, 0, NULL, 0}
+        };
+        struct cli_opts o = {argv[0], mode, decode, 0, 0, 0, '\n', 0, 0, 0, 0, 0, 0, 0, 0,
+                             NULL, NULL};
+        int opt;
+
+        while ((opt = getopt_long(argc, argv, "bpraxc:g:d:j:m:h", longopts, NULL)) != -1) {
+                switch (opt) {
+                        case 'b':
+                                o.batch = 1;
+                                break;
+                        case 'p':
+                                o.pipe = 1;
+                                break;
+                        case 'r':
+                                o.records = 1;
+                                break;
+                        case 'd':
+                                if ((o.delim = parse_delim(optarg)) == -1) {
+                                        fprintf(stderr, "%s: not a delimiter: %s\n", o.prog, optarg);
+                                        return EXIT_FAILURE;
+                                }
+                                break;
+                        case 'a':
+                                o.append = 1;
+                                break;
+                        case 'x':
+                                o.dump = 1;
+                                break;
+                        case 'c':
+                                o.cols = (unsigned int)strtoul(optarg, NULL, 10);
+                                break;
+                        case 'g':
+                                /* 0 means a single group, as in xxd */
+                                o.group = (unsigned int)strtoul(optarg, NULL, 10);
+                                if (o.group == 0) {
+                                        o.group = UINT_MAX;
+                                }
+                                break;
+                        case 'j':
+                                o.nthreads = (unsigned int)strtoul(optarg, NULL, 10);
+                                break;
+                        case 'm':
+                                o.manifest = optarg;
+                                o.batch = 1;
+                                break;
+                        case 's':
+                                o.stats = 1;
+                                break;
+                        case 'K':
+                                o.crc = 1;
+                                break;
+                        case 't':
+                                return run_tune(&o);
+                        case 'C':
+                                o.cache = optarg;
+                                break;
+                        case 'u':
+                                o.utf8 = decode;
+                                break;
+                        case 'A':
+                                if (mode == BASE85) {
+                                        o.mode = mode = ASCII85;
+                                }
+                                break;
+                        default:
+                                usage(o.prog, mode);
+                                return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+                }
+        }
+        if ((mode == BASE85 || mode == ASCII85) && (o.pipe || o.append || o.crc || o.utf8)) {
+                /* their groups vary in size, these modes cut the data in fixed ones */
+                fprintf(stderr, "%s: %s: not available for Base85\n", o.prog,
+                        o.pipe ? "-p" : o.append ? "-a" : o.crc ? "--crc" : "--utf8");
+                return EXIT_FAILURE;
+        }
+        if ((o.pipe || o.records) &&
+            (o.crc || o.utf8 || o.cache != NULL || o.batch || o.append || o.dump)) {
+                /* blocks are written as soon as they are coded, no pass sees the whole data */
+                fprintf(stderr, "%s: %s cannot be combined with %s\n", o.prog,
+                        o.records ? "-r" : "-p",
+                        o.crc ? "--crc" : o.utf8 ? "--utf8" : o.cache != NULL ? "--cache" :
+                        o.batch ? "-b" : o.append ? "-a" : "-x");
+                return EXIT_FAILURE;
+        }
+        if (o.cache != NULL && (o.crc || o.utf8 || o.batch || o.append || o.dump)) {
+                /* a hit is a copy of a stored result, nothing looks at the data */
+                fprintf(stderr, "%s: --cache cannot be combined with %s\n", o.prog,
+                        o.crc ? "--crc" : o.utf8 ? "--utf8" : o.batch ? "-b" :
+                        o.append ? "-a" : "-x");
+                return EXIT_FAILURE;
+        }
+        if (o.batch) {
+                return run_batch(&o, argc - optind, argv + optind);
+        }
+        if (argc - optind != 2) {
+                usage(o.prog, mode);
+                return EXIT_FAILURE;
+        }
+        if (o.pipe || o.records) {
+                return run_pipe(&o, argv[optind], argv[optind + 1]);
+        }
+        if (o.dump) {
+                return run_dump(&o, argv[optind], argv[optind + 1]);
+        }
+        if (o.append) {
+                return run_append(&o, argv[optind], argv[optind + 1]);
+        }
+        if (o.cache != NULL) {
+                return run_cached(&o, argv[optind], argv[optind + 1]);
+        }
+        return run_single(&o, argv[optind], argv[optind + 1]);
+}
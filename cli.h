@@ -0,0 +1,5 @@
+/*
+ * Command line options shared by the encoding/decoding utilities
+ * Copyright Orestes Leal Rodriguez 2015-2025
+ */
+int cli_run(int argc, char *argv[], unsigned char mode, int decode);
@@ -8,7 +8,18 @@
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+#include <signal.h>
+#include <dirent.h>
 #include "base64.h"
+#include "base64_inline.h"
 
 #define TEST_ASSERT(cond, msg) \
     do { \
@@ -200,6 +211,14 @@ int test_b64_invalid_input() {
     TEST_ASSERT(dec_len == 0, "Invalid Base64 should return 0");
     TEST_ASSERT(errno == EINVAL, "Invalid Base64 should set errno");
 
+    /* padding only completes the last quad */
+    errno = 0;
+    TEST_ASSERT(b64_dec((const unsigned char *)"QQ==QQ==", decoded, 8) == 0 && errno == EINVAL,
+                "Padding before the last quad");
+    errno = 0;
+    TEST_ASSERT(b64_dec((const unsigned char *)"QUJD" "QU=D", decoded, 8) == 0 && errno == EINVAL,
+                "Padding followed by data");
+
     printf("PASS: Invalid Base64 input test\n");
     return 0;
 }
@@ -266,6 +285,1495 @@ int test_b16_invalid_input() {
     return 0;
 }
 
+int test_batch_files() {
+    char dir[] = "/tmp/b64batchXXXXXX";
+    char src[4][64], enc[4][64], dec[4][64];
+    struct batch_job jobs[4];
+    char buf[256];
+
+    TEST_ASSERT(mkdtemp(dir) != NULL, "Batch temp dir");
+    for (int i = 0; i < 4; i++) {
+        snprintf(src[i], sizeof(src[i]), "%s/in%d", dir, i);
+        snprintf(enc[i], sizeof(enc[i]), "%s/in%d.b64", dir, i);
+        snprintf(dec[i], sizeof(dec[i]), "%s/out%d", dir, i);
+        if (i < 3) {
+            FILE *fp = fopen(src[i], "w");
+            TEST_ASSERT(fp != NULL, "Batch input file");
+            fprintf(fp, "file %d%.*s", i, i * 7, "0123456789abcdefghij");
+            fclose(fp);
+        }
+        jobs[i].src = src[i];
+        jobs[i].dst = enc[i];
+    }
+
+    /* the fourth input does not exist, the rest of the batch must succeed */
+    TEST_ASSERT(batch_files(jobs, 4, BASE64, 0, 3) == 1, "Batch encode failure count");
+    TEST_ASSERT(jobs[3].err == ENOENT, "Batch per-file error");
+    for (int i = 0; i < 3; i++) {
+        TEST_ASSERT(jobs[i].err == 0, "Batch encode error");
+        jobs[i].src = enc[i];
+        jobs[i].dst = dec[i];
+    }
+    TEST_ASSERT(batch_files(jobs, 3, BASE64, 1, 2) == 0, "Batch decode");
+    for (int i = 0; i < 3; i++) {
+        char expected[64];
+        FILE *fp = fopen(dec[i], "r");
+        TEST_ASSERT(fp != NULL, "Batch output file");
+        size_t n = fread(buf, 1, sizeof(buf), fp);
+        fclose(fp);
+        snprintf(expected, sizeof(expected), "file %d%.*s", i, i * 7, "0123456789abcdefghij");
+        TEST_ASSERT(n == strlen(expected) && memcmp(buf, expected, n) == 0,
+                    "Batch round-trip content");
+        unlink(src[i]);
+        unlink(enc[i]);
+        unlink(dec[i]);
+    }
+    rmdir(dir);
+
+    printf("PASS: Batch file test\n");
+    return 0;
+}
+
+int test_codec_stats() {
+    struct codec_stats st[STATS_NCODECS];
+    char out[64];
+
+    codec_stats_reset();
+    if (codec_stats_snapshot(st) == -1) {
+        TEST_ASSERT(errno == ENOSYS, "Stats disabled errno");
+        printf("PASS: Codec statistics test (compiled out)\n");
+        return 0;
+    }
+    b64_enc((const unsigned char *)"foobar", out, 6);
+    b64_dec((const unsigned char *)"Zm9v", out, 4);
+    b64_dec((const unsigned char *)"Zm9*", out, 4);
+    TEST_ASSERT(codec_stats_snapshot(st) == 0, "Stats snapshot");
+    TEST_ASSERT(st[STATS_B64_ENC].calls == 1, "Stats encode calls");
+    TEST_ASSERT(st[STATS_B64_ENC].bytes_out == 8, "Stats encode bytes out");
+    TEST_ASSERT(st[STATS_B64_DEC].calls == 2, "Stats decode calls");
+    TEST_ASSERT(st[STATS_B64_DEC].bytes_in == 8, "Stats decode bytes in");
+    TEST_ASSERT(st[STATS_B64_DEC].invalid == 1, "Stats invalid count");
+
+    printf("PASS: Codec statistics test\n");
+    return 0;
+}
+
+static size_t test_allocs, test_frees;
+
+static void *counting_alloc(size_t size, void *ctx) {
+    (void)ctx;
+    test_allocs++;
+    return malloc(size);
+}
+
+static void counting_free(void *ptr, size_t size, void *ctx) {
+    (void)size;
+    (void)ctx;
+    test_frees++;
+    free(ptr);
+}
+
+int test_allocator_arena() {
+    struct codec_allocator a = {counting_alloc, counting_free, NULL};
+    struct codec_arena *arena;
+    char input[300];
+    size_t out_len;
+    char *out;
+
+    memset(input, 'x', sizeof(input));
+    codec_set_allocator(&a);
+    arena = codec_arena_create();
+    TEST_ASSERT(arena != NULL, "Arena create");
+
+    out = codec_arena_mem(arena, BASE64, 0, input, sizeof(input), &out_len);
+    TEST_ASSERT(out != NULL && out_len == 400, "Arena encode");
+    size_t warm = test_allocs;
+    for (int i = 0; i < 100; i++) {
+        out = codec_arena_mem(arena, BASE64, 0, input, sizeof(input) - i, &out_len);
+        TEST_ASSERT(out != NULL, "Arena repeated encode");
+    }
+    TEST_ASSERT(test_allocs == warm, "Arena allocated in steady state");
+
+    out = codec_arena_mem(arena, BASE64, 1, "Zm9vYmFy", 8, &out_len);
+    TEST_ASSERT(out != NULL && out_len == 6 && memcmp(out, "foobar", 6) == 0, "Arena decode");
+    TEST_ASSERT(codec_arena_mem(arena, BASE64, 1, "Zm9*", 4, &out_len) == NULL, "Arena invalid");
+
+    codec_arena_destroy(arena);
+    codec_set_allocator(NULL);
+    TEST_ASSERT(test_allocs == test_frees, "Allocator calls balanced");
+
+    printf("PASS: Allocator and arena test\n");
+    return 0;
+}
+
+int test_b32_rfc4648_vectors() {
+    // RFC 4648 Section 10 test vectors
+    struct {
+        const char *input;
+        const char *expected;
+    } vectors[] = {
+        {"f", "MY======"},
+        {"fo", "MZXQ===="},
+        {"foo", "MZXW6==="},
+        {"foob", "MZXW6YQ="},
+        {"fooba", "MZXW6YTB"},
+        {"foobar", "MZXW6YTBOI======"},
+    };
+
+    for (size_t i = 0; i < sizeof(vectors)/sizeof(vectors[0]); i++) {
+        char encoded[64];
+        char decoded[64];
+
+        b32_enc((unsigned char*)vectors[i].input, (unsigned char*)encoded, strlen(vectors[i].input));
+        TEST_ASSERT(strcmp(encoded, vectors[i].expected) == 0, "Base32 RFC vector encoding");
+
+        errno = 0;
+        unsigned int dec_len = b32_dec((unsigned char*)encoded, decoded, strlen(encoded));
+        TEST_ASSERT(errno == 0, "Base32 RFC vector decode errno");
+        TEST_ASSERT(dec_len == strlen(vectors[i].input), "Base32 RFC vector decode length");
+        TEST_ASSERT(memcmp(vectors[i].input, decoded, dec_len) == 0, "Base32 RFC vector round-trip");
+    }
+
+    printf("PASS: Base32 RFC 4648 test vectors\n");
+    return 0;
+}
+
+int test_validate() {
+    const char *b64 = "SGVsbG8sIFdvcmxkISBUaGlzIGlzIGEgbG9uZ2VyIHN0cmluZw==\r\n";
+    unsigned int size, bad;
+
+    TEST_ASSERT(b64_validate((const unsigned char *)b64, strlen(b64), &size, &bad) == 0,
+                "Valid Base64 rejected");
+    TEST_ASSERT(size == strlen("Hello, World! This is a longer string"), "Base64 validated size");
+
+    errno = 0;
+    TEST_ASSERT(b64_validate((const unsigned char *)"SGVsbG8sIFdvcmxkIS*UaGlz", 24, &size, &bad) == -1,
+                "Invalid Base64 accepted");
+    TEST_ASSERT(errno == EINVAL && bad == 18, "Base64 bad offset");
+    TEST_ASSERT(b64_validate((const unsigned char *)"Zm9vYmE", 7, NULL, &bad) == -1 && bad == 7,
+                "Truncated Base64 offset");
+    TEST_ASSERT(b64_validate((const unsigned char *)"QQ==QUJD", 8, NULL, &bad) == -1 && bad == 2,
+                "Base64 inner padding offset");
+    TEST_ASSERT(b64_validate((const unsigned char *)"QUJDQU=D", 8, NULL, &bad) == -1 && bad == 7,
+                "Base64 padding followed by data");
+
+    TEST_ASSERT(b32_validate((const unsigned char *)"MZXW6YQ=", 8, &size, NULL) == 0 && size == 4,
+                "Base32 validated size");
+    TEST_ASSERT(b32_validate((const unsigned char *)"MZXW6YQ==", 9, NULL, &bad) == -1,
+                "Base32 bad padding accepted");
+    TEST_ASSERT(b32_validate((const unsigned char *)"MZXW1YQ=", 8, NULL, &bad) == -1 && bad == 4,
+                "Base32 bad offset");
+
+    TEST_ASSERT(b16_validate("00ffAa7e", 8, &size, NULL) == 0 && size == 4, "Base16 validated size");
+    TEST_ASSERT(b16_validate("00112233445566778899aabbccddeeGf", 32, NULL, &bad) == -1 && bad == 30,
+                "Base16 bad offset");
+
+    printf("PASS: Validation test\n");
+    return 0;
+}
+
+int test_b64_dec_range() {
+    unsigned char data[1000];
+    char encoded[2000], wrapped[2100], out[1100];
+    size_t enc_len, wr_len = 0, got;
+    struct b64_index *idx, *loaded;
+
+    for (int i = 0; i < 1000; i++) {
+        data[i] = (unsigned char)(i * 7 + 3);
+    }
+    b64_enc(data, encoded, 1000);
+    enc_len = strlen(encoded);
+    for (size_t i = 0; i < enc_len; i++) {
+        if (i > 0 && i % 76 == 0) {
+            wrapped[wr_len++] = '\r';
+            wrapped[wr_len++] = '\n';
+        }
+        wrapped[wr_len++] = encoded[i];
+    }
+
+    got = b64_dec_range((unsigned char *)encoded, enc_len, 500, 100, out);
+    TEST_ASSERT(got == 100 && memcmp(out, data + 500, 100) == 0, "Range decode middle");
+    got = b64_dec_range((unsigned char *)encoded, enc_len, 998, 10, out);
+    TEST_ASSERT(got == 2 && memcmp(out, data + 998, 2) == 0, "Range decode past the end");
+
+    idx = b64_index_build((unsigned char *)wrapped, wr_len, 64);
+    TEST_ASSERT(idx != NULL && b64_index_size(idx) == 1000, "Index build");
+    TEST_ASSERT(b64_index_save(idx, "/tmp/test_b64_index") == 0, "Index save");
+    loaded = b64_index_load("/tmp/test_b64_index");
+    unlink("/tmp/test_b64_index");
+    TEST_ASSERT(loaded != NULL, "Index load");
+    got = b64_dec_range_idx((unsigned char *)wrapped, wr_len, loaded, 301, 400, out);
+    TEST_ASSERT(got == 400 && memcmp(out, data + 301, 400) == 0, "Indexed range decode");
+
+    b64_index_free(idx);
+    b64_index_free(loaded);
+    printf("PASS: Range decoding test\n");
+    return 0;
+}
+
+int test_crc32c() {
+    static unsigned char data[20000];
+    static char encoded[30000], decoded[20001];
+    uint32_t enc_crc, dec_crc;
+    size_t n;
+
+    TEST_ASSERT(crc32c(0, "123456789", 9) == 0xE3069283, "CRC32C check value");
+    TEST_ASSERT(crc32c(crc32c(0, "1234", 4), "56789", 5) == 0xE3069283, "CRC32C continuation");
+
+    for (int i = 0; i < (int)sizeof(data); i++) {
+        data[i] = (unsigned char)(i * 31 + (i >> 7));
+    }
+    b64_enc_crc(data, encoded, sizeof(data), &enc_crc);
+    TEST_ASSERT(enc_crc == crc32c(0, data, sizeof(data)), "Fused encode CRC");
+
+    errno = 0;
+    unsigned int dec_len = b64_dec_crc((unsigned char *)encoded, decoded, strlen(encoded), &dec_crc);
+    TEST_ASSERT(errno == 0 && dec_len == sizeof(data), "Fused decode length");
+    TEST_ASSERT(memcmp(data, decoded, dec_len) == 0, "Fused decode content");
+    TEST_ASSERT(dec_crc == enc_crc, "Fused decode CRC");
+
+    TEST_ASSERT(codec_mem_crc(BASE32, 0, (char *)data, 1234, encoded, &n, &enc_crc) == 0, "Base32 fused encode");
+    TEST_ASSERT(codec_mem_crc(BASE32, 1, encoded, n, decoded, &n, &dec_crc) == 0, "Base32 fused decode");
+    TEST_ASSERT(n == 1234 && enc_crc == dec_crc && enc_crc == crc32c(0, data, 1234), "Base32 fused CRC");
+
+    printf("PASS: CRC32C test\n");
+    return 0;
+}
+
+int test_inline_fixed_sizes() {
+    static const unsigned int sizes[] = {16, 20, 32, 64};
+    unsigned char data[64], decoded[64];
+    char expected[100], encoded[100];
+
+    for (int round = 0; round < 50; round++) {
+        for (int i = 0; i < 64; i++) {
+            data[i] = (unsigned char)(round * 53 + i * 97 + (i >> 2));
+        }
+        for (int k = 0; k < 4; k++) {
+            unsigned int n = sizes[k];
+            int rc;
+
+            b64_enc(data, expected, n);
+            switch (n) {
+            case 16: b64_enc16(data, encoded); rc = b64_dec16(encoded, decoded); break;
+            case 20: b64_enc20(data, encoded); rc = b64_dec20(encoded, decoded); break;
+            case 32: b64_enc32(data, encoded); rc = b64_dec32(encoded, decoded); break;
+            default: b64_enc64(data, encoded); rc = b64_dec64(encoded, decoded); break;
+            }
+            TEST_ASSERT(strcmp(encoded, expected) == 0, "Inline encode matches b64_enc");
+            TEST_ASSERT(rc == 0 && memcmp(data, decoded, n) == 0, "Inline round-trip");
+        }
+    }
+
+    b64_enc20(data, encoded);
+    encoded[27] = 'A';          /* padding replaced */
+    errno = 0;
+    TEST_ASSERT(b64_dec20(encoded, decoded) == -1 && errno == EINVAL, "Inline bad padding");
+    b64_enc32(data, encoded);
+    encoded[5] = '*';
+    TEST_ASSERT(b64_dec32(encoded, decoded) == -1, "Inline invalid character");
+
+    printf("PASS: Inline fixed-size test\n");
+    return 0;
+}
+
+static void count_done(struct codec_job *job) {
+    __atomic_add_fetch((int *)job->arg, 1, __ATOMIC_RELAXED);
+}
+
+/* holds the pool thread until '*job->arg' is set */
+static void gate_done(struct codec_job *job) {
+    while (!__atomic_load_n((int *)job->arg, __ATOMIC_ACQUIRE)) {
+        usleep(1000);
+    }
+}
+
+/* wait for 'n' completions on an eventfd */
+static void wait_jobs(int efd, int n) {
+    uint64_t v;
+
+    while (n > 0 && read(efd, &v, sizeof(v)) == sizeof(v)) {
+        n -= (int)v;
+    }
+}
+
+int test_async_pool() {
+    size_t len = 3 * 1000 * 1000 + 7;
+    unsigned char *data = malloc(len);
+    char *encoded = malloc(codec_buf_size(BASE64, 0, len));
+    char *decoded = malloc(len + 1);
+    char *expected = malloc(codec_buf_size(BASE64, 0, len));
+    struct codec_job enc = {0}, dec = {0}, small[64], *ptrs[64];
+    char small_out[64][16];
+    struct codec_pool *pool;
+    int efd = eventfd(0, 0), done = 0, gate = 0;
+
+    TEST_ASSERT(data && encoded && decoded && expected && efd != -1, "Async setup");
+    for (size_t i = 0; i < len; i++) {
+        data[i] = (unsigned char)(i * 131 + (i >> 9));
+    }
+    b64_enc(data, expected, (unsigned int)len);
+
+    pool = codec_pool_create(4, 2);
+    TEST_ASSERT(pool != NULL, "Pool create");
+
+    /* a job larger than the queue is cut in pieces and waits for room */
+    enc.mode = BASE64;
+    enc.in = (char *)data;
+    enc.len = len;
+    enc.out = encoded;
+    enc.done = count_done;
+    enc.arg = &done;
+    enc.efd = efd;
+    TEST_ASSERT(codec_pool_submit(pool, &enc, 0) == 0, "Submit encode");
+    wait_jobs(efd, 1);
+    TEST_ASSERT(enc.err == 0 && enc.out_len == strlen(expected), "Async encode length");
+    TEST_ASSERT(strcmp(encoded, expected) == 0, "Async encode matches b64_enc");
+
+    dec.mode = BASE64;
+    dec.decode = 1;
+    dec.in = encoded;
+    dec.len = enc.out_len;
+    dec.out = decoded;
+    dec.efd = efd;
+    TEST_ASSERT(codec_pool_submit(pool, &dec, 0) == 0, "Submit decode");
+    wait_jobs(efd, 1);
+    TEST_ASSERT(dec.err == 0 && dec.out_len == len, "Async decode length");
+    TEST_ASSERT(memcmp(decoded, data, len) == 0, "Async decode content");
+
+    /* an invalid character far from the end fails the whole job */
+    encoded[2000000] = '*';
+    TEST_ASSERT(codec_pool_submit(pool, &dec, 0) == 0, "Submit bad decode");
+    wait_jobs(efd, 1);
+    TEST_ASSERT(dec.err == EINVAL, "Async decode rejects bad input");
+
+    /* small jobs are queued together */
+    for (int i = 0; i < 64; i++) {
+        memset(&small[i], 0, sizeof(small[i]));
+        small[i].mode = (unsigned char)(BASE64 + i % 3);
+        small[i].in = (char *)data + i;
+        small[i].len = 5;
+        small[i].out = small_out[i];
+        small[i].done = count_done;
+        small[i].arg = &done;
+        small[i].efd = efd;
+        ptrs[i] = &small[i];
+    }
+    TEST_ASSERT(codec_pool_submit_many(pool, ptrs, 64, 0) == 0, "Submit many");
+    wait_jobs(efd, 64);
+    TEST_ASSERT(__atomic_load_n(&done, __ATOMIC_RELAXED) == 65, "Callbacks called");
+    for (int i = 0; i < 64; i++) {
+        char want[16];
+        size_t n;
+        codec_mem(small[i].mode, 0, (char *)data + i, 5, want, &n);
+        TEST_ASSERT(small[i].err == 0 && strcmp(small_out[i], want) == 0, "Small async jobs");
+    }
+
+    /* a job with more pieces than the queue holds never fits */
+    errno = 0;
+    TEST_ASSERT(codec_pool_submit(pool, &enc, CODEC_NOWAIT) == -1 && errno == EMSGSIZE,
+                "Non-blocking submit of an oversize job");
+    codec_pool_destroy(pool);
+
+    /* the only thread is held in the callback of the first job while the
+       next two fill the queue, the jobs are large enough to be taken from
+       the queue one at a time */
+    pool = codec_pool_create(1, 2);
+    TEST_ASSERT(pool != NULL, "Pool create");
+    for (int i = 0; i < 4; i++) {
+        small[i].mode = BASE64;
+        small[i].decode = 0;
+        small[i].in = (char *)data;
+        small[i].len = 300000;
+        small[i].out = encoded + (size_t)i * 400008;
+        small[i].done = i == 0 ? gate_done : NULL;
+        small[i].arg = &gate;
+        small[i].efd = efd;
+    }
+    for (int i = 0; i < 3; i++) {
+        TEST_ASSERT(codec_pool_submit(pool, &small[i], 0) == 0, "Submit while held");
+    }
+    errno = 0;
+    TEST_ASSERT(codec_pool_submit(pool, &small[3], CODEC_NOWAIT) == -1 && errno == EAGAIN,
+                "Non-blocking submit on a full queue");
+    __atomic_store_n(&gate, 1, __ATOMIC_RELEASE);
+    wait_jobs(efd, 3);
+
+    codec_pool_destroy(pool);
+    close(efd);
+    free(data);
+    free(encoded);
+    free(decoded);
+    free(expected);
+    printf("PASS: Async pool test\n");
+    return 0;
+}
+
+int test_nt_stores() {
+    static const size_t sizes[] = {5121, 20000, 100003};
+    size_t len = 100003, n, m;
+    char *data = malloc(len), *plain = malloc(2 * len + 1), *nt = malloc(2 * len + 1);
+    char *back = malloc(len + 1);
+
+    TEST_ASSERT(data && plain && nt && back, "Non-temporal setup");
+    for (size_t i = 0; i < len; i++) {
+        data[i] = (char)(i * 7 + (i >> 5));
+    }
+    for (unsigned char mode = BASE64; mode <= BASE16; mode++) {
+        for (int k = 0; k < 3; k++) {
+            codec_set_nt_threshold(0);
+            TEST_ASSERT(codec_mem(mode, 0, data, sizes[k], plain, &n) == 0, "Cached encode");
+            codec_set_nt_threshold(1);
+            TEST_ASSERT(codec_mem(mode, 0, data, sizes[k], nt, &m) == 0, "Streaming encode");
+            TEST_ASSERT(n == m && strcmp(plain, nt) == 0, "Streaming encode matches");
+            if (mode != BASE16) {
+                plain[n++] = '\n';     /* trimmed before the blocks are cut */
+            }
+            TEST_ASSERT(codec_mem(mode, 1, plain, n, back, &m) == 0, "Streaming decode");
+            TEST_ASSERT(m == sizes[k] && memcmp(back, data, m) == 0, "Streaming decode matches");
+        }
+    }
+
+    /* padding before the last quad is rejected by both paths, at a block
+       end and inside a block */
+    codec_mem(BASE64, 0, data, 10000, plain, &n);
+    for (size_t at = 5116; at <= 5124; at += 8) {
+        char keep[4];
+        memcpy(keep, plain + at, 4);
+        memcpy(plain + at, "AA==", 4);
+        for (int nt_on = 0; nt_on < 2; nt_on++) {
+            codec_set_nt_threshold(nt_on ? 1 : 0);
+            errno = 0;
+            TEST_ASSERT(codec_mem(BASE64, 1, plain, n, back, &m) == -1 && errno == EINVAL,
+                        "Decode rejects inner padding");
+        }
+        memcpy(plain + at, keep, 4);
+    }
+    codec_set_nt_threshold(SIZE_MAX);
+
+    free(data);
+    free(plain);
+    free(nt);
+    free(back);
+    printf("PASS: Non-temporal store test\n");
+    return 0;
+}
+
+int test_iovec() {
+    unsigned char data[600];
+    char whole[1300], gathered[1300], back[700];
+    struct iovec iov[16];
+    size_t n, m;
+
+    for (int i = 0; i < (int)sizeof(data); i++) {
+        data[i] = (unsigned char)(i * 37 + 11);
+    }
+    srand(7);
+    for (int round = 0; round < 300; round++) {
+        unsigned char mode = (unsigned char)(BASE64 + round % 3);
+        size_t len = (size_t)rand() % sizeof(data), off = 0;
+        int cnt = 0;
+
+        /* random segments, some of them empty */
+        while (off < len && cnt < 15) {
+            size_t k = (size_t)rand() % 9;
+            k = k > len - off ? len - off : k;
+            iov[cnt].iov_base = data + off;
+            iov[cnt++].iov_len = k;
+            off += k;
+        }
+        iov[cnt].iov_base = data + off;
+        iov[cnt++].iov_len = len - off;
+
+        codec_mem(mode, 0, (char *)data, len, whole, &n);
+        TEST_ASSERT(codec_memv(mode, 0, iov, cnt, gathered, &m) == 0, "Gathered encode");
+        TEST_ASSERT(m == n && strcmp(whole, gathered) == 0, "Gathered encode matches");
+
+        /* decode the encoded text cut at odd places */
+        for (int i = 0, o = 0; i < 3; i++) {
+            int cut = i == 2 ? (int)n - o : (int)(n / 3) + i;
+            iov[i].iov_base = whole + o;
+            iov[i].iov_len = (size_t)cut;
+            o += cut;
+        }
+        iov[3].iov_base = "\r\n";
+        iov[3].iov_len = mode == BASE16 ? 0 : 2;
+        TEST_ASSERT(codec_memv(mode, 1, iov, 4, back, &m) == 0, "Gathered decode");
+        TEST_ASSERT(m == len && memcmp(back, data, len) == 0, "Gathered decode matches");
+    }
+
+    iov[0].iov_base = "TWFu";
+    iov[0].iov_len = 4;
+    iov[1].iov_base = "TW=";
+    iov[1].iov_len = 3;
+    iov[2].iov_base = "=";
+    iov[2].iov_len = 1;
+    TEST_ASSERT(b64_decv(iov, 3, back) == 4 && memcmp(back, "ManM", 4) == 0, "b64_decv");
+    iov[1].iov_base = "T*==";
+    errno = 0;
+    TEST_ASSERT(b64_decv(iov, 2, back) == 0 && errno == EINVAL, "b64_decv rejects bad input");
+    iov[0].iov_base = "Ma";
+    iov[0].iov_len = 2;
+    iov[1].iov_base = "n";
+    iov[1].iov_len = 1;
+    TEST_ASSERT(b64_encv(iov, 2, gathered) == 4 && strcmp(gathered, "TWFu") == 0, "b64_encv");
+    TEST_ASSERT(b32_encv(iov, 2, gathered) == 8 && strcmp(gathered, "JVQW4===") == 0, "b32_encv");
+
+    printf("PASS: Scatter/gather test\n");
+    return 0;
+}
+
+int test_mmap_output() {
+    char dir[] = "/tmp/b64mmapXXXXXX";
+    char src[64], enc[64], dec[64];
+    size_t len = (2 << 20) + 5, n;
+    char *data = malloc(len), *expected = malloc(codec_buf_size(BASE32, 0, len));
+    struct finfo *fi;
+    struct stat st;
+    FILE *fp;
+
+    TEST_ASSERT(data && expected && mkdtemp(dir) != NULL, "Mapped output setup");
+    snprintf(src, sizeof(src), "%s/in", dir);
+    snprintf(enc, sizeof(enc), "%s/in.b32", dir);
+    snprintf(dec, sizeof(dec), "%s/out", dir);
+    for (size_t i = 0; i < len; i++) {
+        data[i] = (char)(i * 13 + (i >> 10));
+    }
+    fp = fopen(src, "w");
+    TEST_ASSERT(fp != NULL && fwrite(data, 1, len, fp) == len, "Mapped output input file");
+    fclose(fp);
+
+    /* the output file is sized exactly, without the null terminator */
+    TEST_ASSERT(encode_wr_file(src, enc, BASE32) == 0, "Mapped encode");
+    codec_mem(BASE32, 0, data, len, expected, &n);
+    fi = get_file(enc);
+    TEST_ASSERT(fi != NULL && fi->size == n && memcmp(fi->addr, expected, n) == 0,
+                "Mapped encode content");
+    free_finfo(fi);
+
+    TEST_ASSERT(decode_rd_file(enc, dec, BASE32) == 0, "Mapped decode");
+    fi = get_file(dec);
+    TEST_ASSERT(fi != NULL && fi->size == len && memcmp(fi->addr, data, len) == 0,
+                "Mapped decode content");
+    free_finfo(fi);
+
+    /* invalid input is rejected and an existing output is left as it was */
+    fp = fopen(dec, "w");
+    TEST_ASSERT(fp != NULL && fputs("previous content", fp) >= 0, "Mapped output victim");
+    fclose(fp);
+    chmod(dec, 0640);
+    errno = 0;
+    TEST_ASSERT(decode_rd_file(src, dec, BASE64) == -1 && errno == EINVAL, "Mapped decode rejects bad input");
+    fi = get_file(dec);
+    TEST_ASSERT(fi != NULL && fi->size == 16 && memcmp(fi->addr, "previous content", 16) == 0,
+                "Failed decode keeps the output");
+    free_finfo(fi);
+
+    /* a replaced output keeps its permissions */
+    TEST_ASSERT(encode_wr_file(src, dec, BASE32) == 0, "Mapped encode over a file");
+    TEST_ASSERT(stat(dec, &st) == 0 && (st.st_mode & 0777) == 0640 && (size_t)st.st_size == n,
+                "Mapped encode keeps the mode");
+
+    /* outputs that can't be mapped are written */
+    TEST_ASSERT(encode_wr_file(src, "/dev/null", BASE64) == 0, "Unmappable output");
+
+    unlink(src);
+    unlink(enc);
+    unlink(dec);
+    rmdir(dir);
+    free(data);
+    free(expected);
+    printf("PASS: Mapped output test\n");
+    return 0;
+}
+
+/* run codec_pipe, or codec_records when 'delim' is not -1, from 'in' to
+   a temporary file and load the result */
+static struct finfo *pipe_file(const char *in, size_t len, unsigned char mode, int decode,
+                               int delim, unsigned int workers) {
+    char src[] = "/tmp/b64pipeXXXXXX", dst[] = "/tmp/b64pipeXXXXXX";
+    int ifd = mkstemp(src), ofd = mkstemp(dst);
+    struct finfo *fi = NULL;
+
+    if (ifd != -1 && ofd != -1 && write(ifd, in, len) == (ssize_t)len &&
+        lseek(ifd, 0, SEEK_SET) == 0 &&
+        (delim == -1 ? codec_pipe(ifd, ofd, mode, decode, workers) :
+         codec_records(ifd, ofd, mode, decode, delim, workers)) == 0) {
+        fi = get_file(dst);
+    }
+    close(ifd);
+    close(ofd);
+    unlink(src);
+    unlink(dst);
+    return fi;
+}
+
+int test_mem_policy() {
+    char src[] = "/tmp/b64memXXXXXX", dst[] = "/tmp/b64memXXXXXX";
+    int policies[] = {0, MEM_DEFAULT, MEM_DEFAULT | MEM_HUGETLB, MEM_READAHEAD};
+    size_t len = (5 << 20) + 7, n;
+    char *data = malloc(len), *expected = malloc(codec_buf_size(BASE64, 0, len));
+    int sfd = mkstemp(src), dfd = mkstemp(dst);
+    struct finfo *fi;
+
+    TEST_ASSERT(data && expected && sfd != -1 && dfd != -1, "Memory policy setup");
+    for (size_t i = 0; i < len; i++) {
+        data[i] = (char)(i * 7 + (i >> 12));
+    }
+    TEST_ASSERT(write(sfd, data, len) == (ssize_t)len, "Memory policy input");
+    close(sfd);
+    close(dfd);
+    codec_mem(BASE64, 0, data, len, expected, &n);
+
+    /* large buffers, whatever the policy, and freed after a change of it */
+    for (int k = 0; k < 4; k++) {
+        codec_set_mem_policy(policies[k]);
+        TEST_ASSERT(encode_wr_file(src, dst, BASE64) == 0, "Memory policy encode");
+        fi = get_file(dst);
+        TEST_ASSERT(fi != NULL && fi->size == n && memcmp(fi->addr, expected, n) == 0,
+                    "Memory policy encode content");
+        codec_set_mem_policy(policies[(k + 1) % 4]);
+        free_finfo(fi);
+        fi = get_file(src);
+        TEST_ASSERT(fi != NULL && fi->size == len && memcmp(fi->addr, data, len) == 0,
+                    "Memory policy load");
+        free_finfo(fi);
+    }
+    codec_set_mem_policy(MEM_DEFAULT);
+
+    unlink(src);
+    unlink(dst);
+    free(data);
+    free(expected);
+    printf("PASS: Memory policy test\n");
+    return 0;
+}
+
+int test_pipeline() {
+    size_t len = 1000003, n;
+    char *data = malloc(len), *expected = malloc(codec_buf_size(BASE16, 0, len));
+    struct finfo *fi, *back;
+
+    TEST_ASSERT(data && expected, "Pipeline setup");
+    for (size_t i = 0; i < len; i++) {
+        data[i] = (char)(i * 29 + (i >> 8));
+    }
+    for (unsigned int workers = 1; workers <= 3; workers++) {
+        for (unsigned char mode = BASE64; mode <= BASE16; mode++) {
+            codec_mem(mode, 0, data, len, expected, &n);
+            fi = pipe_file(data, len, mode, 0, -1, workers);
+            TEST_ASSERT(fi != NULL && fi->size == n && memcmp(fi->addr, expected, n) == 0,
+                        "Pipeline encode");
+            back = pipe_file(fi->addr, fi->size, mode, 1, -1, workers);
+            TEST_ASSERT(back != NULL && back->size == len && memcmp(back->addr, data, len) == 0,
+                        "Pipeline decode");
+            free_finfo(fi);
+            free_finfo(back);
+        }
+    }
+
+    /* padding and line breaks right after a block boundary */
+    codec_mem(BASE64, 0, data, 196607, expected, &n);
+    memcpy(expected + n, "\r\n", 2);
+    back = pipe_file(expected, n + 2, BASE64, 1, -1, 2);
+    TEST_ASSERT(back != NULL && back->size == 196607 && memcmp(back->addr, data, 196607) == 0,
+                "Pipeline decode with padding at a block boundary");
+    free_finfo(back);
+
+    expected[5000] = '*';
+    TEST_ASSERT(pipe_file(expected, n, BASE64, 1, -1, 2) == NULL, "Pipeline rejects bad input");
+
+    free(data);
+    free(expected);
+    printf("PASS: Pipeline test\n");
+    return 0;
+}
+
+int test_records() {
+    size_t cap = 3 << 20, len = 0, n, m;
+    char *data = malloc(cap), *expected = malloc(4 * cap);
+    struct finfo *fi, *back;
+
+    TEST_ASSERT(data && expected, "Records setup");
+    /* records of 0 to 299 bytes spanning several blocks, without a final
+       delimiter */
+    for (size_t i = 0; len + 300 < cap; i++) {
+        size_t rlen = (i * 37) % 300;
+        for (size_t k = 0; k < rlen; k++) {
+            data[len + k] = (char)('a' + (i + k) % 26);
+        }
+        len += rlen;
+        data[len++] = '\n';
+    }
+    len--;
+    for (unsigned char mode = BASE64; mode <= ASCII85; mode++) {
+        const char *s = data, *end = data + len, *d;
+        n = 0;
+        do {
+            d = memchr(s, '\n', (size_t)(end - s));
+            codec_mem(mode, 0, s, (size_t)((d ? d : end) - s), expected + n, &m);
+            n += m;
+            if (d != NULL) {
+                expected[n++] = '\n';
+            }
+            s = d + 1;
+        } while (d != NULL);
+        fi = pipe_file(data, len, mode, 0, '\n', 3);
+        TEST_ASSERT(fi != NULL && fi->size == n && memcmp(fi->addr, expected, n) == 0,
+                    "Records encode");
+        back = pipe_file(fi->addr, fi->size, mode, 1, '\n', 2);
+        TEST_ASSERT(back != NULL && back->size == len && memcmp(back->addr, data, len) == 0,
+                    "Records decode");
+        free_finfo(fi);
+        free_finfo(back);
+    }
+
+    /* other delimiters, CRLF lines and empty records */
+    fi = pipe_file("ab,,c,", 6, BASE64, 0, ',', 1);
+    TEST_ASSERT(fi != NULL && fi->size == 11 && memcmp(fi->addr, "YWI=,,Yw==,", 11) == 0,
+                "Records with another delimiter");
+    free_finfo(fi);
+    fi = pipe_file("YWI=\r\nYw==\r\n", 12, BASE64, 1, '\n', 1);
+    TEST_ASSERT(fi != NULL && fi->size == 5 && memcmp(fi->addr, "ab\nc\n", 5) == 0,
+                "Records decode CRLF lines");
+    free_finfo(fi);
+
+    /* a bad record fails the stream, so does one longer than a block */
+    TEST_ASSERT(pipe_file("YWI=\nY*==\n", 10, BASE64, 1, '\n', 2) == NULL, "Records reject bad input");
+    memset(data, 'a', 1100000);
+    errno = 0;
+    TEST_ASSERT(pipe_file(data, 1100000, BASE64, 0, '\n', 2) == NULL && errno == EMSGSIZE,
+                "Records reject a record longer than a block");
+    errno = 0;
+    TEST_ASSERT(codec_records(0, 1, BASE64, 0, 256, 1) == -1 && errno == EINVAL,
+                "Records reject a bad delimiter");
+
+    free(data);
+    free(expected);
+    printf("PASS: Records test\n");
+    return 0;
+}
+
+int test_autotune() {
+    char path[] = "/tmp/b64tuneXXXXXX", line[512], *tab;
+    size_t len = 300001, n, m;
+    char *data = malloc(len), *plain = malloc(2 * len + 1), *tunedbuf = malloc(2 * len + 1);
+    FILE *fp;
+    int fd = mkstemp(path);
+
+    TEST_ASSERT(fd != -1 && data && plain && tunedbuf, "Autotune setup");
+    close(fd);
+    unlink(path);
+    setenv("B64_TUNE_CACHE", path, 1);
+    for (size_t i = 0; i < len; i++) {
+        data[i] = (char)(i * 17 + (i >> 6));
+    }
+
+    /* in a new process: without a cache nothing is measured or written,
+       then only codec_tune measures and creates the cache */
+    pid_t pid = fork();
+    if (pid == 0) {
+        char *buf = malloc(2 * len + 1);
+        int rc = buf != NULL && codec_tune_threads(0, len) == 1 &&
+                 codec_mem_auto(BASE64, 0, data, len, buf, &n) == 0 && access(path, F_OK) == -1 &&
+                 codec_tune(path) == 0 && access(path, F_OK) == 0;
+        _exit(rc ? 0 : 1);
+    }
+    TEST_ASSERT(pid > 0 && waitpid(pid, &fd, 0) == pid && WIFEXITED(fd) && WEXITSTATUS(fd) == 0,
+                "Autotune only in codec_tune");
+
+    /* force four threads everywhere in the cache line of this cpu, it is
+       what codec_mem_auto loads on first use */
+    fp = fopen(path, "r");
+    TEST_ASSERT(fp != NULL && fgets(line, sizeof(line), fp) != NULL, "Autotune cache line");
+    fclose(fp);
+    tab = strchr(line, '\t');
+    TEST_ASSERT(tab != NULL, "Autotune cache key");
+    tab = strchr(tab, ' ');
+    TEST_ASSERT(tab != NULL, "Autotune cache table");
+    for (char *p = tab; *p != '\0' && *p != '\n'; p++) {
+        if (*p >= '0' && *p <= '9') {
+            *p = '4';
+        }
+    }
+    fp = fopen(path, "w");
+    TEST_ASSERT(fp != NULL, "Autotune cache rewrite");
+    fputs(line, fp);
+    fclose(fp);
+    TEST_ASSERT(codec_tune_threads(0, len) == 4 && codec_tune_threads(1, 100) == 1,
+                "Autotune table loaded");
+
+    for (unsigned char mode = BASE64; mode <= BASE16; mode++) {
+        size_t sizes[] = {len, 4099, 70000};
+        for (int k = 0; k < 3; k++) {
+            codec_mem(mode, 0, data, sizes[k], plain, &n);
+            TEST_ASSERT(codec_mem_auto(mode, 0, data, sizes[k], tunedbuf, &m) == 0, "Tuned encode");
+            TEST_ASSERT(m == n && strcmp(plain, tunedbuf) == 0, "Tuned encode matches");
+            TEST_ASSERT(codec_mem_auto(mode, 1, plain, n, tunedbuf, &m) == 0, "Tuned decode");
+            TEST_ASSERT(m == sizes[k] && memcmp(tunedbuf, data, m) == 0, "Tuned decode matches");
+        }
+    }
+    codec_set_nt_threshold(SIZE_MAX);
+
+    unlink(path);
+    unsetenv("B64_TUNE_CACHE");
+    free(data);
+    free(plain);
+    free(tunedbuf);
+    printf("PASS: Autotune test\n");
+    return 0;
+}
+
+int test_zero_runs_sparse() {
+    char path[] = "/tmp/b64sparseXXXXXX";
+    size_t size = 3 << 20, n;
+    unsigned char *data = calloc(1, size);
+    char *enc = malloc(codec_buf_size(BASE64, 0, size)), *back = malloc(size + 1);
+    struct finfo *fi;
+    int fd = mkstemp(path);
+
+    TEST_ASSERT(fd != -1 && data && enc && back, "Sparse setup");
+
+    /* zero blocks next to data, at and off block boundaries */
+    for (size_t i = 1000; i < 1100; i++) {
+        data[i] = (unsigned char)i;
+    }
+    data[4095] = 0x80;
+    memcpy(data + (2 << 20) + 7, "not a hole", 10);
+    b64_enc(data, enc, (unsigned int)size);
+    TEST_ASSERT(enc[0] == 'A' && enc[63] == 'A' && strspn(enc, "A") == 1000 / 3 * 4 + 1,
+                "Zero run output");
+    TEST_ASSERT(b64_dec((unsigned char *)enc, back, (unsigned int)strlen(enc)) == size &&
+                memcmp(back, data, size) == 0, "Zero run round-trip");
+    b64_enc(data + 1, enc, 100);
+    TEST_ASSERT(b64_dec((unsigned char *)enc, back, 136) == 100 && memcmp(back, data + 1, 100) == 0,
+                "Zero run short tail");
+
+    /* a file with holes reads as zeros */
+    TEST_ASSERT(ftruncate(fd, (off_t)size) == 0, "Sparse truncate");
+    TEST_ASSERT(pwrite(fd, data + 1000, 100, 1000) == 100 && pwrite(fd, data + 4095, 1, 4095) == 1 &&
+                pwrite(fd, data + (2 << 20) + 7, 10, (2 << 20) + 7) == 10, "Sparse write");
+    close(fd);
+    fi = get_file(path);
+    TEST_ASSERT(fi != NULL && fi->size == size && memcmp(fi->addr, data, size) == 0,
+                "Sparse get_file");
+    free_finfo(fi);
+    snprintf(back, size, "%s.b64", path);
+    TEST_ASSERT(encode_wr_file(path, back, BASE64) == 0, "Sparse encode_wr_file");
+    fi = get_file(back);
+    codec_mem(BASE64, 0, (char *)data, size, enc, &n);
+    TEST_ASSERT(fi != NULL && fi->size == n && memcmp(fi->addr, enc, n) == 0, "Sparse encoded file");
+    free_finfo(fi);
+    unlink(back);
+    unlink(path);
+
+    free(data);
+    free(enc);
+    free(back);
+    printf("PASS: Zero run and sparse file test\n");
+    return 0;
+}
+
+static int count_entries(const char *path) {
+    DIR *d = opendir(path);
+    struct dirent *de;
+    int n = 0;
+
+    while (d != NULL && (de = readdir(d)) != NULL) {
+        n += de->d_name[0] != '.';
+    }
+    if (d != NULL) {
+        closedir(d);
+    }
+    return n;
+}
+
+int test_result_cache() {
+    char dir[] = "/tmp/b64cacheXXXXXX";
+    char src[3][64], dst[4][64], path[96];
+    struct codec_cache *c;
+    struct stat s1, s2;
+    struct finfo *fi, *fi2;
+    FILE *fp;
+
+    TEST_ASSERT(mkdtemp(dir) != NULL, "Cache temp dir");
+    for (int i = 0; i < 3; i++) {
+        snprintf(src[i], sizeof(src[i]), "%s/in%d", dir, i);
+        fp = fopen(src[i], "w");
+        TEST_ASSERT(fp != NULL, "Cache input");
+        /* the third input has the content of the first */
+        for (int k = 0; k < 3000; k++) {
+            fputc((k * 7 + (i == 1)) & 0xff, fp);
+        }
+        fclose(fp);
+    }
+    for (int i = 0; i < 4; i++) {
+        snprintf(dst[i], sizeof(dst[i]), "%s/out%d", dir, i);
+    }
+    snprintf(path, sizeof(path), "%s/cache", dir);
+
+    c = codec_cache_open(path, 0, 0);
+    TEST_ASSERT(c != NULL, "Cache open");
+    TEST_ASSERT(codec_cache_file(c, src[0], dst[0], BASE64, 0) == 0, "Cache miss");
+    TEST_ASSERT(codec_cache_file(c, src[0], dst[1], BASE64, 0) == 0, "Cache hit");
+    TEST_ASSERT(stat(dst[0], &s1) == 0 && stat(dst[1], &s2) == 0 && s1.st_ino != s2.st_ino &&
+                s2.st_nlink == 1 && (s2.st_mode & S_IWUSR), "Cache hit is a writable copy");
+    TEST_ASSERT(codec_cache_file(c, src[2], dst[2], BASE64, 0) == 0, "Cache content hit");
+    snprintf(path, sizeof(path), "%s/cache/obj", dir);
+    TEST_ASSERT(count_entries(path) == 1, "Cache holds one object");
+
+    /* writing over a hit leaves the stored result alone */
+    fp = fopen(dst[1], "w");
+    TEST_ASSERT(fp != NULL, "Cache hit is writable");
+    fputs("not the encoding", fp);
+    fclose(fp);
+    TEST_ASSERT(codec_cache_file(c, src[0], dst[3], BASE64, 0) == 0, "Cache hit after overwrite");
+    fi = get_file(dst[0]);
+    fi2 = get_file(dst[3]);
+    TEST_ASSERT(fi != NULL && fi2 != NULL && fi->size == 4000 && fi2->size == 4000 &&
+                memcmp(fi->addr, fi2->addr, 4000) == 0, "Cache unharmed by an overwritten hit");
+    free_finfo(fi);
+    free_finfo(fi2);
+
+    fi = get_file(dst[2]);
+    TEST_ASSERT(fi != NULL && fi->size == 4000, "Cache output size");
+    free_finfo(fi);
+    TEST_ASSERT(codec_cache_file(c, dst[2], dst[3], BASE64, 1) == 0, "Cache decode");
+    fi = get_file(dst[3]);
+    TEST_ASSERT(fi != NULL && fi->size == 3000 && (unsigned char)fi->addr[1] == 7, "Cache decode content");
+    free_finfo(fi);
+    codec_cache_close(c);
+
+    /* room for one object only, the least recently used one goes */
+    snprintf(path, sizeof(path), "%s/cache", dir);
+    c = codec_cache_open(path, 4000, CACHE_LINK);
+    TEST_ASSERT(c != NULL, "Cache reopen");
+    TEST_ASSERT(codec_cache_file(c, src[1], dst[1], BASE64, 0) == 0, "Cache insert with eviction");
+    snprintf(path, sizeof(path), "%s/cache/obj", dir);
+    TEST_ASSERT(count_entries(path) == 1, "Cache evicted to its cap");
+    TEST_ASSERT(codec_cache_file(c, src[1], dst[2], BASE64, 0) == 0, "Cache hit in link mode");
+    TEST_ASSERT(stat(dst[1], &s1) == 0 && stat(dst[2], &s2) == 0 && s1.st_ino == s2.st_ino &&
+                s2.st_nlink == 3, "Cache link mode shares the object");
+    TEST_ASSERT(codec_cache_file(c, src[0], dst[0], BASE64, 0) == 0, "Cache miss after eviction");
+    fi = get_file(dst[0]);
+    TEST_ASSERT(fi != NULL && fi->size == 4000, "Cache recomputed output");
+    free_finfo(fi);
+    codec_cache_close(c);
+
+    snprintf(path, sizeof(path), "rm -rf %s", dir);
+    TEST_ASSERT(system(path) == 0, "Cache cleanup");
+    printf("PASS: Result cache test\n");
+    return 0;
+}
+
+int test_append_encode() {
+    static const unsigned char modes[3] = {BASE64, BASE32, BASE16};
+    const char *src = "/tmp/b64_append_src", *dst = "/tmp/b64_append_dst",
+               *ref = "/tmp/b64_append_ref";
+
+    for (int m = 0; m < 3; m++) {
+        struct finfo *a, *b;
+        FILE *fp = fopen(src, "w");
+
+        TEST_ASSERT(fp != NULL, "Append input");
+        for (int k = 0; k < 1000; k++) {
+            fputc((k * 13) & 0xff, fp);
+        }
+        fclose(fp);
+        unlink(dst);
+        TEST_ASSERT(encode_append_file(src, dst, modes[m]) == 0, "Append to a missing dst");
+
+        /* two rounds of growth, the first ends in the middle of a group */
+        for (int round = 0; round < 2; round++) {
+            fp = fopen(src, "a");
+            TEST_ASSERT(fp != NULL, "Append growth");
+            for (int k = 0; k < 70001 + round; k++) {
+                fputc((k * 29 + round) & 0xff, fp);
+            }
+            fclose(fp);
+            TEST_ASSERT(encode_append_file(src, dst, modes[m]) == 0, "Append new bytes");
+            TEST_ASSERT(encode_wr_file(src, ref, modes[m]) == 0, "Append reference");
+            a = get_file(dst);
+            b = get_file(ref);
+            TEST_ASSERT(a != NULL && b != NULL && a->size == b->size &&
+                        memcmp(a->addr, b->addr, a->size) == 0, "Append matches a full encode");
+            free_finfo(a);
+            free_finfo(b);
+        }
+
+        /* a replaced src does not match dst, it is encoded again */
+        fp = fopen(src, "w");
+        TEST_ASSERT(fp != NULL, "Append replaced input");
+        fputs("a different file that is longer than nothing", fp);
+        fclose(fp);
+        TEST_ASSERT(encode_append_file(src, dst, modes[m]) == 0, "Append after replace");
+        TEST_ASSERT(encode_wr_file(src, ref, modes[m]) == 0, "Append replace reference");
+        a = get_file(dst);
+        b = get_file(ref);
+        TEST_ASSERT(a != NULL && b != NULL && a->size == b->size &&
+                    memcmp(a->addr, b->addr, a->size) == 0, "Append re-encodes a replaced src");
+        free_finfo(a);
+        free_finfo(b);
+    }
+    TEST_ASSERT(encode_append_file(src, dst, 9) == -1 && errno == EINVAL, "Append bad mode");
+    unlink(src);
+    unlink(dst);
+    unlink(ref);
+    printf("PASS: Append encode test\n");
+    return 0;
+}
+
+int test_transcode() {
+    static const unsigned char modes[3] = {BASE64, BASE32, BASE16};
+    static const size_t sizes[4] = {0, 7, 3840, 100001};
+    const char *path = "/tmp/b64_transcode";
+    size_t n = 100001;
+    char *raw = malloc(n), *enc[3], *out;
+
+    TEST_ASSERT(raw != NULL, "Transcode buffers");
+    for (size_t i = 0; i < n; i++) {
+        raw[i] = (char)(i * 37 + (i >> 9));
+    }
+    for (int s = 0; s < 4; s++) {
+        size_t len[3];
+
+        for (int m = 0; m < 3; m++) {
+            enc[m] = malloc(codec_buf_size(modes[m], 0, sizes[s]) + 1);
+            TEST_ASSERT(enc[m] != NULL, "Transcode buffers");
+            TEST_ASSERT(codec_mem(modes[m], 0, raw, sizes[s], enc[m], &len[m]) == 0, "Transcode input");
+        }
+        for (int f = 0; f < 3; f++) {
+            /* a line break at the end is accepted as by the decoders */
+            if (modes[f] != BASE16) {
+                enc[f][len[f]] = '\n';
+            }
+            for (int t = 0; t < 3; t++) {
+                size_t in_len = len[f] + (modes[f] != BASE16), out_len;
+
+                out = malloc(transcode_buf_size(modes[f], modes[t], in_len));
+                TEST_ASSERT(out != NULL, "Transcode output buffer");
+                TEST_ASSERT(codec_transcode(modes[f], modes[t], enc[f], in_len, out, &out_len) == 0,
+                            "Transcode");
+                TEST_ASSERT(out_len == len[t] && memcmp(out, enc[t], out_len) == 0,
+                            "Transcode matches a direct encode");
+                free(out);
+            }
+            enc[f][len[f]] = '\0';
+        }
+        if (sizes[s] == n) {
+            /* streaming, the input spans several reads */
+            int ifd, ofd;
+            struct finfo *fi;
+            FILE *fp = fopen(path, "w");
+
+            TEST_ASSERT(fp != NULL && fwrite(enc[1], 1, len[1], fp) == len[1], "Transcode file");
+            fputc('\n', fp);
+            fclose(fp);
+            ifd = open(path, O_RDONLY);
+            ofd = open("/tmp/b64_transcode.out", O_CREAT | O_WRONLY | O_TRUNC, 0600);
+            TEST_ASSERT(ifd != -1 && ofd != -1, "Transcode open");
+            TEST_ASSERT(codec_transcode_fd(ifd, ofd, BASE32, BASE64) == 0, "Transcode stream");
+            close(ifd);
+            close(ofd);
+            fi = get_file("/tmp/b64_transcode.out");
+            TEST_ASSERT(fi != NULL && fi->size == len[0] && memcmp(fi->addr, enc[0], len[0]) == 0,
+                        "Transcode stream output");
+            free_finfo(fi);
+            unlink(path);
+            unlink("/tmp/b64_transcode.out");
+        }
+        for (int m = 0; m < 3; m++) {
+            free(enc[m]);
+        }
+    }
+
+    out = malloc(64);
+    TEST_ASSERT(out != NULL, "Transcode output buffer");
+    {
+        size_t out_len;
+        TEST_ASSERT(codec_transcode(BASE16, BASE64, "48656c6c6f", 10, out, &out_len) == 0 &&
+                    out_len == 8 && memcmp(out, "SGVsbG8=", 8) == 0, "Transcode hex to base64");
+        TEST_ASSERT(codec_transcode(BASE64, BASE16, "AB*CDEFG", 8, out, &out_len) == -1 &&
+                    errno == EINVAL, "Transcode rejects invalid input");
+        TEST_ASSERT(codec_transcode(7, BASE16, "AAAA", 4, out, &out_len) == -1 &&
+                    errno == EINVAL, "Transcode bad mode");
+    }
+    free(out);
+    free(raw);
+    printf("PASS: Transcode test\n");
+    return 0;
+}
+
+struct mime_seen {
+    int n;
+    size_t len[4];
+    int err[4];
+    char name[4][16];
+    char data[4][64];
+};
+
+static int mime_collect(const struct mime_part *p, void *arg) {
+    struct mime_seen *s = arg;
+
+    if (s->n < 4) {
+        s->len[s->n] = p->len;
+        s->err[s->n] = p->err;
+        snprintf(s->name[s->n], sizeof(s->name[0]), "%.*s", (int)p->name_len,
+                 p->name != NULL ? p->name : "");
+        memcpy(s->data[s->n], p->data, p->len < 64 ? p->len : 64);
+    }
+    s->n++;
+    return 0;
+}
+
+static int mime_stop(const struct mime_part *p, void *arg) {
+    (void)p;
+    (void)arg;
+    errno = EIO;
+    return -1;
+}
+
+int test_mime_scan() {
+    /* the second part has lines cut in the middle of groups */
+    const char *msg =
+        "From: a@example.com\r\n"
+        "Content-Type: multipart/mixed;\r\n"
+        "\tboundary=\"outer\"\r\n"
+        "\r\n"
+        "preamble\r\n"
+        "--outer\r\n"
+        "Content-Type: text/plain\r\n"
+        "\r\n"
+        "not base64 --outerx\r\n"
+        "--outer\r\n"
+        "Content-Type: application/octet-stream; name=\"a.bin\"\r\n"
+        "Content-Transfer-Encoding: BASE64\r\n"
+        "Content-Disposition: attachment; filename=report.txt\r\n"
+        "\r\n"
+        "SGVsbG8s\r\n"
+        "IHdvc\r\n"
+        "mxkIQ==\r\n"
+        "\r\n"
+        "--outer\r\n"
+        "Content-Type: multipart/alternative; boundary=inner\r\n"
+        "\r\n"
+        "--inner\r\n"
+        "Content-Transfer-Encoding: base64\r\n"
+        "\r\n"
+        "bmVzdGVk\r\n"
+        "--inner--\r\n"
+        "--outer\r\n"
+        "Content-Transfer-Encoding: base64\r\n"
+        "\r\n"
+        "bad*data\r\n"
+        "--outer--\r\n"
+        "epilogue\r\n";
+    const char *single =
+        "Subject: one\n"
+        "Content-Transfer-Encoding: base64\n"
+        "\n"
+        "Zm9v\n"
+        "YmFy\n";
+    struct mime_seen s;
+
+    memset(&s, 0, sizeof(s));
+    TEST_ASSERT(mime_scan(msg, strlen(msg), mime_collect, &s) == 3 && s.n == 3, "MIME part count");
+    TEST_ASSERT(s.err[0] == 0 && s.len[0] == 13 && memcmp(s.data[0], "Hello, world!", 13) == 0,
+                "MIME part split across lines");
+    TEST_ASSERT(strcmp(s.name[0], "report.txt") == 0, "MIME filename");
+    TEST_ASSERT(s.err[1] == 0 && s.len[1] == 6 && memcmp(s.data[1], "nested", 6) == 0,
+                "MIME nested multipart");
+    TEST_ASSERT(s.err[2] == EINVAL && s.len[2] == 0, "MIME invalid part reported");
+
+    memset(&s, 0, sizeof(s));
+    TEST_ASSERT(mime_scan(single, strlen(single), mime_collect, &s) == 1 &&
+                s.len[0] == 6 && memcmp(s.data[0], "foobar", 6) == 0, "MIME single part message");
+    TEST_ASSERT(mime_scan(msg, strlen(msg), mime_stop, NULL) == -1 && errno == EIO,
+                "MIME callback stops the scan");
+    memset(&s, 0, sizeof(s));
+    TEST_ASSERT(mime_scan("Subject: none\n\nbody\n", 20, mime_collect, &s) == 0 && s.n == 0,
+                "MIME message without parts");
+    printf("PASS: MIME scanner test\n");
+    return 0;
+}
+
+/* offset of the first invalid or cut sequence of 's', or -1 */
+static long utf8_first_bad(const unsigned char *s, size_t n) {
+    size_t i = 0;
+
+    while (i < n) {
+        unsigned char c = s[i], lo, hi;
+        size_t need = c < 0x80 ? 0 : c < 0xe0 ? 1 : c < 0xf0 ? 2 : 3;
+
+        if ((c >= 0x80 && c < 0xc2) || c > 0xf4) {
+            return (long)i;
+        }
+        lo = c == 0xe0 ? 0xa0 : c == 0xf0 ? 0x90 : 0x80;
+        hi = c == 0xed ? 0x9f : c == 0xf4 ? 0x8f : 0xbf;
+        for (size_t k = 1; k <= need; k++) {
+            if (i + k == n || s[i + k] < lo || s[i + k] > hi) {
+                return (long)i;
+            }
+            lo = 0x80;
+            hi = 0xbf;
+        }
+        i += need + 1;
+    }
+    return -1;
+}
+
+int test_utf8_decode() {
+    static const unsigned char modes[3] = {BASE64, BASE32, BASE16};
+    struct finfo *fi = get_file("utf-8.sampler.txt");
+    char *text, *enc, *out;
+    size_t n, enc_len, out_len, bad;
+
+    TEST_ASSERT(fi != NULL && fi->size > 8000, "UTF-8 sampler loaded");
+    n = fi->size;
+    text = malloc(n);
+    enc = malloc(codec_buf_size(BASE16, 0, n) + 1);
+    out = malloc(codec_buf_size(BASE16, 0, n) + 1);
+    TEST_ASSERT(text != NULL && enc != NULL && out != NULL, "UTF-8 buffers");
+    memcpy(text, fi->addr, n);
+    free_finfo(fi);
+
+    for (int m = 0; m < 3; m++) {
+        TEST_ASSERT(codec_mem(modes[m], 0, text, n, enc, &enc_len) == 0, "UTF-8 encode");
+        TEST_ASSERT(codec_dec_utf8(modes[m], enc, enc_len, out, &out_len, &bad) == 0 &&
+                    out_len == n && memcmp(out, text, n) == 0, "UTF-8 text decoded");
+    }
+
+    /* a sequence cut by the block boundary of 3840 bytes is still valid */
+    memset(text, 'a', 4000);
+    memcpy(text + 3838, "\xe2\x82\xac", 3);
+    codec_mem(BASE64, 0, text, 4000, enc, &enc_len);
+    TEST_ASSERT(codec_dec_utf8(BASE64, enc, enc_len, out, &out_len, &bad) == 0 && out_len == 4000,
+                "UTF-8 sequence across blocks");
+
+    /* overlong, surrogate, stray continuation and truncated sequences */
+    {
+        static const char *bad_seq[4] = {"\xc0\xaf", "\xed\xa0\x80", "\x80", "\xf0\x9f\x98"};
+        for (int k = 0; k < 4; k++) {
+            size_t at = k == 3 ? 4000 - 3 : 5000 - 1000 * (size_t)k;
+
+            memset(text, 'a', 6000);
+            memcpy(text + at, bad_seq[k], strlen(bad_seq[k]));
+            n = k == 3 ? 4000 : 6000;
+            codec_mem(BASE64, 0, text, n, enc, &enc_len);
+            bad = 0;
+            TEST_ASSERT(codec_dec_utf8(BASE64, enc, enc_len, out, &out_len, &bad) == -1 &&
+                        errno == EILSEQ && bad == at, "UTF-8 invalid sequence offset");
+        }
+    }
+    TEST_ASSERT(codec_dec_utf8(BASE64, "QUJD*", 5, out, &out_len, &bad) == -1 && errno == EINVAL,
+                "UTF-8 decode of invalid base64");
+
+    /* single bytes changed in multibyte text, the vector check and the
+       byte at a time one agree on the result and the offset */
+    fi = get_file("utf-8.sampler.txt");
+    TEST_ASSERT(fi != NULL, "UTF-8 sampler reloaded");
+    n = fi->size < 9000 ? fi->size : 9000;
+    for (size_t at = 0; at < n; at += 41) {
+        static const unsigned char vals[8] = {0x80, 0xbf, 0xc1, 0xe0, 0xed, 0xf4, 0xf5, 'z'};
+        unsigned char v = vals[at % 8];
+        long expect;
+
+        memcpy(text, fi->addr, n);
+        text[at] = (char)v;
+        expect = utf8_first_bad((const unsigned char *)text, n);
+        codec_mem(BASE64, 0, text, n, enc, &enc_len);
+        bad = 0;
+        if (expect == -1) {
+            TEST_ASSERT(codec_dec_utf8(BASE64, enc, enc_len, out, &out_len, &bad) == 0,
+                        "UTF-8 changed text still valid");
+        } else {
+            TEST_ASSERT(codec_dec_utf8(BASE64, enc, enc_len, out, &out_len, &bad) == -1 &&
+                        errno == EILSEQ && bad == (size_t)expect, "UTF-8 changed text offset");
+        }
+    }
+    free_finfo(fi);
+
+    free(text);
+    free(enc);
+    free(out);
+    printf("PASS: UTF-8 decode test\n");
+    return 0;
+}
+
+int test_hex_dump() {
+    unsigned char data[300];
+    char *dump, back[301];
+    size_t n, back_len;
+
+    for (int i = 0; i < 300; i++) {
+        data[i] = (unsigned char)(i * 7);
+    }
+    dump = malloc(b16_dump_size(300, 10, 3));
+    TEST_ASSERT(dump != NULL, "Dump buffer");
+
+    n = b16_dump((const unsigned char *)"hello\n", 6, 0, 0, 0, dump);
+    TEST_ASSERT(n == strlen(dump) && strcmp(dump,
+                "00000000: 6865 6c6c 6f0a                           hello.\n") == 0,
+                "Dump matches xxd");
+    n = b16_dump((const unsigned char *)"hello", 5, 0x123456789ULL, 5, 2, dump);
+    TEST_ASSERT(strcmp(dump, "123456789: 6865 6c6c 6f  hello\n") == 0, "Dump of a long offset");
+    n = b16_dump((const unsigned char *)"\x00\xff AZ", 5, 0, 4, 99, dump);
+    TEST_ASSERT(strcmp(dump, "00000000: 00ff2041  .. A\n00000004: 5a        Z\n") == 0,
+                "Dump without groups");
+
+    for (unsigned int cols = 1; cols <= 40; cols += 13) {
+        for (unsigned int group = 1; group <= 5; group += 2) {
+            free(dump);
+            dump = malloc(b16_dump_size(300, cols, group));
+            TEST_ASSERT(dump != NULL, "Dump buffer");
+            n = b16_dump(data, 300, 0, cols, group, dump);
+            TEST_ASSERT(n + 1 <= b16_dump_size(300, cols, group), "Dump within its size");
+            TEST_ASSERT(b16_undump(dump, n, back, &back_len) == 0 && back_len == 300 &&
+                        memcmp(back, data, 300) == 0, "Undump round trip");
+        }
+    }
+    TEST_ASSERT(b16_undump("48656c\n6c6f\n", 12, back, &back_len) == 0 && back_len == 5 &&
+                memcmp(back, "Hello", 5) == 0, "Undump plain hex");
+    TEST_ASSERT(b16_undump("00000000: 48zz  H.\n", 19, back, &back_len) == -1 && errno == EINVAL,
+                "Undump invalid hex");
+    TEST_ASSERT(b16_dump_size(10, 257, 2) == 0, "Dump width limit");
+    free(dump);
+    printf("PASS: Hex dump test\n");
+    return 0;
+}
+
+int test_base85() {
+    const unsigned char hello[8] = {0x86, 0x4F, 0xD2, 0x6F, 0xB5, 0x59, 0xF7, 0x5B};
+    char enc[64], dec[64], *big, *big_enc, *big_dec;
+    size_t n, m;
+
+    /* ZeroMQ RFC 32 test vector */
+    TEST_ASSERT(z85_enc(hello, enc, 8) == 10 && strcmp(enc, "HelloWorld") == 0, "Z85 vector");
+    TEST_ASSERT(z85_dec("HelloWorld", dec, 10) == 8 && memcmp(dec, hello, 8) == 0, "Z85 vector decode");
+    TEST_ASSERT(a85_enc((const unsigned char *)"Man is distinguished", enc, 20) == 25 &&
+                strcmp(enc, "9jqo^BlbD-BleB1DJ+*+F(f,q") == 0, "Ascii85 vector");
+    TEST_ASSERT(a85_enc((const unsigned char *)"\0\0\0\0ab", enc, 6) == 4 && strcmp(enc, "z@:B") == 0,
+                "Ascii85 zero group and tail");
+    TEST_ASSERT(a85_dec("<~9jqo^BlbD-\nBleB1DJ+*+F(f,q~>\n", dec, 31) == 20 &&
+                memcmp(dec, "Man is distinguished", 20) == 0, "Ascii85 delimiters and line breaks");
+    TEST_ASSERT(a85_dec("z@:B", dec, 4) == 6 && memcmp(dec, "\0\0\0\0ab", 6) == 0, "Ascii85 'z'");
+
+    errno = 0;
+    TEST_ASSERT(z85_dec("Hello\"orld", dec, 10) == 0 && errno == EINVAL, "Z85 invalid character");
+    errno = 0;
+    TEST_ASSERT(z85_dec("#####", dec, 5) == 0 && errno == EINVAL, "Z85 group out of range");
+    errno = 0;
+    TEST_ASSERT(a85_dec("9jqo^B", dec, 6) == 0 && errno == EINVAL, "Ascii85 single digit tail");
+    errno = 0;
+    TEST_ASSERT(a85_dec("9jzo^", dec, 5) == 0 && errno == EINVAL, "Ascii85 'z' inside a group");
+
+    /* every tail length through codec_mem, with zero groups in between */
+    big = malloc(1003);
+    big_enc = malloc(codec_buf_size(BASE85, 0, 1003));
+    big_dec = malloc(codec_buf_size(ASCII85, 1, codec_buf_size(BASE85, 0, 1003)));
+    TEST_ASSERT(big != NULL && big_enc != NULL && big_dec != NULL, "Base85 buffers");
+    for (int i = 0; i < 1003; i++) {
+        big[i] = (char)(i % 97 < 20 ? 0 : i * 31);
+    }
+    for (size_t len = 995; len <= 1003; len++) {
+        TEST_ASSERT(codec_mem(BASE85, 0, big, len, big_enc, &n) == 0 &&
+                    n == len / 4 * 5 + (len % 4 ? len % 4 + 1 : 0), "Z85 encoded size");
+        TEST_ASSERT(codec_mem(BASE85, 1, big_enc, n, big_dec, &m) == 0 && m == len &&
+                    memcmp(big_dec, big, len) == 0, "Z85 round trip");
+        TEST_ASSERT(codec_mem(ASCII85, 0, big, len, big_enc, &n) == 0 &&
+                    n < codec_buf_size(ASCII85, 0, len), "Ascii85 encode");
+        TEST_ASSERT(codec_mem(ASCII85, 1, big_enc, n, big_dec, &m) == 0 && m == len &&
+                    memcmp(big_dec, big, len) == 0, "Ascii85 round trip");
+    }
+    TEST_ASSERT(codec_pipe(0, 1, BASE85, 0, 1) == -1 && errno == EINVAL, "Base85 not split by pipelines");
+    free(big);
+    free(big_enc);
+    free(big_dec);
+    printf("PASS: Base85 test\n");
+    return 0;
+}
+
+/* the b64d daemon on a socket of its own and the b64c client in each of
+   its ways to send a request, the files are passed, sent inline or named */
+int test_daemon() {
+    static const char *kinds[3] = {"", "-i", "-P"};
+    char dir[] = "/tmp/b64dXXXXXX";
+    char sock[64], src[64], enc[64], dec[64], cmd[512];
+    char *data, *expect;
+    size_t len = 100003, enc_len;
+    struct finfo *fi;
+    struct stat st;
+    int listening = -1;
+    pid_t pid;
+    FILE *fp;
+
+    TEST_ASSERT(mkdtemp(dir) != NULL, "Daemon temp dir");
+    snprintf(sock, sizeof(sock), "%s/sock", dir);
+    snprintf(src, sizeof(src), "%s/in", dir);
+    snprintf(enc, sizeof(enc), "%s/in.b64", dir);
+    snprintf(dec, sizeof(dec), "%s/out", dir);
+    data = malloc(len);
+    expect = malloc(codec_buf_size(BASE32, 0, len));
+    TEST_ASSERT(data != NULL && expect != NULL, "Daemon buffers");
+    for (size_t i = 0; i < len; i++) {
+        data[i] = (char)(i * 11 + (i >> 9));
+    }
+    fp = fopen(src, "w");
+    TEST_ASSERT(fp != NULL && fwrite(data, 1, len, fp) == len, "Daemon input");
+    fclose(fp);
+
+    if ((pid = fork()) == 0) {
+        /* goes away with the tests, also when an assertion returns early */
+        prctl(PR_SET_PDEATHSIG, SIGTERM);
+        execl("./b64d", "b64d", "-S", sock, "-j", "2", (char *)NULL);
+        _exit(127);
+    }
+    TEST_ASSERT(pid > 0, "Daemon started");
+    for (int i = 0; i < 200 && (listening = stat(sock, &st)) == -1; i++) {
+        usleep(10000);
+    }
+    TEST_ASSERT(listening == 0 && S_ISSOCK(st.st_mode), "Daemon listening");
+
+    for (int m = 0; m < 2; m++) {
+        unsigned char mode = m == 0 ? BASE64 : BASE32;
+
+        codec_mem(mode, 0, data, len, expect, &enc_len);
+        for (int k = 0; k < 3; k++) {
+            unlink(enc);
+            unlink(dec);
+            snprintf(cmd, sizeof(cmd), "./b64c -t %s %s -S %s %s %s", m == 0 ? "64" : "32",
+                     kinds[k], sock, src, enc);
+            TEST_ASSERT(system(cmd) == 0, "Daemon encode request");
+            snprintf(cmd, sizeof(cmd), "./b64c -d -t %s %s -S %s %s %s", m == 0 ? "64" : "32",
+                     kinds[k], sock, enc, dec);
+            TEST_ASSERT(system(cmd) == 0, "Daemon decode request");
+            fi = get_file(enc);
+            TEST_ASSERT(fi != NULL && fi->size == enc_len && memcmp(fi->addr, expect, enc_len) == 0,
+                        "Daemon encoding matches codec_mem");
+            free_finfo(fi);
+            fi = get_file(dec);
+            TEST_ASSERT(fi != NULL && fi->size == len && memcmp(fi->addr, data, len) == 0,
+                        "Daemon round trip");
+            free_finfo(fi);
+        }
+    }
+
+    /* errors come back as a failed exit */
+    snprintf(cmd, sizeof(cmd), "./b64c -d -S %s %s %s 2>/dev/null", sock, src, dec);
+    TEST_ASSERT(system(cmd) != 0, "Daemon rejects invalid input");
+    snprintf(cmd, sizeof(cmd), "./b64c -t 99 -S %s %s %s 2>/dev/null", sock, src, enc);
+    TEST_ASSERT(system(cmd) != 0, "Client rejects an unknown base");
+
+    kill(pid, SIGTERM);
+    TEST_ASSERT(waitpid(pid, NULL, 0) == pid, "Daemon stopped");
+    free(data);
+    free(expect);
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+    TEST_ASSERT(system(cmd) == 0, "Daemon cleanup");
+    printf("PASS: Daemon test\n");
+    return 0;
+}
+
 int main(void) {
     int failures = 0;
 
@@ -283,8 +1791,33 @@ int main(void) {
     failures += test_b64_invalid_input();
     failures += test_b32_roundtrip();
     failures += test_b32_invalid_input();
+    failures += test_b32_rfc4648_vectors();
     failures += test_b16_roundtrip();
     failures += test_b16_invalid_input();
+    failures += test_batch_files();
+    failures += test_codec_stats();
+    failures += test_allocator_arena();
+    failures += test_validate();
+    failures += test_b64_dec_range();
+    failures += test_crc32c();
+    failures += test_inline_fixed_sizes();
+    failures += test_async_pool();
+    failures += test_nt_stores();
+    failures += test_iovec();
+    failures += test_mmap_output();
+    failures += test_mem_policy();
+    failures += test_pipeline();
+    failures += test_records();
+    failures += test_autotune();
+    failures += test_zero_runs_sparse();
+    failures += test_result_cache();
+    failures += test_append_encode();
+    failures += test_transcode();
+    failures += test_mime_scan();
+    failures += test_utf8_decode();
+    failures += test_hex_dump();
+    failures += test_base85();
+    failures += test_daemon();
     
     printf("\n======================\n");
     if (failures == 0) {
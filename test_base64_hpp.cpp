@@ -0,0 +1,154 @@
+/*
+ * Unit tests for the C++ interface in base64.hpp
+ * Run with: make test
+ *
+ * Copyright Orestes Leal Rodriguez 2015-2025
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "base64.hpp"
+
+#define TEST_ASSERT(cond, msg) \
+    do { \
+        if (!(cond)) { \
+            printf("FAIL: %s\n", msg); \
+            return 1; \
+        } \
+    } while(0)
+
+/* evaluated by the compiler, a failure does not build */
+constexpr auto hello = b64::encode_literal("Hello, World!");
+constexpr auto back = b64::decode_literal("SGVsbG8sIFdvcmxkIQ==");
+static_assert(hello.view() == "SGVsbG8sIFdvcmxkIQ==", "encode_literal");
+static_assert(back.view() == "Hello, World!", "decode_literal");
+static_assert(b64::encode_literal("").size() == 0, "encode_literal of nothing");
+static_assert(b64::encode_literal("f").view() == "Zg==", "encode_literal, one byte");
+static_assert(b64::encode_literal("fo").view() == "Zm8=", "encode_literal, two bytes");
+static_assert(b64::decode_literal("Zm9vYg==").view() == "foob", "decode_literal, padded");
+static_assert(b64::decode_literal("Zm9vYmE=").view() == "fooba", "decode_literal, padded");
+
+int test_literals() {
+    char c[64];
+    unsigned int n;
+
+    /* same output as the C codecs, including bytes above 0x7f */
+    constexpr auto high = b64::encode_literal("\xff\xfe\x80\x00z");
+    b64_enc((const unsigned char *)"\xff\xfe\x80\x00z", c, 5);
+    TEST_ASSERT(high.view() == c, "Literal matches b64_enc");
+    n = b64_dec((const unsigned char *)high.c_str(), c, (unsigned int)high.size());
+    TEST_ASSERT(b64::decode_literal("//6AAHo=").view() == std::string_view(c, n),
+                "Literal decode matches b64_dec");
+    TEST_ASSERT(hello.c_str()[hello.size()] == '\0', "Literal is null terminated");
+
+    /* out of a constant expression invalid input throws */
+    bool threw = false;
+    try {
+        (void)b64::decode_literal("Zm9*");
+    } catch (const std::invalid_argument &) {
+        threw = true;
+    }
+    TEST_ASSERT(threw, "Literal decode rejects bad input");
+    printf("PASS: Literals test\n");
+    return 0;
+}
+
+int test_runtime() {
+    std::string raw;
+    for (int i = 0; i < 100003; i++) {
+        raw += (char)(i * 31 + (i >> 7));
+    }
+
+    for (auto e : {b64::encoding::base64, b64::encoding::base32, b64::encoding::base16,
+                   b64::encoding::z85, b64::encoding::ascii85}) {
+        unsigned char mode = static_cast<unsigned char>(e);
+        std::vector<char> expected(codec_buf_size(mode, 0, raw.size()));
+        size_t n;
+
+        codec_mem(mode, 0, raw.data(), raw.size(), expected.data(), &n);
+        std::string enc = b64::encode(raw, e);
+        TEST_ASSERT(enc == std::string_view(expected.data(), n), "Encode to a string");
+        TEST_ASSERT(b64::decode(enc, e) == raw, "Decode to a string");
+
+        /* caller storage, reused buffers */
+        std::vector<char> out(b64::encode_bound(raw.size(), e));
+        TEST_ASSERT(b64::encode(raw, out.data(), out.size(), e) == n &&
+                    memcmp(out.data(), expected.data(), n) == 0, "Encode to caller memory");
+        b64::buffer b;
+        b64::encode_into(b, raw, e);
+        TEST_ASSERT(b.view() == enc, "Encode to a buffer");
+        const char *storage = b.data();
+        b64::decode_into(b, std::string_view(enc).substr(0, 40), e);
+        TEST_ASSERT(b.data() == storage && b.size() > 0, "Buffer storage reused");
+        b64::decode_into(b, enc, e);
+        TEST_ASSERT(b.view() == raw, "Decode to a buffer");
+        std::string s;
+        b64::decode_into(s, enc, e);
+        TEST_ASSERT(s == raw, "Decode into a string");
+    }
+
+    /* errors */
+    std::error_code ec;
+    char small[8];
+    TEST_ASSERT(b64::encode("abcdef", small, sizeof(small), b64::encoding::base64, ec) == 0 &&
+                ec == std::errc::no_buffer_space, "Encode to a short buffer");
+    TEST_ASSERT(b64::decode("Zm9*", small, sizeof(small), b64::encoding::base64, ec) == 0 &&
+                ec == std::errc::invalid_argument, "Decode bad input with an error code");
+    bool threw = false;
+    try {
+        b64::decode("Zm9*");
+    } catch (const std::system_error &e) {
+        threw = e.code() == std::errc::invalid_argument;
+    }
+    TEST_ASSERT(threw, "Decode bad input throws");
+
+#ifdef B64_HAS_SPAN
+    std::vector<unsigned char> bytes(raw.begin(), raw.end());
+    std::vector<std::byte> sbytes(bytes.size());
+    std::memcpy(sbytes.data(), bytes.data(), bytes.size());
+    std::vector<char> out(b64::encode_bound(bytes.size()));
+    size_t n = b64::encode(std::span<const unsigned char>(bytes), std::span<char>(out));
+    TEST_ASSERT(std::string_view(out.data(), n) == b64::encode(raw), "Encode a span of bytes");
+    TEST_ASSERT(b64::encode(std::span<const std::byte>(sbytes)) == b64::encode(raw),
+                "Encode a span of std::byte");
+    std::vector<char> dec(b64::decode_bound(n));
+    TEST_ASSERT(b64::decode(std::string_view(out.data(), n), std::span<char>(dec)) == raw.size() &&
+                memcmp(dec.data(), raw.data(), raw.size()) == 0, "Decode to a span");
+#endif
+    printf("PASS: Runtime test\n");
+    return 0;
+}
+
+int main() {
+    int failures = 0;
+    char tune[] = "/tmp/test_b64_hpp_tune_XXXXXX";
+    int fd = mkstemp(tune);
+
+    /* keep the user's tuning cache out of the results */
+    if (fd == -1) {
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+    setenv("B64_TUNE_CACHE", tune, 1);
+
+    printf("Running C++ interface tests...\n");
+    printf("==============================\n\n");
+
+    failures += test_literals();
+    failures += test_runtime();
+
+    unlink(tune);
+
+    printf("\n==============================\n");
+    if (failures == 0) {
+        printf("All tests PASSED! ✓\n");
+    } else {
+        printf("Tests completed with %d failure(s)\n", failures);
+    }
+
+    return failures;
+}